@@ -0,0 +1,70 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "bench/helpers/chunk.h"
+
+// Each get maps the chunk and each release of the last reference
+// unmaps it, as when peers request blocks from chunks not otherwise
+// in use.
+static void
+bench_chunk_list_get_release(benchmark::State& state) {
+  const uint32_t chunk_size  = state.range(0);
+  const uint32_t chunk_count = 64;
+
+  bench_chunk_list chunk_list(
+    chunk_size, chunk_count, [chunk_size](uint32_t index, int) {
+      return bench_create_anon_chunk(index, chunk_size);
+    });
+
+  uint32_t index = 0;
+
+  for (auto _ : state) {
+    torrent::ChunkHandle handle = chunk_list->get(index++ % chunk_count);
+
+    benchmark::DoNotOptimize(handle.chunk());
+
+    chunk_list->release(&handle);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(bench_chunk_list_get_release)
+  ->RangeMultiplier(16)
+  ->Range(16 << 10, 4 << 20);
+
+// Holds a reference to every chunk, so get and release only touch
+// the reference counts.
+static void
+bench_chunk_list_get_release_held(benchmark::State& state) {
+  const uint32_t chunk_size  = 1 << 20;
+  const uint32_t chunk_count = 64;
+
+  bench_chunk_list chunk_list(
+    chunk_size, chunk_count, [chunk_size](uint32_t index, int) {
+      return bench_create_anon_chunk(index, chunk_size);
+    });
+
+  std::vector<torrent::ChunkHandle> held;
+
+  for (uint32_t index = 0; index < chunk_count; index++)
+    held.push_back(chunk_list->get(index));
+
+  uint32_t index = 0;
+
+  for (auto _ : state) {
+    torrent::ChunkHandle handle = chunk_list->get(index++ % chunk_count);
+
+    benchmark::DoNotOptimize(handle.chunk());
+
+    chunk_list->release(&handle);
+  }
+
+  for (auto& handle : held)
+    chunk_list->release(&handle);
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(bench_chunk_list_get_release_held);
@@ -0,0 +1,66 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "bench/helpers/chunk.h"
+#include "data/hash_check_queue.h"
+#include "data/hash_chunk.h"
+#include "torrent/hash_string.h"
+
+// Queues every chunk of a file and hashes them on the calling
+// thread, from mapping the chunks to the done slot. The file is in
+// the page cache, so this measures the overhead of each read mode
+// rather than the disk.
+static void
+bench_hash_check_queue(benchmark::State& state) {
+  const uint32_t read_mode   = state.range(0);
+  const uint32_t chunk_size  = 1 << 20;
+  const uint32_t chunk_count = 32;
+
+  bench_file       file(chunk_size, chunk_count);
+  bench_chunk_list chunk_list(
+    chunk_size, chunk_count, [&file](uint32_t index, int) {
+      return file.create_chunk(index);
+    });
+
+  torrent::HashCheckQueue hash_queue;
+  uint32_t                done_count = 0;
+
+  hash_queue.slot_chunk_done() =
+    [&done_count](torrent::HashChunk*, const torrent::HashString&) {
+      done_count++;
+    };
+
+  std::vector<torrent::ChunkHandle> handles(chunk_count);
+  std::vector<torrent::HashChunk*>  chunks(chunk_count);
+
+  for (auto _ : state) {
+    for (uint32_t index = 0; index < chunk_count; index++) {
+      handles[index] = chunk_list->get(index, torrent::ChunkList::get_blocking);
+      chunks[index]  = new torrent::HashChunk(handles[index]);
+      chunks[index]->set_read_mode(read_mode);
+
+      hash_queue.push_back(chunks[index]);
+    }
+
+    hash_queue.perform();
+
+    for (uint32_t index = 0; index < chunk_count; index++) {
+      chunk_list->release(&handles[index]);
+      delete chunks[index];
+    }
+  }
+
+  if (done_count != state.iterations() * chunk_count)
+    state.SkipWithError("Not all chunks were hashed.");
+
+  state.SetBytesProcessed(int64_t(state.iterations()) * chunk_count *
+                          chunk_size);
+  state.SetItemsProcessed(int64_t(state.iterations()) * chunk_count);
+}
+
+BENCHMARK(bench_hash_check_queue)
+  ->ArgName("read_mode")
+  ->Arg(torrent::ChunkManager::recheck_read_mmap)
+  ->Arg(torrent::ChunkManager::recheck_read_pread)
+  ->Arg(torrent::ChunkManager::recheck_read_direct);
@@ -0,0 +1,45 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "bench/helpers/chunk.h"
+#include "data/hash_chunk.h"
+
+// Hashes chunks already mapped in memory, as when checking a chunk
+// that was just downloaded.
+static void
+bench_hash_chunk_perform(benchmark::State& state) {
+  const uint32_t chunk_size  = state.range(0);
+  const uint32_t chunk_count = 8;
+
+  bench_chunk_list chunk_list(
+    chunk_size, chunk_count, [chunk_size](uint32_t index, int) {
+      return bench_create_anon_chunk(index, chunk_size);
+    });
+
+  std::vector<torrent::ChunkHandle> handles;
+
+  for (uint32_t index = 0; index < chunk_count; index++)
+    handles.push_back(chunk_list->get(index, torrent::ChunkList::get_blocking));
+
+  char     hash[20];
+  uint32_t index = 0;
+
+  for (auto _ : state) {
+    torrent::HashChunk hash_chunk(handles[index++ % chunk_count]);
+
+    hash_chunk.perform(~uint32_t(), true);
+    hash_chunk.hash_c(hash);
+
+    benchmark::DoNotOptimize(hash);
+  }
+
+  for (auto& handle : handles)
+    chunk_list->release(&handle);
+
+  state.SetBytesProcessed(int64_t(state.iterations()) * chunk_size);
+}
+
+BENCHMARK(bench_hash_chunk_perform)
+  ->RangeMultiplier(4)
+  ->Range(256 << 10, 16 << 20);
@@ -0,0 +1,62 @@
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "utils/sha1.h"
+
+static void
+bench_sha1(benchmark::State& state) {
+  std::string   buffer(state.range(0), 'a');
+  char          hash[20];
+  torrent::Sha1 sha1;
+
+  for (auto _ : state) {
+    sha1.init();
+    sha1.update(buffer.data(), buffer.size());
+    sha1.final_c(hash);
+
+    benchmark::DoNotOptimize(hash);
+  }
+
+  state.SetBytesProcessed(int64_t(state.iterations()) * buffer.size());
+}
+
+BENCHMARK(bench_sha1)->RangeMultiplier(16)->Range(16 << 10, 4 << 20);
+
+static void
+bench_sha1_multi(benchmark::State& state) {
+  if (!torrent::Sha1Multi::is_supported()) {
+    state.SkipWithError("no multi-buffer kernel for this CPU");
+    return;
+  }
+
+  unsigned int lanes = torrent::Sha1Multi::preferred_lanes();
+
+  std::vector<std::string> buffers(lanes, std::string(state.range(0), 'a'));
+  std::vector<char>        hashes(lanes * 20);
+
+  const void* data[torrent::Sha1Multi::max_lanes];
+  char*       results[torrent::Sha1Multi::max_lanes];
+
+  for (unsigned int i = 0; i < lanes; i++) {
+    data[i]    = buffers[i].data();
+    results[i] = hashes.data() + i * 20;
+  }
+
+  torrent::Sha1Multi sha1;
+
+  for (auto _ : state) {
+    sha1.init(lanes);
+    sha1.update(data, state.range(0));
+    sha1.final_c(results);
+
+    benchmark::DoNotOptimize(hashes.data());
+  }
+
+  state.counters["lanes"] = lanes;
+  state.SetBytesProcessed(int64_t(state.iterations()) * lanes *
+                          state.range(0));
+}
+
+BENCHMARK(bench_sha1_multi)->RangeMultiplier(16)->Range(16 << 10, 4 << 20);
@@ -0,0 +1,91 @@
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bench/helpers/chunk.h"
+#include "data/chunk.h"
+#include "data/memory_chunk.h"
+#include "data/socket_file.h"
+#include "torrent/exceptions.h"
+
+torrent::Chunk*
+bench_create_anon_chunk(uint32_t index, uint32_t chunk_size) {
+  char* memory = (char*)mmap(nullptr,
+                             chunk_size,
+                             PROT_READ | PROT_WRITE,
+                             MAP_ANON | MAP_PRIVATE,
+                             -1,
+                             0);
+
+  if (memory == MAP_FAILED)
+    throw torrent::internal_error("bench_create_anon_chunk() mmap failed.");
+
+  std::memset(memory, index, chunk_size);
+
+  auto chunk = new torrent::Chunk();
+  chunk->push_back(torrent::ChunkPart::MAPPED_MMAP,
+                   torrent::MemoryChunk(memory,
+                                        memory,
+                                        memory + chunk_size,
+                                        torrent::MemoryChunk::prot_read,
+                                        0));
+  return chunk;
+}
+
+bench_file::bench_file(uint32_t chunk_size, uint32_t chunk_count)
+  : m_chunk_size(chunk_size) {
+  char path[] = "/tmp/libtorrent_bench.XXXXXX";
+
+  if ((m_fd = mkstemp(path)) == -1)
+    throw torrent::internal_error("bench_file::bench_file() mkstemp failed.");
+
+  m_path = path;
+  set_frozen_path(m_path);
+
+  std::string buffer(chunk_size, '\0');
+
+  for (uint32_t index = 0; index < chunk_count; index++) {
+    std::memset(buffer.data(), index, chunk_size);
+
+    if (pwrite(m_fd, buffer.data(), chunk_size, uint64_t(index) * chunk_size) !=
+        ssize_t(chunk_size))
+      throw torrent::internal_error("bench_file::bench_file() pwrite failed.");
+  }
+}
+
+bench_file::~bench_file() {
+  ::close(m_fd);
+  ::unlink(m_path.c_str());
+}
+
+torrent::Chunk*
+bench_file::create_chunk(uint32_t index) {
+  uint64_t offset = uint64_t(index) * m_chunk_size;
+
+  torrent::MemoryChunk memory_chunk =
+    torrent::SocketFile(m_fd).create_chunk(offset,
+                                           m_chunk_size,
+                                           torrent::MemoryChunk::prot_read,
+                                           torrent::MemoryChunk::map_shared);
+
+  if (!memory_chunk.is_valid())
+    throw torrent::internal_error("bench_file::create_chunk() mmap failed.");
+
+  auto chunk = new torrent::Chunk();
+  chunk->push_back(torrent::ChunkPart::MAPPED_MMAP, memory_chunk);
+  chunk->back().set_file(this, offset);
+  return chunk;
+}
+
+bench_chunk_list::bench_chunk_list(
+  uint32_t                             chunk_size,
+  uint32_t                             chunk_count,
+  torrent::ChunkList::slot_chunk_index slot) {
+  m_chunk_list.set_manager(&m_chunk_manager);
+  m_chunk_list.slot_create_chunk()   = std::move(slot);
+  m_chunk_list.slot_free_diskspace() = []() { return uint64_t(); };
+  m_chunk_list.slot_storage_error()  = [](const std::string&) {};
+  m_chunk_list.set_chunk_size(chunk_size);
+  m_chunk_list.resize(chunk_count);
+}
@@ -0,0 +1,5 @@
+#include <benchmark/benchmark.h>
+
+// Use '--benchmark_format=json' or '--benchmark_out=<file>' for
+// results that can be compared between releases.
+BENCHMARK_MAIN();
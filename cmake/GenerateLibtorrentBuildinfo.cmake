@@ -80,6 +80,38 @@ if(HAVE_INOTIFY)
   file(APPEND ${BUILDINFO_H} "#define LT_HAVE_INOTIFY 1\n\n")
 endif()
 
+check_cxx_source_compiles(
+  "
+  #include <sys/sendfile.h>
+  int main() {
+    off_t offset = 0;
+    return sendfile(1, 0, &offset, 1);
+  }
+  "
+  HAVE_SENDFILE)
+
+if(HAVE_SENDFILE)
+  file(APPEND ${BUILDINFO_H} "/* Linux's sendfile supported */\n")
+  file(APPEND ${BUILDINFO_H} "#define LT_HAVE_SENDFILE 1\n\n")
+endif()
+
+check_cxx_source_compiles(
+  "
+  #include <ctime>
+  #include <linux/errqueue.h>
+  #include <sys/socket.h>
+  int main() {
+    return MSG_ZEROCOPY + SO_ZEROCOPY + SO_EE_ORIGIN_ZEROCOPY +
+           SO_EE_CODE_ZEROCOPY_COPIED;
+  }
+  "
+  HAVE_MSG_ZEROCOPY)
+
+if(HAVE_MSG_ZEROCOPY)
+  file(APPEND ${BUILDINFO_H} "/* Linux's MSG_ZEROCOPY supported */\n")
+  file(APPEND ${BUILDINFO_H} "#define LT_HAVE_MSG_ZEROCOPY 1\n\n")
+endif()
+
 file(APPEND ${BUILDINFO_H} "/* Default address space size */\n")
 check_type_size("long" LONG_SIZE)
 if(LONG_SIZE GREATER_EQUAL 8)
@@ -188,6 +220,20 @@ if(USE_MADVISE)
   file(APPEND ${BUILDINFO_H} "#define LT_USE_MADVISE 1\n\n")
 endif()
 
+check_cxx_source_compiles(
+  "
+  #include <fcntl.h>
+  int main() {
+    posix_fadvise(0, 0, 0, POSIX_FADV_DONTNEED);
+  }
+  "
+  USE_POSIX_FADVISE)
+
+if(USE_POSIX_FADVISE)
+  file(APPEND ${BUILDINFO_H} "/* Use posix_fadvise */\n")
+  file(APPEND ${BUILDINFO_H} "#define LT_USE_POSIX_FADVISE 1\n\n")
+endif()
+
 check_cxx_source_compiles(
   "
   #include <sys/types.h>
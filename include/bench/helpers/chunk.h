@@ -0,0 +1,48 @@
+#ifndef LIBTORRENT_BENCH_HELPERS_CHUNK_H
+#define LIBTORRENT_BENCH_HELPERS_CHUNK_H
+
+#include <string>
+
+#include "data/chunk_list.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/data/file.h"
+
+// Chunks backed by anonymous memory, filled with the chunk index.
+torrent::Chunk*
+bench_create_anon_chunk(uint32_t index, uint32_t chunk_size);
+
+// A temporary file holding 'chunk_count' chunks, which are mapped
+// from the file so that they can also be read with pread.
+class bench_file : public torrent::File {
+public:
+  bench_file(uint32_t chunk_size, uint32_t chunk_count);
+  ~bench_file();
+
+  torrent::Chunk* create_chunk(uint32_t index);
+
+private:
+  bench_file(const bench_file&) = delete;
+  void operator=(const bench_file&) = delete;
+
+  int         m_fd;
+  std::string m_path;
+  uint32_t    m_chunk_size;
+};
+
+// Owns a ChunkList and its ChunkManager, creating chunks with 'slot'.
+class bench_chunk_list {
+public:
+  bench_chunk_list(uint32_t                             chunk_size,
+                   uint32_t                             chunk_count,
+                   torrent::ChunkList::slot_chunk_index slot);
+
+  torrent::ChunkList* operator->() {
+    return &m_chunk_list;
+  }
+
+private:
+  torrent::ChunkManager m_chunk_manager;
+  torrent::ChunkList    m_chunk_list;
+};
+
+#endif
@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_DATA_ALLOCATE_QUEUE_H
+#define LIBTORRENT_DATA_ALLOCATE_QUEUE_H
+
+#include <cinttypes>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+
+#include "data/device_stats.h"
+#include "torrent/utils/cacheline.h"
+#include "utils/mpsc_queue.h"
+
+namespace torrent {
+
+// Resizes and preallocates files on a disk thread, as fallocate and
+// the vfat workaround in SocketFile::set_size may take minutes for
+// large files.
+//
+// The jobs only hold duplicated file descriptors, so the file manager
+// is free to close the files while they are being allocated.
+
+class lt_cacheline_aligned AllocateQueue {
+public:
+  using slot_void   = std::function<void()>;
+  using slot_device = std::function<void(uint64_t)>;
+  using slot_result = std::function<void(int)>;
+
+  AllocateQueue() = default;
+  ~AllocateQueue();
+
+  // The number of jobs pushed whose slot has not yet been called.
+  size_t size() const {
+    return m_size;
+  }
+
+  // Takes ownership of 'fd', which is resized to 'size' bytes using
+  // the SocketFile::set_size flags by the worker of 'device'. The slot
+  // is called with zero or the errno of the failure.
+  void push_back(const void* owner,
+                 uint64_t    device,
+                 int         fd,
+                 uint64_t    size,
+                 int         flags,
+                 slot_result slot);
+
+  // Cancels the pending jobs of 'owner', calling their slots with
+  // ECANCELED, and blocks until the jobs already being performed
+  // complete. Only the slots of the owner are called, the jobs of
+  // others are left to the workers and 'work'.
+  void erase(const void* owner);
+
+  // The number of jobs waiting to be performed on the device.
+  size_t pending(uint64_t device);
+
+  // Called by the device's worker thread, performs its jobs until
+  // none are pending.
+  void perform(uint64_t device, device_stats* stats);
+
+  // Called on the main thread to receive completed jobs.
+  void work();
+
+  // Wakes up the worker of the device after a job is pushed.
+  slot_device& slot_interrupt() {
+    return m_slot_interrupt;
+  }
+
+  // Called by a worker thread when there are completed jobs and the
+  // main thread needs to call 'work'.
+  slot_void& slot_has_work() {
+    return m_slot_has_work;
+  }
+
+private:
+  AllocateQueue(const AllocateQueue&) = delete;
+  void operator=(const AllocateQueue&) = delete;
+
+  struct job {
+    const void* owner;
+    int         fd;
+    uint64_t    size;
+    int         flags;
+    int         error{ 0 };
+    slot_result slot;
+    job*        m_done_next{ nullptr };
+  };
+
+  using done_queue_type = mpsc_queue<job, &job::m_done_next>;
+
+  void finish(job* j);
+
+  size_t m_size{ 0 };
+
+  // The number of jobs being performed for each owner. Only the main
+  // thread calls 'erase', so there is at most one owner waiting for
+  // its jobs to complete.
+  std::map<const void*, unsigned int> m_running;
+  bool                                m_waiting{ false };
+  const void*                         m_waiting_owner{ nullptr };
+  std::promise<void>                  m_waiting_done;
+
+  std::map<uint64_t, std::deque<job*>> m_pending;
+  std::mutex                           m_lock;
+  done_queue_type                      m_done_queue;
+
+  slot_device m_slot_interrupt;
+  slot_void   m_slot_has_work;
+};
+
+} // namespace torrent
+
+#endif
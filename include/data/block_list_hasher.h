@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_DATA_BLOCK_LIST_HASHER_H
+#define LIBTORRENT_DATA_BLOCK_LIST_HASHER_H
+
+#include <map>
+#include <memory>
+
+#include "utils/sha1.h"
+
+namespace torrent {
+
+class Block;
+class Chunk;
+
+// Hashes the blocks of an in-progress piece as they are completed, so
+// the piece hash is ready as soon as the last block lands and the
+// chunk does not need to be read back through the HashQueue.
+//
+// Blocks are consumed in order while the data is still hot in the
+// cache, and blocks completed out of order are copied aside until the
+// blocks before them are done. If the copies would grow beyond
+// max_pending_size, the hasher gives up and the piece is checked by
+// the HashQueue as before.
+
+class BlockListHasher {
+public:
+  static constexpr uint32_t max_pending_size = 1 << 20;
+
+  BlockListHasher(uint32_t size)
+    : m_size(size) {
+    clear();
+  }
+
+  bool is_valid() const {
+    return m_valid;
+  }
+
+  uint32_t next_block() const {
+    return m_next;
+  }
+  uint32_t pending_size() const {
+    return m_pending_size;
+  }
+
+  // Restart the hash, called when the blocks are to be downloaded
+  // again.
+  void clear();
+
+  // The chunk data may have been changed behind our back, e.g. by
+  // retrying with blocks from failed attempts.
+  void invalidate();
+
+  // The block must be finished and its data written to 'chunk'.
+  void block_completed(const Block* block, Chunk* chunk);
+
+  // Returns false unless all the blocks have been hashed, otherwise
+  // the hasher is invalidated after writing the result.
+  bool hash_c(char* buffer);
+
+private:
+  void update_chunk(Chunk* chunk, uint32_t position, uint32_t length);
+
+  Sha1     m_hash;
+  uint32_t m_size;
+  uint32_t m_next;
+  bool     m_valid;
+
+  std::map<uint32_t, std::unique_ptr<char[]>> m_pending;
+  uint32_t                                    m_pending_size;
+};
+
+} // namespace torrent
+
+#endif
@@ -73,6 +73,15 @@ public:
 
   bool sync(int flags);
 
+  // Records a write to the range, so that MAPPED_BUFFER parts know
+  // what to write back when synced. Writes through 'from_buffer' are
+  // marked automatically.
+  void mark_dirty(uint32_t position, uint32_t length);
+
+  // Fills the range of MAPPED_BUFFER parts from the file, skipping
+  // what has already been written or loaded. Use errno if it fails.
+  bool load(uint32_t position, uint32_t length);
+
   void preload(uint32_t position, uint32_t length, bool useAdvise);
 
   bool to_buffer(void* buffer, uint32_t position, uint32_t length);
@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_DATA_CHUNK_CACHE_H
+#define LIBTORRENT_DATA_CHUNK_CACHE_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+
+namespace torrent {
+
+class ChunkList;
+class ChunkListNode;
+
+// Keeps the mappings of unreferenced chunks so that popular pieces
+// served to many peers are not repeatedly mapped and unmapped. The
+// cache is shared by all downloads, and evicted with ARC using the
+// chunk sizes as weights.
+//
+// Chunks seen once are kept in the recent list, and those got again
+// while cached move to the frequent list. The ghost lists remember
+// the evicted chunks, a miss on one of them shifts the target size
+// of the recent list towards the list that would have kept it.
+//
+// Evicted chunks are unmapped by calling ChunkList::clear_cached.
+
+class ChunkCache {
+public:
+  ChunkCache() = default;
+
+  uint64_t usage() const {
+    return m_lists[list_recent].size + m_lists[list_frequent].size;
+  }
+  size_t size() const {
+    return m_lists[list_recent].entries.size() +
+           m_lists[list_frequent].entries.size();
+  }
+
+  uint64_t recent_usage() const {
+    return m_lists[list_recent].size;
+  }
+  uint64_t frequent_usage() const {
+    return m_lists[list_frequent].size;
+  }
+  uint64_t recent_target() const {
+    return m_recent_target;
+  }
+
+  bool is_cached(const ChunkListNode* node) const;
+
+  // Called when the last reference to the node is released, returns
+  // false if the chunk should be unmapped by the caller.
+  bool insert(ChunkList* chunk_list,
+              ChunkListNode* node,
+              uint32_t       size,
+              uint64_t       capacity);
+
+  // Removes a cached node that is being referenced again, it is
+  // moved to the frequent list when released.
+  void hit(ChunkListNode* node);
+
+  // Evicts until no more than 'capacity' bytes are cached.
+  void evict(uint64_t capacity);
+
+  // Evicts the chunks of a chunk list that is being cleared, and
+  // forgets its ghost entries.
+  void erase(ChunkList* chunk_list);
+
+  // Evicts a single unreferenced chunk whose data is being discarded,
+  // does nothing if it is not cached.
+  void erase(ChunkListNode* node);
+
+private:
+  ChunkCache(const ChunkCache&) = delete;
+  void operator=(const ChunkCache&) = delete;
+
+  enum list_type {
+    list_recent,
+    list_frequent,
+    list_recent_ghost,
+    list_frequent_ghost,
+    list_max_size
+  };
+
+  struct entry {
+    ChunkList*     chunk_list;
+    ChunkListNode* node;
+    uint32_t       size;
+  };
+
+  using entry_list = std::list<entry>;
+
+  struct lru_list {
+    entry_list entries;
+    uint64_t   size{ 0 };
+  };
+
+  struct locator {
+    list_type            list;
+    entry_list::iterator itr;
+  };
+
+  using index_map = std::unordered_map<const ChunkListNode*, locator>;
+
+  void push_front(list_type list, const entry& e);
+  void remove(index_map::iterator itr);
+  void evict_lru(list_type list);
+  void trim_ghosts(uint64_t capacity);
+  void replace(uint64_t capacity);
+
+  lru_list  m_lists[list_max_size];
+  index_map m_index;
+  uint64_t  m_recent_target{ 0 };
+};
+
+} // namespace torrent
+
+#endif
@@ -22,6 +22,9 @@ public:
   MemoryChunk* memory_chunk() {
     return &m_iterator->chunk();
   }
+  const ChunkPart& chunk_part() const {
+    return *m_iterator;
+  }
 
   uint32_t memory_chunk_first() const {
     return m_first - m_iterator->position();
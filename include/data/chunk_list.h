@@ -29,6 +29,7 @@ public:
   using slot_chunk_index = std::function<Chunk*(uint32_t, int)>;
   using slot_value       = std::function<uint64_t()>;
   using slot_string      = std::function<void(const std::string&)>;
+  using slot_index       = std::function<void(uint32_t)>;
 
   using base_type::difference_type;
   using base_type::reference;
@@ -86,6 +87,12 @@ public:
     return m_queue.size();
   }
 
+  // Chunks whose sync has been passed to the sync thread, they are
+  // released when the sync completes.
+  size_type syncing_size() const {
+    return m_syncing;
+  }
+
   download_data* data() {
     return m_data;
   }
@@ -115,6 +122,10 @@ public:
   // Returns the number of failed syncs.
   uint32_t sync_chunks(int flags);
 
+  // Called by the read cache to unmap an unreferenced chunk it
+  // evicts.
+  void clear_cached(ChunkListNode* node);
+
   slot_string& slot_storage_error() {
     return m_slot_storage_error;
   }
@@ -125,11 +136,19 @@ public:
     return m_slot_free_diskspace;
   }
 
+  // Called with the index of a chunk once it is unmapped.
+  slot_index& slot_chunk_cleared() {
+    return m_slot_chunk_cleared;
+  }
+
 private:
   inline bool is_queued(ChunkListNode* node);
 
   inline void clear_chunk(ChunkListNode* node, int flags = 0);
   inline bool sync_chunk(ChunkListNode* node, std::pair<int, bool> options);
+  bool        sync_chunk_thread(ChunkListNode* node, int flags);
+  void        sync_chunk_done(ChunkListNode* node, int error);
+  void        wait_syncing();
 
   Queue::iterator partition_optimize(Queue::iterator first,
                                      Queue::iterator last,
@@ -146,6 +165,7 @@ private:
   download_data* m_data{ nullptr };
   ChunkManager*  m_manager{ nullptr };
   Queue          m_queue;
+  size_type      m_syncing{ 0 };
 
   int      m_flags{ 0 };
   uint32_t m_chunk_size{ 0 };
@@ -153,6 +173,7 @@ private:
   slot_string      m_slot_storage_error;
   slot_chunk_index m_slot_create_chunk;
   slot_value       m_slot_free_diskspace;
+  slot_index       m_slot_chunk_cleared;
 };
 
 } // namespace torrent
@@ -63,6 +63,15 @@ public:
     m_asyncTriggered = v;
   }
 
+  // Set when the node was taken from the read cache, so that it is
+  // cached as frequently used once released.
+  bool cache_frequent() const {
+    return m_cacheFrequent;
+  }
+  void set_cache_frequent(bool v) {
+    m_cacheFrequent = v;
+  }
+
   int references() const {
     return m_references;
   }
@@ -111,6 +120,7 @@ private:
   int m_blocking{ 0 };
 
   bool m_asyncTriggered{ false };
+  bool m_cacheFrequent{ false };
 
   utils::timer m_timeModified;
   utils::timer m_timePreloaded;
@@ -4,16 +4,35 @@
 #ifndef LIBTORRENT_DATA_STORAGE_CHUNK_PART_H
 #define LIBTORRENT_DATA_STORAGE_CHUNK_PART_H
 
+#include <utility>
+
 #include "memory_chunk.h"
 #include "torrent/utils/cacheline.h"
+#include "torrent/utils/ranges.h"
 
 namespace torrent {
 
 class File;
 
+// MAPPED_BUFFER parts hold a copy of the file's range in anonymous
+// memory, and the ranges marked dirty are written to the file with
+// pwrite when the part is synced. The buffer starts out empty, ranges
+// neither written nor loaded are read from the file by 'load'.
+//
+// MAPPED_WINDOW parts are views into a window owned by the
+// MappingManager, and are released to it instead of being unmapped.
+//
+// MAPPED_STATIC parts point into memory owned by the storage backend,
+// which is neither unmapped nor synced.
+
 class lt_cacheline_aligned ChunkPart {
 public:
-  using mapped_type = enum { MAPPED_MMAP, MAPPED_STATIC };
+  using mapped_type =
+    enum { MAPPED_MMAP, MAPPED_STATIC, MAPPED_BUFFER, MAPPED_WINDOW };
+
+  bool is_file_mapping() const {
+    return m_mapped == MAPPED_MMAP || m_mapped == MAPPED_WINDOW;
+  }
 
   ChunkPart(mapped_type mapped, const MemoryChunk& c, uint32_t pos)
     : m_mapped(mapped)
@@ -72,7 +91,42 @@ public:
   bool     is_incore(uint32_t pos, uint32_t length = ~uint32_t());
   uint32_t incore_length(uint32_t pos, uint32_t length = ~uint32_t());
 
+  bool is_dirty() const {
+    return !m_dirty.empty();
+  }
+
+  // Offsets are relative to the start of the part.
+  void mark_dirty(uint32_t first, uint32_t last) {
+    m_dirty.insert(first, last);
+    m_loaded.insert(first, last);
+  }
+
+  // Reads the ranges of a MAPPED_BUFFER part that do not yet hold the
+  // file's data. Offsets are relative to the start of the part. Use
+  // errno if it fails.
+  bool load(uint32_t first, uint32_t last);
+
+  // Moves the dirty ranges out of the part, so that they can be
+  // written by another thread while the chunk remains referenced.
+  ranges<uint32_t> take_dirty() {
+    return std::exchange(m_dirty, ranges<uint32_t>());
+  }
+
+  // Writes the dirty ranges of a MAPPED_BUFFER part to the file, and
+  // with sync_sync waits for them to reach the disk. Use errno if it
+  // fails.
+  bool sync(int flags);
+
+  // Writes the ranges of the buffer to 'fd', removing them as they
+  // are written so that only the unwritten part remains on failure.
+  static bool write_ranges(int               fd,
+                           const char*       buffer,
+                           uint64_t          offset,
+                           ranges<uint32_t>* dirty);
+
 private:
+  bool flush();
+
   mapped_type m_mapped;
 
   MemoryChunk m_chunk;
@@ -83,6 +137,9 @@ private:
   // temporary storage, etc.
   File*    m_file;
   uint64_t m_file_offset;
+
+  ranges<uint32_t> m_dirty;
+  ranges<uint32_t> m_loaded;
 };
 
 } // namespace torrent
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_DATA_DEVICE_STATS_H
+#define LIBTORRENT_DATA_DEVICE_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+
+#include "torrent/utils/cacheline.h"
+
+namespace torrent {
+
+// Counts the disk jobs performed for a device by its worker thread,
+// read and cleared by the main thread when logging instrumentation.
+
+struct lt_cacheline_aligned device_stats {
+  using clock_type = std::chrono::steady_clock;
+
+  std::atomic<int64_t> jobs{ 0 };
+  std::atomic<int64_t> bytes{ 0 };
+  std::atomic<int64_t> busy_usec{ 0 };
+  std::atomic<int64_t> max_usec{ 0 };
+
+  // Adds a job of 'size' bytes started at 'start', 'stats' may be
+  // null when the job is not performed by a device worker.
+  static void update(device_stats*          stats,
+                     uint64_t               size,
+                     clock_type::time_point start);
+};
+
+inline void
+device_stats::update(device_stats*          stats,
+                     uint64_t               size,
+                     clock_type::time_point start) {
+  if (stats == nullptr)
+    return;
+
+  int64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(
+                   clock_type::now() - start)
+                   .count();
+
+  stats->jobs++;
+  stats->bytes += size;
+  stats->busy_usec += usec;
+
+  // Only the device worker writes, so no compare-exchange loop.
+  if (usec > stats->max_usec)
+    stats->max_usec = usec;
+}
+
+} // namespace torrent
+
+#endif
@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_DATA_DISK_SCHEDULER_H
+#define LIBTORRENT_DATA_DISK_SCHEDULER_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <map>
+#include <utility>
+
+namespace torrent {
+
+class HashChunk;
+
+// Orders the chunks of rechecks from all downloads by the device they
+// are stored on, serving each device in elevator order by file and
+// offset. The number of dispatches in flight on each device is
+// limited, so that several hash threads don't make a disk seek
+// between the torrents being checked.
+//
+// The files are ordered by inode, which on most filesystems roughly
+// follows their placement on disk. Not thread-safe, HashCheckQueue
+// guards it with its lock.
+
+class DiskScheduler {
+public:
+  struct location {
+    uint64_t device{ 0 };
+    uint64_t inode{ 0 };
+    uint64_t offset{ 0 };
+  };
+
+  static constexpr unsigned int default_device_limit = 1;
+
+  // The number of bytes read from one file before moving on to the
+  // next file on the device, if any other file is waiting.
+  static constexpr uint64_t sweep_limit = uint64_t(256) << 20;
+
+  // Uses the device and inode stored in the chunk's first file when
+  // it was opened.
+  static location locate(HashChunk* hash_chunk);
+
+  bool empty() const {
+    return m_size == 0;
+  }
+  size_t size() const {
+    return m_size;
+  }
+  size_t pending(uint64_t device) const;
+
+  unsigned int device_limit() const {
+    return m_device_limit;
+  }
+  void set_device_limit(unsigned int limit);
+
+  // The single flag keeps the chunk out of batches.
+  void push(HashChunk*      hash_chunk,
+            const location& loc,
+            uint32_t        size,
+            bool            single);
+
+  // Pops up to 'max_count' chunks of equal size in elevator order
+  // from the next device with a free slot, returning the number of
+  // chunks. The dispatch must be passed to 'finished' once done.
+  unsigned int pop(HashChunk** chunks, unsigned int max_count);
+  void         finished(HashChunk* const* chunks, unsigned int count);
+
+  // As 'pop', but only from 'device'.
+  unsigned int pop_device(uint64_t     device,
+                          HashChunk**  chunks,
+                          unsigned int max_count);
+
+  // Returns false if the chunk is not queued, e.g. while it is being
+  // hashed.
+  bool remove(HashChunk* hash_chunk);
+
+private:
+  using key_type = std::pair<uint64_t, uint64_t>;
+
+  struct request {
+    HashChunk* chunk;
+    uint32_t   size;
+    bool       single;
+  };
+
+  struct device {
+    std::multimap<key_type, request> queue;
+
+    key_type     head{ 0, 0 };
+    uint64_t     head_bytes{ 0 };
+    unsigned int active{ 0 };
+  };
+
+  using queue_iterator = std::multimap<key_type, request>::iterator;
+  using device_map     = std::map<uint64_t, device>;
+
+  queue_iterator next_request(device& dev);
+  unsigned int   pop_from(device_map::iterator first,
+                          HashChunk**          chunks,
+                          unsigned int         max_count);
+
+  using queued_type = std::pair<uint64_t, queue_iterator>;
+
+  device_map                        m_devices;
+  std::map<HashChunk*, queued_type> m_queued;
+  std::map<HashChunk*, uint64_t>    m_active;
+
+  uint64_t     m_next_device{ 0 };
+  size_t       m_size{ 0 };
+  unsigned int m_device_limit{ default_device_limit };
+};
+
+} // namespace torrent
+
+#endif
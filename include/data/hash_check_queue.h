@@ -4,11 +4,12 @@
 #ifndef LIBTORRENT_DATA_HASH_CHECK_QUEUE_H
 #define LIBTORRENT_DATA_HASH_CHECK_QUEUE_H
 
-#include <deque>
+#include <cstddef>
 #include <functional>
+#include <map>
 #include <mutex>
 
-#include "torrent/utils/allocators.h"
+#include "data/disk_scheduler.h"
 #include "torrent/utils/cacheline.h"
 
 namespace torrent {
@@ -16,36 +17,107 @@ namespace torrent {
 class HashString;
 class HashChunk;
 
-class lt_cacheline_aligned HashCheckQueue
-  : private std::deque<HashChunk*, utils::cacheline_allocator<HashChunk*>> {
+// The chunks are linked through HashChunk, so that they can be
+// removed without searching the queue. The hash threads pop the
+// chunks concurrently, so the queue is guarded by a lock held only
+// while linking and unlinking.
+//
+// Chunks are hashed in two lanes. Completed downloads are hashed
+// first, shared between their owners by deficit round robin so that
+// every download gets an equal number of bytes hashed. Rechecks are
+// only dispatched when no completed chunk is waiting, ordered by the
+// disk scheduler, which limits how many hash threads they may hold.
+//
+// Both lanes are split by the device the chunk is stored on. The
+// device threads only hash their own device's chunks, so that a slow
+// disk can't hold up the chunks of the others, while the hash threads
+// take chunks from each device in turn.
+
+class lt_cacheline_aligned HashCheckQueue {
 public:
-  using base_type =
-    std::deque<HashChunk*, utils::cacheline_allocator<HashChunk*>>;
   using slot_chunk_handle = std::function<void(HashChunk*, const HashString&)>;
+  using slot_device       = std::function<void(uint64_t)>;
 
-  using base_type::iterator;
+  static constexpr uint64_t any_device = ~uint64_t();
 
-  using base_type::empty;
-  using base_type::size;
+  HashCheckQueue() = default;
 
-  using base_type::back;
-  using base_type::begin;
-  using base_type::end;
-  using base_type::front;
+  bool empty() const {
+    return m_size == 0;
+  }
+  size_t size() const {
+    return m_size;
+  }
 
-  // Guarded functions for adding new...
+  // The chunk the next call to perform will hash first, and the
+  // chunk last queued by the owner of the most recent push_back.
+  HashChunk* front();
+  HashChunk* back();
 
+  // Guarded functions for adding new...
+  //
+  // Rechecks are passed to the disk scheduler, and are hashed once
+  // the regular queue is empty.
   void push_back(HashChunk* node);
-  void perform();
+  void perform(uint64_t device = any_device);
 
   bool remove(HashChunk* node);
 
+  size_t scheduled_size();
+
+  // The number of chunks waiting for 'device', in both lanes.
+  size_t pending(uint64_t device);
+
+  unsigned int device_limit();
+  void         set_device_limit(unsigned int limit);
+
   slot_chunk_handle& slot_chunk_done() {
     return m_slot_chunk_done;
   }
 
+  // Wakes up the worker of the device after a chunk is pushed.
+  slot_device& slot_interrupt() {
+    return m_slot_interrupt;
+  }
+
 private:
+  HashCheckQueue(const HashCheckQueue&) = delete;
+  void operator=(const HashCheckQueue&) = delete;
+
+  // The number of bytes each owner may hash per round.
+  static constexpr int64_t owner_quantum = int64_t(4) << 20;
+
+  struct owner_queue {
+    HashChunk* first{ nullptr };
+    HashChunk* last{ nullptr };
+    int64_t    deficit{ 0 };
+  };
+
+  using owner_map = std::map<const void*, owner_queue>;
+
+  struct device_lane {
+    owner_map   owners;
+    const void* current_owner{ nullptr };
+    size_t      size{ 0 };
+  };
+
+  using lane_map = std::map<uint64_t, device_lane>;
+
+  void                link_back(HashChunk* hash_chunk);
+  void                unlink(HashChunk* hash_chunk);
+  lane_map::iterator  next_lane(uint64_t device);
+  owner_map::iterator next_owner(device_lane& lane);
+  HashChunk*          pop_front(lane_map::iterator lane);
+
+  lane_map    m_lanes;
+  uint64_t    m_next_device{ 0 };
+  uint64_t    m_last_device{ 0 };
+  const void* m_last_owner{ nullptr };
+  size_t      m_size{ 0 };
+
   slot_chunk_handle m_slot_chunk_done;
+  slot_device       m_slot_interrupt;
+  DiskScheduler     m_scheduler;
   std::mutex        m_lock;
 };
 
@@ -4,7 +4,14 @@
 #ifndef LIBTORRENT_HASH_CHUNK_H
 #define LIBTORRENT_HASH_CHUNK_H
 
+#include <chrono>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "torrent/chunk_manager.h"
 #include "torrent/exceptions.h"
+#include "torrent/hash_string.h"
 #include "torrent/utils/cacheline.h"
 #include "utils/sha1.h"
 
@@ -18,6 +25,9 @@ namespace torrent {
 // stuff related to performance and responsiveness.
 
 class ChunkListNode;
+class HashCheckQueue;
+class HashQueue;
+class HashQueueNode;
 
 class lt_cacheline_aligned HashChunk {
 public:
@@ -27,8 +37,12 @@ public:
   }
 
   void set_chunk(ChunkHandle h) {
-    m_position = 0;
-    m_chunk    = h;
+    m_position  = 0;
+    m_chunk     = h;
+    m_read_mode = ChunkManager::recheck_read_mmap;
+    m_recheck   = false;
+    m_owner     = nullptr;
+    m_extents.clear();
     m_hash.init();
   }
 
@@ -45,18 +59,91 @@ public:
   // If force is true, then the return value is always true.
   bool perform(uint32_t length, bool force = true);
 
+  // Hash several unstarted chunks of equal size in one pass using
+  // Sha1Multi, writing the result for each chunk to 'hashes'.
+  static void
+  perform_multi(HashChunk* const* chunks, unsigned int count, char* const* hashes);
+
+  // Read the chunk's file ranges with pread rather than through the
+  // mapping, see ChunkManager::recheck_read_mode. The file paths are
+  // copied, so call this from the main thread before queueing.
+  uint32_t read_mode() const {
+    return m_read_mode;
+  }
+  void set_read_mode(uint32_t mode);
+
+  // Rechecks are ordered by the disk scheduler rather than hashed in
+  // the order they were queued.
+  bool is_recheck() const {
+    return m_recheck;
+  }
+  void set_recheck(bool state) {
+    m_recheck = state;
+  }
+
+  // The download the chunk belongs to, the hash threads share their
+  // time between the owners.
+  const void* owner() const {
+    return m_owner;
+  }
+  void set_owner(const void* owner) {
+    m_owner = owner;
+  }
+
+  // Returns false if the files could not be read, in which case the
+  // hash is reset and the caller should fall back to perform.
+  bool perform_read();
+
   void advise_willneed(uint32_t length);
 
   uint32_t remaining();
 
 private:
+  friend class HashCheckQueue;
+  friend class HashQueue;
+
+  struct read_extent {
+    std::string path;
+    uint64_t    offset;
+    uint32_t    position;
+    uint32_t    length;
+  };
+
   inline uint32_t remaining_part(Chunk::iterator itr, uint32_t pos);
   uint32_t        perform_part(Chunk::iterator itr, uint32_t length);
 
+  bool perform_read_extent(const read_extent& extent, char* buffer);
+
   uint32_t m_position;
 
   ChunkHandle m_chunk;
   Sha1        m_hash;
+
+  uint32_t                 m_read_mode{ ChunkManager::recheck_read_mmap };
+  bool                     m_recheck{ false };
+  const void*              m_owner{ nullptr };
+  std::vector<read_extent> m_extents;
+
+  // Links for HashCheckQueue, guarded by its lock, so that removing
+  // a chunk does not search the queue.
+  static constexpr int queue_none      = 0;
+  static constexpr int queue_pending   = 1;
+  static constexpr int queue_scheduled = 2;
+
+  int        m_queue_state{ queue_none };
+  uint64_t   m_queue_device{ 0 };
+  HashChunk* m_queue_prev{ nullptr };
+  HashChunk* m_queue_next{ nullptr };
+
+  std::chrono::steady_clock::time_point m_queue_time;
+
+  // The result is passed to HashQueue through its lock-free done
+  // queue, 'm_done' and 'm_node' are only accessed by the main thread.
+  HashChunk* m_done_next{ nullptr };
+  HashString m_done_hash;
+  bool       m_done{ false };
+
+  std::list<HashQueueNode>::iterator m_node;
 };
 
 inline uint32_t
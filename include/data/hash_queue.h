@@ -6,18 +6,19 @@
 
 #include <deque>
 #include <functional>
-#include <map>
-#include <mutex>
+#include <list>
 
+#include "torrent/chunk_manager.h"
 #include "torrent/hash_string.h"
 #include "torrent/utils/cacheline.h"
 
 #include "chunk_handle.h"
+#include "hash_chunk.h"
 #include "hash_queue_node.h"
+#include "utils/mpsc_queue.h"
 
 namespace torrent {
 
-class HashChunk;
 class thread_disk;
 
 // Calculating hash of incore memory is blindingly fast, it's always
@@ -26,10 +27,9 @@ class thread_disk;
 // helps us in getting as much done as possible while the pages are in
 // memory.
 
-class lt_cacheline_aligned HashQueue : private std::deque<HashQueueNode> {
+class lt_cacheline_aligned HashQueue : private std::list<HashQueueNode> {
 public:
-  using base_type        = std::deque<HashQueueNode>;
-  using done_chunks_type = std::map<HashChunk*, torrent::HashString>;
+  using base_type = std::list<HashQueueNode>;
 
   using slot_done_type = HashQueueNode::slot_done_type;
   using slot_bool      = std::function<void(bool)>;
@@ -49,9 +49,20 @@ public:
     clear();
   }
 
+  // Rechecks are ordered by the disk they are read from, see
+  // DiskScheduler.
   void push_back(ChunkHandle            handle,
                  HashQueueNode::id_type id,
-                 slot_done_type         d);
+                 slot_done_type         d,
+                 uint32_t read_mode = ChunkManager::recheck_read_mmap,
+                 bool     recheck   = false);
+
+  // Queue a chunk whose hash is already known, it is passed to the
+  // owner in queue order by the next call to work().
+  void push_back_hashed(ChunkHandle            handle,
+                        HashQueueNode::id_type id,
+                        const HashString&      hash,
+                        slot_done_type         d);
 
   bool has(HashQueueNode::id_type id);
   bool has(HashQueueNode::id_type id, uint32_t index);
@@ -66,14 +77,23 @@ public:
   }
 
 private:
+  using done_queue_type = mpsc_queue<HashChunk, &HashChunk::m_done_next>;
+
+  // Called from the hash threads, the chunk is handed over without
+  // taking a lock.
   void chunk_done(HashChunk* hash_chunk, const HashString& hash_value);
 
+  // Marks the chunks received from the hash threads as done.
+  void receive_done();
+
   thread_disk* m_thread_disk;
 
-  done_chunks_type m_done_chunks;
-  slot_bool        m_slot_has_work;
+  // Received chunks not yet passed to their owners, each finds its
+  // node through HashChunk::m_node.
+  std::deque<HashChunk*> m_done_chunks;
+  slot_bool              m_slot_has_work;
 
-  std::mutex m_done_chunks_lock lt_cacheline_aligned;
+  done_queue_type m_done_queue;
 };
 
 } // namespace torrent
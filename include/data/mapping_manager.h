@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_DATA_MAPPING_MANAGER_H
+#define LIBTORRENT_DATA_MAPPING_MANAGER_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <tuple>
+
+#include "data/memory_chunk.h"
+
+namespace torrent {
+
+class File;
+
+// Keeps large aligned windows of files mapped, and hands out chunk
+// parts as views into them. This avoids a mmap and munmap for every
+// chunk, and the TLB shootdowns the latter causes on hosts with many
+// cores.
+//
+// Unreferenced windows stay mapped until the total size of the
+// windows would exceed the address budget, and are then unmapped in
+// least recently used order. Ranges that cross a window boundary, or
+// that don't fit the budget, are left to the caller to map.
+
+class MappingManager {
+public:
+  MappingManager() = default;
+  ~MappingManager();
+
+  uint64_t window_size() const {
+    return m_window_size;
+  }
+  void set_window_size(uint64_t size);
+
+  uint64_t address_budget() const {
+    return m_address_budget;
+  }
+  void set_address_budget(uint64_t budget);
+
+  // Ask for transparent huge pages for the windows, only effective
+  // on filesystems that support them for file mappings.
+  bool hugepages() const {
+    return m_hugepages;
+  }
+  void set_hugepages(bool state) {
+    m_hugepages = state;
+  }
+
+  // Bytes of address space used by mapped windows.
+  uint64_t usage() const {
+    return m_usage;
+  }
+  size_t size() const {
+    return m_addresses.size();
+  }
+
+  // Returns an invalid chunk if the range could not be served from a
+  // window, in which case the caller should map it itself. The file
+  // must be prepared with 'prot'.
+  MemoryChunk create_chunk(File*    file,
+                           uint64_t offset,
+                           uint32_t length,
+                           int      prot);
+
+  // Drops the reference a view returned by create_chunk holds on its
+  // window.
+  void release(const MemoryChunk& chunk);
+
+  // Forgets the windows of a file that is being closed, those still
+  // referenced are unmapped when released.
+  void erase(File* file);
+
+  // Unmaps unreferenced windows until no more than 'budget' bytes are
+  // mapped, or none are left.
+  void evict(uint64_t budget);
+
+private:
+  MappingManager(const MappingManager&) = delete;
+  void operator=(const MappingManager&) = delete;
+
+  struct window;
+
+  using key_type    = std::tuple<File*, uint64_t, bool>;
+  using index_map   = std::map<key_type, window*>;
+  using address_map = std::map<char*, window*>;
+  using unused_list = std::list<window*>;
+
+  struct window {
+    char*    ptr;
+    uint64_t length;
+    uint32_t refs{ 0 };
+
+    // Cleared when the file is erased while the window is still
+    // referenced.
+    bool                  indexed{ true };
+    index_map::iterator   index_itr{};
+    unused_list::iterator unused_itr{};
+  };
+
+  window* map_window(File* file, uint64_t offset, bool writable);
+  void    unmap_window(window* w);
+
+  uint64_t m_window_size{ 0 };
+  uint64_t m_address_budget{ 0 };
+  bool     m_hugepages{ false };
+
+  uint64_t m_usage{ 0 };
+
+  index_map   m_index;
+  address_map m_addresses;
+  unused_list m_unused;
+};
+
+} // namespace torrent
+
+#endif
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_DATA_MEMORY_STORAGE_H
+#define LIBTORRENT_DATA_MEMORY_STORAGE_H
+
+#include <unordered_map>
+
+#include "data/storage_backend.h"
+
+namespace torrent {
+
+// Keeps the contents of every file in anonymous memory, allocated on
+// first use and freed when the file list is destroyed. Used to
+// benchmark the network paths without any disk access, the data is
+// lost when the client exits.
+
+class MemoryStorage : public StorageBackend {
+public:
+  MemoryStorage() = default;
+  ~MemoryStorage() override;
+
+  const char* name() const override {
+    return "memory";
+  }
+
+  bool is_file_backed() const override {
+    return false;
+  }
+
+  MemoryChunk create_chunk(File*                   file,
+                           uint64_t                offset,
+                           uint32_t                length,
+                           int                     prot,
+                           ChunkPart::mapped_type* mapped) override;
+
+  void close_file(File*) override {}
+  void erase_file(File* file) override;
+
+private:
+  struct buffer {
+    char*    ptr;
+    uint64_t size;
+  };
+
+  std::unordered_map<File*, buffer> m_buffers;
+};
+
+} // namespace torrent
+
+#endif
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_DATA_MMAP_STORAGE_H
+#define LIBTORRENT_DATA_MMAP_STORAGE_H
+
+#include "data/storage_backend.h"
+
+namespace torrent {
+
+// Maps the files through the MappingManager windows, or per chunk
+// part, and copies writable chunks into anonymous memory when the
+// write mode is buffered.
+
+class MmapStorage : public StorageBackend {
+public:
+  const char* name() const override {
+    return "mmap";
+  }
+
+  bool is_file_backed() const override {
+    return true;
+  }
+
+  MemoryChunk create_chunk(File*                   file,
+                           uint64_t                offset,
+                           uint32_t                length,
+                           int                     prot,
+                           ChunkPart::mapped_type* mapped) override;
+
+  void close_file(File* file) override;
+  void erase_file(File*) override {}
+};
+
+} // namespace torrent
+
+#endif
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_DATA_PREFETCH_QUEUE_H
+#define LIBTORRENT_DATA_PREFETCH_QUEUE_H
+
+#include <cinttypes>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+
+#include "data/device_stats.h"
+#include "torrent/data/piece.h"
+#include "torrent/utils/cacheline.h"
+
+namespace torrent {
+
+class ChunkList;
+class FileList;
+
+// Reads ranges of the files into the page cache ahead of uploads, so
+// that writing a piece to the socket does not fault on cold data in
+// the main thread.
+//
+// The main thread splits the range into files and passes a duplicate
+// of each file descriptor, as the file manager may close the
+// original, while the worker thread of the file's device calls
+// posix_fadvise which blocks until the reads are submitted.
+//
+// Ranges are tagged with an owner, usually the peer connection, so
+// that they can be dropped when the requests they were queued for are
+// choked or cancelled.
+
+class lt_cacheline_aligned PrefetchQueue {
+public:
+  using slot_device = std::function<void(uint64_t)>;
+
+  // Prefetching is only advisory, so ranges pushed while this many
+  // are pending are dropped.
+  static constexpr size_t max_pending = 1024;
+
+  PrefetchQueue() = default;
+  ~PrefetchQueue();
+
+  size_t size();
+
+  // Returns false if any part of the range could not be queued. Parts
+  // already covered by a pending range of the file list are skipped.
+  bool push_back(const void* owner,
+                 FileList*   file_list,
+                 uint64_t    position,
+                 uint32_t    length);
+
+  // Queues the rest of the chunk of the current piece and then of each
+  // upcoming one, until 'budget' bytes are queued. Chunks prefetched
+  // within the last minute are skipped, and only chunks whose whole
+  // tail got queued are marked as prefetched. Returns the bytes the
+  // queue covers for the pieces.
+  uint64_t push_pieces(const void*            owner,
+                       ChunkList*             chunk_list,
+                       FileList*              file_list,
+                       const Piece&           current,
+                       const std::list<Piece>& upcoming,
+                       uint64_t               budget);
+
+  // Drops the pending ranges of the owner that overlap the range,
+  // returning how many were dropped.
+  size_t erase(const void* owner, uint64_t position, uint64_t length);
+
+  // The number of jobs waiting to be performed on the device.
+  size_t pending(uint64_t device);
+
+  // Called by the device's worker thread, performs its jobs until
+  // none are pending.
+  void perform(uint64_t device, device_stats* stats);
+
+  // Wakes up the worker of the device after a range is pushed.
+  slot_device& slot_interrupt() {
+    return m_slot_interrupt;
+  }
+
+private:
+  PrefetchQueue(const PrefetchQueue&) = delete;
+  void operator=(const PrefetchQueue&) = delete;
+
+  // The position is within the file list, and the offset within the
+  // file of the duplicated descriptor.
+  struct job {
+    int         fd;
+    const void* owner;
+    FileList*   file_list;
+    uint64_t    position;
+    uint64_t    offset;
+    uint32_t    length;
+  };
+
+  std::map<uint64_t, std::deque<job>> m_pending;
+  size_t                              m_size{ 0 };
+  std::mutex                          m_lock;
+
+  slot_device m_slot_interrupt;
+};
+
+} // namespace torrent
+
+#endif
@@ -43,11 +43,21 @@ public:
   uint64_t size() const;
   bool     set_size(uint64_t s, int flags = 0) const;
 
+  // Deallocates the range while keeping the file size. Without hole
+  // punching support only a range reaching the end of the file can be
+  // released, by truncating and extending the file.
+  bool punch_hole(uint64_t offset, uint64_t length) const;
+
   MemoryChunk create_chunk(uint64_t offset,
                            uint32_t length,
                            int      prot,
                            int      flags) const;
 
+  // Allocates anonymous memory for the range rather than mapping the
+  // file, for chunks that are written back with pwrite. Nothing is
+  // read here, ChunkPart::load fills the parts that are needed.
+  MemoryChunk create_buffer(uint64_t offset, uint32_t length) const;
+
   fd_type fd() const {
     return m_fd;
   }
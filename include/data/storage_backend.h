@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_DATA_STORAGE_BACKEND_H
+#define LIBTORRENT_DATA_STORAGE_BACKEND_H
+
+#include <cinttypes>
+
+#include "data/chunk_part.h"
+#include "data/memory_chunk.h"
+
+namespace torrent {
+
+class File;
+
+// Provides the memory of chunk parts for FileList::create_chunk. The
+// rest of the data path works on the returned MemoryChunk, and the
+// part's mapped type decides how it is synced and released.
+//
+// Backends that are not file backed have no files to open, allocate
+// or read directly, so preallocation is skipped and hash checks read
+// the chunk memory.
+
+class StorageBackend {
+public:
+  virtual ~StorageBackend() = default;
+
+  virtual const char* name() const = 0;
+
+  virtual bool is_file_backed() const = 0;
+
+  // Returns the memory for 'length' bytes at 'offset' in the file, or
+  // an invalid chunk with errno set.
+  virtual MemoryChunk create_chunk(File*                   file,
+                                   uint64_t                offset,
+                                   uint32_t                length,
+                                   int                     prot,
+                                   ChunkPart::mapped_type* mapped) = 0;
+
+  // Called when the file list is closed, parts created for the file
+  // may still be referenced.
+  virtual void close_file(File* file) = 0;
+
+  // Called before the file is deleted, no parts created for it are
+  // referenced.
+  virtual void erase_file(File* file) = 0;
+};
+
+} // namespace torrent
+
+#endif
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_DATA_SYNC_QUEUE_H
+#define LIBTORRENT_DATA_SYNC_QUEUE_H
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "data/device_stats.h"
+#include "data/memory_chunk.h"
+#include "torrent/utils/cacheline.h"
+#include "torrent/utils/ranges.h"
+#include "utils/mpsc_queue.h"
+
+namespace torrent {
+
+class Chunk;
+class ChunkPart;
+
+// Syncs chunks on a disk thread, so that the main thread never waits
+// for msync or for buffered writes to reach the disk.
+//
+// The main thread prepares a job with everything the sync needs, as
+// the file manager and the chunk's dirty ranges are not thread-safe,
+// and the caller keeps the chunk referenced until the job's slot is
+// called from 'work' on the main thread.
+//
+// Jobs are queued by the device of the chunk's first file, and each
+// device is performed by its own worker thread.
+
+class lt_cacheline_aligned SyncQueue {
+public:
+  using slot_void   = std::function<void()>;
+  using slot_device = std::function<void(uint64_t)>;
+  using slot_result = std::function<void(int)>;
+
+  SyncQueue() = default;
+  ~SyncQueue();
+
+  // The number of jobs pushed whose slot has not yet been called.
+  size_t size() const {
+    return m_size;
+  }
+
+  // Returns false if the chunk's files could not be prepared, in
+  // which case the caller should sync in place. The slot is called
+  // with zero or the errno of the first failure.
+  bool push_back(Chunk* chunk, int flags, slot_result slot);
+
+  // The number of jobs waiting to be performed on the device.
+  size_t pending(uint64_t device);
+
+  // Called by the device's worker thread, performs its jobs until
+  // none are pending.
+  void perform(uint64_t device, device_stats* stats);
+
+  // Called on the main thread to receive completed jobs.
+  void work();
+
+  // Blocks until at least one job completes, pending jobs are
+  // performed by the calling thread. Returns the number of jobs
+  // completed.
+  size_t wait();
+
+  // Wakes up the worker of the device after a job is pushed.
+  slot_device& slot_interrupt() {
+    return m_slot_interrupt;
+  }
+
+  // Called by a worker thread when there are completed jobs and the
+  // main thread needs to call 'work'.
+  slot_void& slot_has_work() {
+    return m_slot_has_work;
+  }
+
+private:
+  SyncQueue(const SyncQueue&) = delete;
+  void operator=(const SyncQueue&) = delete;
+
+  // Buffered parts are written to a duplicate of the file
+  // descriptor, as the file manager may close the original.
+  struct sync_part {
+    ChunkPart*       part;
+    MemoryChunk      memory;
+    int              fd;
+    uint64_t         offset;
+    ranges<uint32_t> dirty;
+  };
+
+  struct job {
+    uint64_t               device{ 0 };
+    std::vector<sync_part> parts;
+    int                    flags;
+    int                    error{ 0 };
+    slot_result            slot;
+    job*                   m_done_next{ nullptr };
+  };
+
+  using done_queue_type = mpsc_queue<job, &job::m_done_next>;
+
+  static uint64_t perform_job(job* j);
+
+  void perform_all();
+
+  size_t m_size{ 0 };
+
+  std::map<uint64_t, std::deque<job*>> m_pending;
+  std::mutex                           m_lock;
+  done_queue_type                      m_done_queue;
+
+  slot_device m_slot_interrupt;
+  slot_void   m_slot_has_work;
+};
+
+} // namespace torrent
+
+#endif
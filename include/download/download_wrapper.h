@@ -102,12 +102,15 @@ public:
   void receive_tick(uint32_t ticks);
 
   void receive_update_priorities();
+  void receive_chunk_cleared(uint32_t index);
 
 private:
   DownloadWrapper(const DownloadWrapper&) = delete;
   void operator=(const DownloadWrapper&) = delete;
 
   void finished_download();
+  void migrate_part_files();
+  void reclaim_space();
 
   DownloadMain* m_main;
   Object*       m_bencode;
@@ -117,6 +120,11 @@ private:
   std::string m_hash;
 
   int m_connectionType{ 0 };
+
+  // Set when a wanted file waits for its boundary chunks to be
+  // unmapped before leaving the part file, and when one of them is.
+  bool m_migrateWaiting{ false };
+  bool m_migrateReady{ false };
 };
 
 } // namespace torrent
@@ -44,6 +44,13 @@ public:
   bool set_send_buffer_size(uint32_t s);
   bool set_receive_buffer_size(uint32_t s);
 
+  // Returns false if the kernel or the socket does not support it.
+  bool set_zerocopy(bool state);
+
+  // Holds back partial segments while set, so that separate writes go
+  // out together. Clearing it sends what is pending.
+  bool set_cork(bool state);
+
   int get_error() const;
 
   bool open_stream();
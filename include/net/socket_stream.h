@@ -6,6 +6,7 @@
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "socket_base.h"
 #include "torrent/exceptions.h"
@@ -23,6 +24,27 @@ public:
   uint32_t read_stream_throws(void* buf, uint32_t length);
   uint32_t write_stream_throws(const void* buf, uint32_t length);
 
+  // Reads or writes the buffers with a single call, returns and
+  // throws like read_stream_throws and write_stream_throws.
+  uint32_t read_vector_throws(const iovec* iov, int count);
+  uint32_t write_vector_throws(const iovec* iov, int count);
+
+  // Sends the file range directly from the page cache, returns and
+  // throws like write_stream_throws. Returns -1 if the file cannot be
+  // sent this way, leaving the caller to fall back to a copy.
+  int write_file_throws(int fd, uint64_t offset, uint32_t length);
+
+  // Sends with MSG_ZEROCOPY, 'buf' must stay unmodified until the
+  // kernel reports the send completed. Sends that returned non-zero
+  // are numbered from zero. Returns -1 if the data needs to be copied
+  // instead.
+  int write_zerocopy_throws(const void* buf, uint32_t length);
+
+  // Reads the completion notifications from the socket's error queue,
+  // setting 'last' to the highest completed send and 'copied' if the
+  // kernel copied the data anyway. Returns false if there were none.
+  bool read_zerocopy_completions(uint32_t* last, bool* copied);
+
   // Handles all the error catching etc. Returns true if the buffer is
   // finished reading/writing.
   bool read_buffer(void* buf, uint32_t length, uint32_t& pos);
@@ -31,6 +53,9 @@ public:
   uint32_t ignore_stream_throws(uint32_t length) {
     return read_stream_throws(m_nullBuffer, length);
   }
+
+private:
+  static uint32_t stream_result_throws(int r);
 };
 
 inline bool
@@ -6,6 +6,8 @@
 
 #include "torrent/buildinfo.h"
 
+#include <deque>
+
 #include "data/chunk_handle.h"
 #include "net/socket_stream.h"
 #include "torrent/peer/choke_status.h"
@@ -32,6 +34,8 @@ namespace torrent {
 // inheritance or member instances?
 
 class choke_queue;
+class ChunkIterator;
+class ChunkPart;
 class DownloadMain;
 
 class PeerConnectionBase
@@ -178,10 +182,23 @@ public:
 protected:
   static constexpr uint32_t extension_must_encrypt = ~uint32_t();
 
+  // Limits on what 'up_chunk_vectored' gathers into one write.
+  static constexpr int      max_write_vectors = 64;
+  static constexpr unsigned max_write_pieces  = 16;
+
+  // Limit on the chunk segments 'down_chunk_vectored' reads into.
+  static constexpr int max_read_vectors = 16;
+
+  // Smaller writes are copied, as pinning the pages and reading the
+  // completion costs more than the copy.
+  static constexpr uint32_t zerocopy_min_size = 8 << 10;
+
   inline bool read_remaining();
   inline bool write_remaining();
 
   void load_up_chunk();
+  void up_prefetch();
+  void up_prefetch_erase(const Piece& piece);
 
   void read_request_piece(const Piece& p);
   void read_cancel_piece(const Piece& p);
@@ -193,6 +210,11 @@ protected:
   void down_chunk_finished();
 
   bool down_chunk();
+
+  // Reads the rest of the block together with the header of the next
+  // message in a single readv. Returns true if the block is finished.
+  bool down_chunk_vectored();
+
   bool down_chunk_from_buffer();
   bool down_chunk_skip();
   bool down_chunk_skip_from_buffer();
@@ -205,6 +227,33 @@ protected:
   bool            up_chunk();
   inline uint32_t up_chunk_encrypt(uint32_t quota);
 
+  // Sends the range starting at 'first' within the part's memory
+  // chunk with sendfile, returns -1 if it needs to be copied instead.
+  int up_chunk_sendfile(const ChunkPart& part, uint32_t first, uint32_t length);
+
+  // Sends the data with MSG_ZEROCOPY and keeps a reference to the
+  // chunk until the kernel completes the send. Returns -1 if it needs
+  // to be copied instead.
+  int  up_chunk_zerocopy(const void* buf, uint32_t length);
+  bool up_zerocopy_complete();
+  void up_zerocopy_release();
+
+  // The chunk part a write vector points into, or nullptr for
+  // message headers.
+  struct vector_source {
+    const ChunkPart* part;
+    uint32_t         first;
+  };
+
+  uint32_t up_write_vectors(const iovec*         iov,
+                            const vector_source* sources,
+                            int                  count);
+
+  // Writes the message buffer, which ends with the header of
+  // 'm_upPiece', together with the piece. Returns false if the socket
+  // did not take all of it.
+  bool up_chunk_vectored(bool batch);
+
   bool up_extension();
 
   void down_chunk_release();
@@ -227,6 +276,10 @@ protected:
   ChunkHandle m_downChunk;
   uint32_t    m_downStall{ 0 };
 
+  // The message buffer holds a full piece header read along with the
+  // previous block, so the next read goes straight to the chunk.
+  bool m_downHeaderRead{ false };
+
   Piece       m_upPiece;
   ChunkHandle m_upChunk;
 
@@ -262,6 +315,15 @@ protected:
   ProtocolExtension* m_extensions;
 
   bool m_incoreContinous{ false };
+
+  // Unencrypted connections write pieces straight from the files.
+  bool m_upSendfile{ false };
+  bool m_upZerocopy{ false };
+
+  // Chunks referenced by MSG_ZEROCOPY sends, with the number of the
+  // last send from each.
+  uint32_t                                     m_upZerocopyNext{ 0 };
+  std::deque<std::pair<uint32_t, ChunkHandle>> m_upZerocopyChunks;
 };
 
 inline void
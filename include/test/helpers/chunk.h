@@ -34,12 +34,12 @@ func_storage_error(torrent::ChunkList* chunk_list, const std::string& message);
   delete chunk_list;                                                           \
   delete chunk_manager;
 
-static torrent::Poll*
+[[maybe_unused]] static torrent::Poll*
 create_select_poll() {
   return torrent::PollSelect::create(256);
 }
 
-static void
+[[maybe_unused]] static void
 do_nothing() {}
 
 void
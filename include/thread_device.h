@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_THREAD_DEVICE_H
+#define LIBTORRENT_THREAD_DEVICE_H
+
+#include <cinttypes>
+
+#include "data/device_stats.h"
+#include "thread_worker.h"
+
+namespace torrent {
+
+class AllocateQueue;
+class HashCheckQueue;
+class PrefetchQueue;
+class SyncQueue;
+
+// Performs the syncs, hash checks, prefetches and allocations of
+// files stored on one device, for thread_disk which owns the queues.
+// A slow or failing disk only holds up the jobs of its own files.
+//
+// Syncs and hash checks go first as they keep chunks referenced,
+// while a running allocation does hold up the device's syncs, which
+// would be waiting on the same disk anyway.
+
+class thread_device : public thread_worker {
+public:
+  thread_device(uint64_t        device,
+                SyncQueue*      sync_queue,
+                HashCheckQueue* hash_queue,
+                PrefetchQueue*  prefetch_queue,
+                AllocateQueue*  allocate_queue)
+    : m_device(device)
+    , m_sync_queue(sync_queue)
+    , m_hash_queue(hash_queue)
+    , m_prefetch_queue(prefetch_queue)
+    , m_allocate_queue(allocate_queue) {}
+
+  const char* name() const override {
+    return "rtorrent device";
+  }
+
+  uint64_t device() const {
+    return m_device;
+  }
+
+  // The number of jobs waiting for this thread.
+  size_t pending() const;
+
+  device_stats* stats() {
+    return &m_stats;
+  }
+
+protected:
+  void perform() override;
+
+  uint64_t        m_device;
+  SyncQueue*      m_sync_queue;
+  HashCheckQueue* m_hash_queue;
+  PrefetchQueue*  m_prefetch_queue;
+  AllocateQueue*  m_allocate_queue;
+
+  device_stats m_stats;
+};
+
+} // namespace torrent
+
+#endif
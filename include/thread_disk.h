@@ -1,13 +1,27 @@
 #ifndef LIBTORRENT_THREAD_DISK_H
 #define LIBTORRENT_THREAD_DISK_H
 
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "data/allocate_queue.h"
 #include "data/hash_check_queue.h"
-#include "torrent/utils/thread_base.h"
+#include "data/prefetch_queue.h"
+#include "data/sync_queue.h"
+#include "thread_device.h"
+#include "thread_hash.h"
+#include "thread_worker.h"
 
 namespace torrent {
 
-class LIBTORRENT_EXPORT thread_disk : public thread_base {
+class LIBTORRENT_EXPORT thread_disk : public thread_worker {
 public:
+  using hash_worker_list = std::vector<std::unique_ptr<thread_hash>>;
+  using device_map = std::map<uint64_t, std::unique_ptr<thread_device>>;
+
+  ~thread_disk() override;
+
   const char* name() const override {
     return "rtorrent disk";
   }
@@ -15,13 +29,60 @@ public:
     return &m_hash_queue;
   }
 
+  // Chunks are synced, hashed and prefetched, and files allocated, by
+  // a thread per device owned by thread_disk. The threads are added
+  // when a device first gets a job, and started and stopped along
+  // with thread_disk.
+  SyncQueue* sync_queue() {
+    return &m_sync_queue;
+  }
+  PrefetchQueue* prefetch_queue() {
+    return &m_prefetch_queue;
+  }
+  AllocateQueue* allocate_queue() {
+    return &m_allocate_queue;
+  }
+
+  const device_map& devices() const {
+    return m_devices;
+  }
+  thread_device* device_thread(uint64_t device);
+
+  // Logs the job count, bytes, busy time and longest job of each
+  // device since the last call, and its pending jobs.
+  void instrumentation_tick();
+
+  // The number of threads performing hash checks of any device,
+  // including this thread, besides the device threads which hash
+  // their own. Additional threads are started and stopped along with
+  // thread_disk, or immediately if it is already running.
+  unsigned int hash_thread_count() const {
+    return m_hash_workers.size() + 1;
+  }
+  void set_hash_thread_count(unsigned int count);
+
   void init_thread() override;
 
+  void start_thread() override;
+  void stop_thread() override;
+
+  // Wake up an idle hash thread, call after adding chunks to the hash
+  // queue. Busy threads check the queue again before polling.
+  void interrupt_hash();
+
 protected:
-  void    call_events() override;
-  int64_t next_timeout_usec() override;
+  void perform() override;
 
   HashCheckQueue m_hash_queue;
+
+  hash_worker_list m_hash_workers;
+  unsigned int     m_hash_next{ 0 };
+
+  SyncQueue     m_sync_queue;
+  PrefetchQueue m_prefetch_queue;
+  AllocateQueue m_allocate_queue;
+
+  device_map m_devices;
 };
 
 } // namespace torrent
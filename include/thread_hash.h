@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_THREAD_HASH_H
+#define LIBTORRENT_THREAD_HASH_H
+
+#include "thread_worker.h"
+
+namespace torrent {
+
+class HashCheckQueue;
+
+// Additional hash checking thread owned by thread_disk, it shares the
+// disk thread's HashCheckQueue and so calls the queue's
+// slot_chunk_done from its own thread.
+
+class thread_hash : public thread_worker {
+public:
+  thread_hash(HashCheckQueue* hash_queue)
+    : m_hash_queue(hash_queue) {}
+
+  const char* name() const override {
+    return "rtorrent hash";
+  }
+
+protected:
+  void perform() override;
+
+  HashCheckQueue* m_hash_queue;
+};
+
+} // namespace torrent
+
+#endif
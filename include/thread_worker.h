@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_THREAD_WORKER_H
+#define LIBTORRENT_THREAD_WORKER_H
+
+#include "torrent/utils/thread_base.h"
+
+namespace torrent {
+
+// Common base of thread_disk and the threads it owns. They only poll
+// to be woken up when their queues get work, count as disk threads in
+// the instrumentation, and call 'perform' on every wakeup until
+// shutdown.
+
+class LIBTORRENT_EXPORT thread_worker : public thread_base {
+public:
+  void init_thread() override;
+
+protected:
+  void    call_events() override;
+  int64_t next_timeout_usec() override;
+
+  virtual void perform() = 0;
+};
+
+} // namespace torrent
+
+#endif
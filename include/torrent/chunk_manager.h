@@ -13,6 +13,13 @@
 
 namespace torrent {
 
+class AllocateQueue;
+class ChunkCache;
+class MappingManager;
+class PrefetchQueue;
+class StorageBackend;
+class SyncQueue;
+
 // TODO: Currently all chunk lists are inserted, despite the download
 // not being open/active.
 
@@ -114,6 +121,131 @@ public:
     m_preloadRequiredRate = bytes;
   }
 
+  // How chunks are read when rechecking a torrent. The mmap mode
+  // faults chunks into the page cache like any other access, while
+  // the pread modes stream them through a small buffer in the hash
+  // threads and leave the page cache as it was found.
+  static constexpr uint32_t recheck_read_mmap   = 0;
+  static constexpr uint32_t recheck_read_pread  = 1;
+  static constexpr uint32_t recheck_read_direct = 2;
+
+  uint32_t recheck_read_mode() const {
+    return m_recheckReadMode;
+  }
+  void set_recheck_read_mode(uint32_t mode) {
+    if (mode > recheck_read_direct)
+      throw input_error("Invalid recheck read mode.");
+
+    m_recheckReadMode = mode;
+  }
+
+  // How downloaded data is written. The mmap mode writes into shared
+  // mappings of the files, faulting in every page on first touch. The
+  // buffered mode gives writable chunks a private copy in anonymous
+  // memory, which is written to the files with large pwrite calls of
+  // the modified ranges when the chunk is synced.
+  static constexpr uint32_t write_mmap     = 0;
+  static constexpr uint32_t write_buffered = 1;
+
+  uint32_t write_mode() const {
+    return m_writeMode;
+  }
+  void set_write_mode(uint32_t mode) {
+    if (mode > write_buffered)
+      throw input_error("Invalid write mode.");
+
+    m_writeMode = mode;
+  }
+
+  // Where the contents of downloads are kept. The mmap storage maps
+  // the files, while the memory storage keeps them in anonymous
+  // memory without touching the disk, for benchmarking the network
+  // paths. Can only be changed while there are no downloads.
+  static constexpr uint32_t storage_mmap   = 0;
+  static constexpr uint32_t storage_memory = 1;
+
+  uint32_t storage_type() const {
+    return m_storageType;
+  }
+  void set_storage_type(uint32_t type);
+
+  StorageBackend* storage() LIBTORRENT_NO_EXPORT {
+    return m_storage;
+  }
+
+  // Syncs are passed to the disk thread's sync queue when set,
+  // rather than being done on the main thread.
+  SyncQueue* sync_queue() LIBTORRENT_NO_EXPORT {
+    return m_syncQueue;
+  }
+  void set_sync_queue(SyncQueue* queue) LIBTORRENT_NO_EXPORT {
+    m_syncQueue = queue;
+  }
+
+  // Pieces requested by peers are read into the page cache by the
+  // disk thread ahead of being uploaded, looking as many seconds of
+  // the peer's upload rate into its request queue, and at least
+  // preload_min_size bytes. Set to zero to disable.
+  uint32_t prefetch_lookahead() const {
+    return m_prefetchLookahead;
+  }
+  void set_prefetch_lookahead(uint32_t seconds) {
+    m_prefetchLookahead = seconds;
+  }
+
+  PrefetchQueue* prefetch_queue() LIBTORRENT_NO_EXPORT {
+    return m_prefetchQueue;
+  }
+  void set_prefetch_queue(PrefetchQueue* queue) LIBTORRENT_NO_EXPORT {
+    m_prefetchQueue = queue;
+  }
+
+  // Files preallocated with fallocate are resized by the disk
+  // thread's allocate queue when set, while the download waits in the
+  // opening state.
+  AllocateQueue* allocate_queue() LIBTORRENT_NO_EXPORT {
+    return m_allocateQueue;
+  }
+  void set_allocate_queue(AllocateQueue* queue) LIBTORRENT_NO_EXPORT {
+    m_allocateQueue = queue;
+  }
+
+  // Unreferenced chunks stay mapped in a read cache shared by all
+  // downloads, sized as a percentage of max_memory_usage. Set to zero
+  // to unmap chunks as soon as they are released.
+  uint32_t read_cache_ratio() const {
+    return m_readCacheRatio;
+  }
+  void set_read_cache_ratio(uint32_t percent);
+
+  uint64_t read_cache_max_usage() const {
+    return m_maxMemoryUsage / 100 * m_readCacheRatio;
+  }
+  uint64_t read_cache_usage() const;
+
+  ChunkCache* read_cache() LIBTORRENT_NO_EXPORT {
+    return m_readCache;
+  }
+
+  // File ranges are served as views into persistent windows of
+  // mapping_window_size bytes, rather than mapping and unmapping each
+  // chunk, as long as the windows fit in mapping_address_budget. Set
+  // the window size to zero to map every chunk on its own.
+  uint64_t mapping_window_size() const;
+  void     set_mapping_window_size(uint64_t size);
+
+  uint64_t mapping_address_budget() const;
+  void     set_mapping_address_budget(uint64_t budget);
+
+  bool mapping_hugepages() const;
+  void set_mapping_hugepages(bool state);
+
+  uint64_t mapping_usage() const;
+
+  MappingManager* mapping_manager() LIBTORRENT_NO_EXPORT {
+    return m_mappingManager;
+  }
+
   void insert(ChunkList* chunkList);
   void erase(ChunkList* chunkList);
 
@@ -173,6 +305,23 @@ private:
   uint32_t m_preloadMinSize{ 256 << 10 };
   uint32_t m_preloadRequiredRate{ 5 << 10 };
 
+  uint32_t m_recheckReadMode{ recheck_read_mmap };
+  uint32_t m_writeMode{ write_mmap };
+
+  uint32_t        m_storageType{ storage_mmap };
+  StorageBackend* m_storage;
+
+  uint32_t    m_readCacheRatio{ 10 };
+  ChunkCache* m_readCache;
+
+  MappingManager* m_mappingManager;
+
+  SyncQueue* m_syncQueue{ nullptr };
+
+  uint32_t       m_prefetchLookahead{ 4 };
+  PrefetchQueue* m_prefetchQueue{ nullptr };
+  AllocateQueue* m_allocateQueue{ nullptr };
+
   uint32_t m_statsPreloaded{ 0 };
   uint32_t m_statsNotPreloaded{ 0 };
 
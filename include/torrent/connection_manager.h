@@ -113,6 +113,12 @@ public:
     return m_encryptionOptions;
   }
 
+  // Sends piece data that cannot be sent with sendfile using
+  // MSG_ZEROCOPY, where the kernel supports it.
+  bool is_zerocopy() const {
+    return m_zerocopy;
+  }
+
   void set_max_size(size_type s) {
     m_maxSize = s;
   }
@@ -122,6 +128,9 @@ public:
   void set_send_buffer_size(uint32_t s);
   void set_receive_buffer_size(uint32_t s);
   void set_encryption_options(uint32_t options);
+  void set_zerocopy(bool state) {
+    m_zerocopy = state;
+  }
 
   // Setting the addresses creates a copy of the address.
   const sockaddr* bind_address() const {
@@ -190,6 +199,7 @@ private:
   uint32_t      m_sendBufferSize{ 0 };
   uint32_t      m_receiveBufferSize{ 0 };
   int           m_encryptionOptions{ encryption_none };
+  bool          m_zerocopy{ false };
 
   sockaddr* m_bindAddress;
   sockaddr* m_localAddress;
@@ -7,6 +7,7 @@
 #include <torrent/common.h>
 #include <torrent/data/block.h>
 #include <torrent/data/piece.h>
+#include <memory>
 #include <vector>
 
 namespace torrent {
@@ -77,6 +78,8 @@ private:
   Block*    m_values{ nullptr };
 };
 
+class BlockListHasher;
+
 class LIBTORRENT_EXPORT BlockList : public no_copy_vector<Block> {
 public:
   using base_type = no_copy_vector<Block>;
@@ -157,6 +160,11 @@ public:
     m_bySeeder = state;
   }
 
+  // Internal to libTorrent, hashes the blocks as they complete.
+  BlockListHasher* hasher() {
+    return m_hasher.get();
+  }
+
   void do_all_failed();
 
 private:
@@ -171,6 +179,8 @@ private:
   uint32_t  m_attempt;
 
   bool m_bySeeder;
+
+  std::unique_ptr<BlockListHasher> m_hasher;
 };
 
 } // namespace torrent
@@ -13,6 +13,7 @@ namespace torrent {
 class LIBTORRENT_EXPORT lt_cacheline_aligned File {
 public:
   friend class FileList;
+  friend class FileManager;
 
   using range_type = std::pair<uint32_t, uint32_t>;
 
@@ -26,6 +27,16 @@ public:
   static constexpr int flag_prioritize_first = (1 << 6);
   static constexpr int flag_prioritize_last  = (1 << 7);
 
+  // Release the disk space of chunks that belong only to this file
+  // once its priority is set to off, see also
+  // FileList::set_reclaim_space.
+  static constexpr int flag_reclaim_space = (1 << 9);
+
+  // The file was not created as it is not wanted, and its part of the
+  // pieces shared with other files is kept in the FileList's part
+  // file.
+  static constexpr int flag_part_file = (1 << 8);
+
   File();
   ~File();
 
@@ -46,6 +57,9 @@ public:
   bool is_previously_created() const {
     return m_flags & flag_previously_created;
   }
+  bool is_part_file() const {
+    return m_flags & flag_part_file;
+  }
 
   bool has_flags(int flags) {
     return m_flags & flags;
@@ -132,6 +146,14 @@ public:
   uint64_t last_touched() const {
     return m_lastTouched;
   }
+
+  // The device and inode of the file, updated when it is opened.
+  uint64_t device() const {
+    return m_device;
+  }
+  uint64_t inode() const {
+    return m_inode;
+  }
   void set_last_touched(uint64_t t) {
     m_lastTouched = t;
   }
@@ -188,6 +210,8 @@ private:
   uint64_t m_offset{ 0 };
   uint64_t m_size{ 0 };
   uint64_t m_lastTouched;
+  uint64_t m_device{ 0 };
+  uint64_t m_inode{ 0 };
 
   range_type m_range;
 
@@ -196,6 +220,12 @@ private:
 
   uint32_t m_matchDepthPrev{ 0 };
   uint32_t m_matchDepthNext{ 0 };
+
+  // Owned by FileManager while the file is open.
+  uint32_t m_managerIndex{ 0 };
+  File*    m_lruPrev{ nullptr };
+  File*    m_lruNext{ nullptr };
+  uint64_t m_lruTouched{ 0 };
 };
 
 inline bool
@@ -207,14 +237,16 @@ inline void
 File::set_flags(int flags) {
   set_flags_protected(flags & (flag_create_queued | flag_resize_queued |
                                flag_fallocate | flag_fallocate_all |
-                               flag_prioritize_first | flag_prioritize_last));
+                               flag_prioritize_first | flag_prioritize_last |
+                               flag_reclaim_space));
 }
 
 inline void
 File::unset_flags(int flags) {
   unset_flags_protected(flags & (flag_create_queued | flag_resize_queued |
                                  flag_fallocate | flag_fallocate_all |
-                                 flag_prioritize_first | flag_prioritize_last));
+                                 flag_prioritize_first | flag_prioritize_last |
+                                 flag_reclaim_space));
 }
 
 inline void
@@ -65,6 +65,9 @@ public:
   bool is_open() const {
     return m_isOpen;
   }
+  bool is_allocating() const {
+    return m_allocating != 0;
+  }
   bool is_done() const {
     return completed_chunks() == size_chunks();
   }
@@ -125,6 +128,15 @@ public:
   }
   void set_max_file_size(uint64_t size);
 
+  // Release the disk space of chunks that belong only to files with
+  // priority off, as if every file had File::flag_reclaim_space set.
+  bool is_reclaim_space() const {
+    return m_reclaimSpace;
+  }
+  void set_reclaim_space(bool state) {
+    m_reclaimSpace = state;
+  }
+
   // If the files span multiple disks, the one with the least amount
   // of free diskspace will be returned.
   uint64_t free_diskspace() const;
@@ -162,6 +174,27 @@ protected:
   void open(int flags) LIBTORRENT_NO_EXPORT;
   void close() LIBTORRENT_NO_EXPORT;
 
+  // Passes the files that are to be preallocated to the disk thread,
+  // and calls 'slot' once they are all done. Returns false if there
+  // is nothing to allocate, in which case the slot is not called.
+  // Calling it again while allocating replaces the slot.
+  bool allocate(std::function<void()> slot) LIBTORRENT_NO_EXPORT;
+
+  // Creates a file that was kept in the part file, and copies the
+  // data of its boundary chunks there. The caller must make sure
+  // those chunks are not mapped.
+  bool migrate_part_file(File* file) LIBTORRENT_NO_EXPORT;
+
+  // The chunks of a file with priority off whose space is to be
+  // reclaimed, empty if none of them are completed. Shared boundary
+  // chunks are never included.
+  File::range_type reclaim_range(File* file) const LIBTORRENT_NO_EXPORT;
+
+  // Punches a hole over 'reclaim_range(file)' and clears those chunks
+  // in the completed bitfield. The caller must make sure the chunks
+  // are neither mapped nor being downloaded.
+  bool reclaim_space(File* file) LIBTORRENT_NO_EXPORT;
+
   download_data* mutable_data() {
     return &m_data;
   }
@@ -183,20 +216,28 @@ protected:
   void reset_filesize(int64_t) LIBTORRENT_NO_EXPORT;
 
 private:
-  bool        open_file(File*       node,
-                        const Path& lastPath,
-                        int         flags) LIBTORRENT_NO_EXPORT;
-  void        make_directory(Path::const_iterator pathBegin,
-                             Path::const_iterator pathEnd,
-                             Path::const_iterator startItr) LIBTORRENT_NO_EXPORT;
-  MemoryChunk create_chunk_part(FileList::iterator itr,
-                                uint64_t           offset,
-                                uint32_t           length,
-                                int                prot) LIBTORRENT_NO_EXPORT;
+  bool open_file(File*       node,
+                 const Path& lastPath,
+                 int         flags) LIBTORRENT_NO_EXPORT;
+  void make_directory(Path::const_iterator pathBegin,
+                      Path::const_iterator pathEnd,
+                      Path::const_iterator startItr) LIBTORRENT_NO_EXPORT;
+  void receive_allocated(File* file, int error) LIBTORRENT_NO_EXPORT;
+
+  bool  use_part_file(File* file) LIBTORRENT_NO_EXPORT;
+  File* part_file() LIBTORRENT_NO_EXPORT;
+  void  close_part_file(bool remove) LIBTORRENT_NO_EXPORT;
 
   download_data m_data;
 
   bool m_isOpen{ false };
+  bool m_reclaimSpace{ false };
+
+  uint32_t              m_allocating{ 0 };
+  std::function<void()> m_slotAllocated;
+
+  // Sparse, and addressed by the torrent offset.
+  File* m_partFile{ nullptr };
 
   uint64_t m_torrentSize{ 0 };
   uint32_t m_chunkSize{ 0 };
@@ -11,6 +11,12 @@ namespace torrent {
 
 class File;
 
+// The open files are kept in a list ordered by when they were last
+// moved to its front, with the time stored in the file. Touching a
+// file only updates File::last_touched, and files touched since they
+// were moved get another round when they reach the back, so finding
+// the least active file takes amortized constant time.
+
 class LIBTORRENT_EXPORT FileManager : private std::vector<File*> {
 public:
   using base_type = std::vector<File*>;
@@ -57,8 +63,14 @@ private:
   FileManager(const FileManager&) LIBTORRENT_NO_EXPORT = delete;
   void operator=(const FileManager&) LIBTORRENT_NO_EXPORT = delete;
 
+  void lru_push_front(File* file) LIBTORRENT_NO_EXPORT;
+  void lru_unlink(File* file) LIBTORRENT_NO_EXPORT;
+
   size_type m_maxOpenFiles{ 0 };
 
+  File* m_lruFront{ nullptr };
+  File* m_lruBack{ nullptr };
+
   uint64_t m_filesOpenedCounter{ 0 };
   uint64_t m_filesClosedCounter{ 0 };
   uint64_t m_filesFailedCounter{ 0 };
@@ -11,6 +11,7 @@
 #include <torrent/common.h>
 #include <torrent/download/choke_queue.h>
 #include <torrent/peer/peer.h>
+#include <torrent/utils/ranges.h>
 
 namespace torrent {
 
@@ -55,6 +56,10 @@ public:
   bool hash_check(bool tryQuick);
   void hash_stop();
 
+  // The chunk ranges that have not yet been checked, including those
+  // currently being hashed. Empty once the download is checked.
+  ranges<uint32_t> hash_unchecked_ranges() const;
+
   // Start/stop the download. The torrent must be open.
   void start(int flags = 0);
   void stop(int flags = 0);
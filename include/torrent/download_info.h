@@ -39,6 +39,9 @@ public:
   static constexpr int flag_pex_enabled   = (1 << 7);
   static constexpr int flag_pex_active    = (1 << 8);
 
+  // Started, but waiting for files to be allocated.
+  static constexpr int flag_opening = (1 << 9);
+
   static constexpr int public_flags = flag_accepting_seeders;
 
   static constexpr uint32_t unlimited = ~uint32_t();
@@ -79,6 +82,9 @@ public:
   bool is_active() const {
     return m_flags & flag_active;
   }
+  bool is_opening() const {
+    return m_flags & flag_opening;
+  }
   bool is_compact() const {
     return m_flags & flag_compact;
   }
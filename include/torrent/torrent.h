@@ -67,6 +67,21 @@ version() LIBTORRENT_EXPORT;
 uint32_t
 hash_queue_size() LIBTORRENT_EXPORT;
 
+// The number of threads used for hash checking chunks, including the
+// disk thread. May be changed while the library is running.
+uint32_t
+hash_thread_count() LIBTORRENT_EXPORT;
+void
+set_hash_thread_count(uint32_t count) LIBTORRENT_EXPORT;
+
+// The number of hash threads that may read rechecked chunks from the
+// same device at once. Rechecks on each device are read in order of
+// their position on disk, so keep this low for rotational disks.
+uint32_t
+hash_device_limit() LIBTORRENT_EXPORT;
+void
+set_hash_device_limit(uint32_t limit) LIBTORRENT_EXPORT;
+
 using DList        = std::list<Download>;
 using EncodingList = std::list<std::string>;
 
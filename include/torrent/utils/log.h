@@ -90,6 +90,11 @@ enum {
   LOG_INSTRUMENTATION_CHOKE,
   LOG_INSTRUMENTATION_POLLING,
   LOG_INSTRUMENTATION_TRANSFERS,
+  LOG_INSTRUMENTATION_HASHING,
+  LOG_INSTRUMENTATION_READ_CACHE,
+  LOG_INSTRUMENTATION_FILES,
+  LOG_INSTRUMENTATION_MAPPING,
+  LOG_INSTRUMENTATION_DEVICES,
 
   LOG_MOCK_CALLS,
 
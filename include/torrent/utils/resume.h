@@ -13,6 +13,7 @@
 #define LIBTORRENT_UTILS_RESUME_H
 
 #include <torrent/common.h>
+#include <torrent/utils/ranges.h>
 
 namespace torrent {
 
@@ -32,6 +33,24 @@ resume_load_bitfield(Download download, const Object& object) LIBTORRENT_EXPORT;
 void
 resume_save_bitfield(Download download, Object& object) LIBTORRENT_EXPORT;
 
+// Save the progress of an ongoing hash check, so that a check
+// interrupted by a restart continues where it stopped. Called by
+// 'resume_save_progress' while checking, and loaded in place of the
+// bitfield by 'resume_load_progress' before the per-file checks.
+//
+// The overload taking 'unchecked' writes the checkpoint for the
+// current bitfield without requiring the download to be checking.
+bool
+resume_load_hash_checkpoint(Download      download,
+                            const Object& object) LIBTORRENT_EXPORT;
+void
+resume_save_hash_checkpoint(Download download,
+                            Object&  object) LIBTORRENT_EXPORT;
+void
+resume_save_hash_checkpoint(Download                download,
+                            const ranges<uint32_t>& unchecked,
+                            Object&                 object) LIBTORRENT_EXPORT;
+
 // Do not call 'resume_load_uncertain_pieces' directly.
 void
 resume_load_uncertain_pieces(Download      download,
@@ -50,6 +50,12 @@ public:
     return state() == STATE_INACTIVE;
   }
 
+  // True once start_thread has created the thread, which may not yet
+  // have set STATE_ACTIVE.
+  bool is_started() const {
+    return m_thread != nullptr;
+  }
+
   bool is_polling() const;
   bool is_current() const;
 
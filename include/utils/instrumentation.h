@@ -74,6 +74,29 @@ enum instrumentation_enum {
 
   INSTRUMENTATION_TRANSFER_PEER_INFO_UNACCOUNTED,
 
+  INSTRUMENTATION_HASHING_INTERACTIVE_QUEUED,
+  INSTRUMENTATION_HASHING_INTERACTIVE_DISPATCHED,
+  INSTRUMENTATION_HASHING_INTERACTIVE_WAIT,
+  INSTRUMENTATION_HASHING_RECHECK_QUEUED,
+  INSTRUMENTATION_HASHING_RECHECK_DISPATCHED,
+  INSTRUMENTATION_HASHING_RECHECK_WAIT,
+
+  INSTRUMENTATION_READ_CACHE_HIT,
+  INSTRUMENTATION_READ_CACHE_MISS,
+  INSTRUMENTATION_READ_CACHE_EVICTED,
+  INSTRUMENTATION_READ_CACHE_USAGE,
+  INSTRUMENTATION_READ_CACHE_COUNT,
+
+  INSTRUMENTATION_FILES_HIT,
+  INSTRUMENTATION_FILES_OPENED,
+  INSTRUMENTATION_FILES_EVICTED,
+  INSTRUMENTATION_FILES_OPEN,
+
+  INSTRUMENTATION_MAPPING_HIT,
+  INSTRUMENTATION_MAPPING_MAPPED,
+  INSTRUMENTATION_MAPPING_FALLBACK,
+  INSTRUMENTATION_MAPPING_USAGE,
+
   INSTRUMENTATION_MAX_SIZE
 };
 
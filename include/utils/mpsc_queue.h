@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#ifndef LIBTORRENT_UTILS_MPSC_QUEUE_H
+#define LIBTORRENT_UTILS_MPSC_QUEUE_H
+
+#include <atomic>
+
+#include "torrent/utils/cacheline.h"
+
+namespace torrent {
+
+// An intrusive lock-free queue with any number of producers and a
+// single consumer, linking the nodes through the 'Next' member. As no
+// memory is allocated the queue is bounded by the number of nodes,
+// and a push never blocks or fails.
+//
+// The consumer takes all queued nodes at once, which are returned in
+// the order they were pushed.
+
+template <typename Type, Type* Type::*Next>
+class mpsc_queue {
+public:
+  bool empty() const {
+    return m_head.load(std::memory_order_acquire) == nullptr;
+  }
+
+  // Returns true if the queue was empty, in which case the consumer
+  // should be woken up.
+  bool push(Type* node) {
+    Type* head = m_head.load(std::memory_order_relaxed);
+
+    do {
+      node->*Next = head;
+    } while (!m_head.compare_exchange_weak(
+      head, node, std::memory_order_release, std::memory_order_relaxed));
+
+    return head == nullptr;
+  }
+
+  // Only call from the consumer thread. The nodes are linked through
+  // 'Next', ending with nullptr.
+  Type* pop_all() {
+    Type* node   = m_head.exchange(nullptr, std::memory_order_acquire);
+    Type* result = nullptr;
+
+    while (node != nullptr) {
+      Type* next  = node->*Next;
+      node->*Next = result;
+      result      = node;
+      node        = next;
+    }
+
+    return result;
+  }
+
+private:
+  std::atomic<Type*> m_head lt_cacheline_aligned{ nullptr };
+};
+
+} // namespace torrent
+
+#endif
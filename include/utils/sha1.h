@@ -4,6 +4,7 @@
 #ifndef LIBTORRENT_HASH_COMPUTE_H
 #define LIBTORRENT_HASH_COMPUTE_H
 
+#include <cinttypes>
 #include <cstring>
 #include <openssl/sha.h>
 
@@ -20,6 +21,42 @@ private:
   SHA_CTX m_ctx;
 };
 
+// Hashes several streams of equal length at once by interleaving
+// them in the lanes of SIMD registers. Every call to update must pass
+// the same number of bytes for each of the lanes.
+class Sha1Multi {
+public:
+  static constexpr unsigned int max_lanes = 16;
+
+  // The number of lanes to use for multi-buffer hashing to be faster
+  // than Sha1, or 1 if the CPU lacks AVX2 or has SHA-NI, which Sha1
+  // uses through OpenSSL.
+  static unsigned int preferred_lanes();
+
+  // Whether the CPU has a multi-buffer kernel at all, Sha1Multi may
+  // only be used if it does.
+  static bool is_supported();
+
+  unsigned int lanes() const {
+    return m_lanes;
+  }
+
+  void init(unsigned int lanes);
+  void update(const void* const* data, unsigned int length);
+
+  void final_c(char* const* buffers);
+
+private:
+  void transform(const unsigned char* const* data, unsigned int blocks);
+
+  unsigned int m_lanes;
+  unsigned int m_buffered;
+  uint64_t     m_length;
+
+  uint32_t      m_state[5][max_lanes];
+  unsigned char m_buffer[max_lanes][64];
+};
+
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 inline void
 Sha1::init() {
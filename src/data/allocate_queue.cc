@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#include <cerrno>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "data/allocate_queue.h"
+#include "data/socket_file.h"
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+AllocateQueue::~AllocateQueue() {
+  for (auto& device : m_pending) {
+    for (auto j : device.second) {
+      ::close(j->fd);
+      delete j;
+    }
+  }
+
+  for (job* j = m_done_queue.pop_all(); j != nullptr;)
+    delete std::exchange(j, j->m_done_next);
+}
+
+void
+AllocateQueue::push_back(const void* owner,
+                         uint64_t    device,
+                         int         fd,
+                         uint64_t    size,
+                         int         flags,
+                         slot_result slot) {
+  if (fd == -1)
+    throw internal_error("AllocateQueue::push_back(...) fd == -1.");
+
+  auto j = new job{ owner, fd, size, flags, 0, std::move(slot) };
+
+  m_size++;
+
+  {
+    std::lock_guard lk(m_lock);
+    m_pending[device].push_back(j);
+  }
+
+  if (m_slot_interrupt)
+    m_slot_interrupt(device);
+}
+
+size_t
+AllocateQueue::pending(uint64_t device) {
+  std::lock_guard lk(m_lock);
+
+  auto itr = m_pending.find(device);
+  return itr != m_pending.end() ? itr->second.size() : 0;
+}
+
+void
+AllocateQueue::perform(uint64_t device, device_stats* stats) {
+  while (true) {
+    job* j;
+
+    {
+      std::lock_guard lk(m_lock);
+
+      auto itr = m_pending.find(device);
+
+      if (itr == m_pending.end())
+        return;
+
+      j = itr->second.front();
+      itr->second.pop_front();
+
+      if (itr->second.empty())
+        m_pending.erase(itr);
+
+      m_running[j->owner]++;
+    }
+
+    auto start = device_stats::clock_type::now();
+
+    errno = 0;
+
+    if (!SocketFile(j->fd).set_size(j->size, j->flags))
+      j->error = errno != 0 ? errno : EIO;
+
+    ::close(j->fd);
+
+    device_stats::update(stats, j->size, start);
+
+    const void* owner = j->owner;
+    bool        first = m_done_queue.push(j);
+
+    {
+      std::lock_guard lk(m_lock);
+
+      auto itr = m_running.find(owner);
+
+      if (--itr->second == 0) {
+        m_running.erase(itr);
+
+        if (m_waiting && owner == m_waiting_owner) {
+          m_waiting = false;
+          m_waiting_done.set_value();
+        }
+      }
+    }
+
+    if (first && m_slot_has_work)
+      m_slot_has_work();
+  }
+}
+
+void
+AllocateQueue::erase(const void* owner) {
+  std::vector<job*> cancelled;
+  std::future<void> running_done;
+
+  {
+    std::lock_guard lk(m_lock);
+
+    for (auto itr = m_pending.begin(); itr != m_pending.end();) {
+      auto& jobs = itr->second;
+
+      for (auto job_itr = jobs.begin(); job_itr != jobs.end();) {
+        if ((*job_itr)->owner != owner) {
+          ++job_itr;
+          continue;
+        }
+
+        cancelled.push_back(*job_itr);
+        job_itr = jobs.erase(job_itr);
+      }
+
+      if (jobs.empty())
+        itr = m_pending.erase(itr);
+      else
+        ++itr;
+    }
+
+    if (m_running.find(owner) != m_running.end()) {
+      m_waiting       = true;
+      m_waiting_owner = owner;
+      m_waiting_done  = std::promise<void>();
+      running_done    = m_waiting_done.get_future();
+    }
+  }
+
+  if (running_done.valid())
+    running_done.wait();
+
+  for (auto j : cancelled) {
+    ::close(j->fd);
+    j->error = ECANCELED;
+    finish(j);
+  }
+
+  // The completed jobs of other owners go back on the done queue, to
+  // be received by the next call to 'work'.
+  bool has_work = false;
+
+  for (job* j = m_done_queue.pop_all(); j != nullptr;) {
+    job* current = std::exchange(j, j->m_done_next);
+
+    if (current->owner == owner) {
+      finish(current);
+      continue;
+    }
+
+    has_work |= m_done_queue.push(current);
+  }
+
+  if (has_work && m_slot_has_work)
+    m_slot_has_work();
+}
+
+void
+AllocateQueue::work() {
+  for (job* j = m_done_queue.pop_all(); j != nullptr;)
+    finish(std::exchange(j, j->m_done_next));
+}
+
+void
+AllocateQueue::finish(job* j) {
+  std::unique_ptr<job> done(j);
+
+  if (m_size == 0)
+    throw internal_error("AllocateQueue::finish(...) m_size == 0.");
+
+  m_size--;
+  done->slot(done->error);
+}
+
+} // namespace torrent
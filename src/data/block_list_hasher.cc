@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#include "data/block_list_hasher.h"
+#include "data/chunk.h"
+#include "data/chunk_iterator.h"
+#include "torrent/data/block.h"
+#include "torrent/data/block_list.h"
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+void
+BlockListHasher::clear() {
+  m_hash.init();
+  m_next  = 0;
+  m_valid = true;
+
+  m_pending.clear();
+  m_pending_size = 0;
+}
+
+void
+BlockListHasher::invalidate() {
+  m_valid = false;
+
+  m_pending.clear();
+  m_pending_size = 0;
+}
+
+void
+BlockListHasher::block_completed(const Block* block, Chunk* chunk) {
+  if (!m_valid)
+    return;
+
+  const BlockList* block_list = block->parent();
+  uint32_t         index      = block - block_list->begin();
+
+  if (block_list->size() != m_size || index >= m_size)
+    throw internal_error(
+      "BlockListHasher::block_completed(...) received an invalid block.");
+
+  // Already hashed or copied, which would be a bug in the caller.
+  if (index < m_next || m_pending.find(index) != m_pending.end())
+    throw internal_error(
+      "BlockListHasher::block_completed(...) block completed twice.");
+
+  if (index != m_next) {
+    if (m_pending_size + block->piece().length() > max_pending_size) {
+      invalidate();
+      return;
+    }
+
+    auto buffer = std::make_unique<char[]>(block->piece().length());
+    chunk->to_buffer(
+      buffer.get(), block->piece().offset(), block->piece().length());
+
+    m_pending[index] = std::move(buffer);
+    m_pending_size += block->piece().length();
+    return;
+  }
+
+  update_chunk(chunk, block->piece().offset(), block->piece().length());
+  m_next++;
+
+  auto itr = m_pending.begin();
+
+  while (itr != m_pending.end() && itr->first == m_next) {
+    uint32_t length = (block_list->begin() + m_next)->piece().length();
+
+    m_hash.update(itr->second.get(), length);
+    m_pending_size -= length;
+    m_next++;
+
+    itr = m_pending.erase(itr);
+  }
+}
+
+bool
+BlockListHasher::hash_c(char* buffer) {
+  if (!m_valid || m_next != m_size)
+    return false;
+
+  m_hash.final_c(buffer);
+  m_valid = false;
+
+  return true;
+}
+
+void
+BlockListHasher::update_chunk(Chunk* chunk, uint32_t position, uint32_t length) {
+  if (position + length > chunk->chunk_size())
+    throw internal_error(
+      "BlockListHasher::update_chunk(...) position + length > chunk_size.");
+
+  ChunkIterator itr(chunk, position, position + length);
+
+  do {
+    Chunk::data_type data = itr.data();
+    m_hash.update(data.first, data.second);
+  } while (itr.next());
+}
+
+} // namespace torrent
@@ -160,7 +160,7 @@ Chunk::sync(int flags) {
   bool success = true;
 
   for (auto& part : *this) {
-    if (!part.chunk().sync(0, part.chunk().size(), flags)) {
+    if (!part.sync(flags)) {
       success = false;
     }
   }
@@ -168,6 +168,39 @@ Chunk::sync(int flags) {
   return success;
 }
 
+void
+Chunk::mark_dirty(uint32_t position, uint32_t length) {
+  for (auto& part : *this) {
+    if (part.mapped() != ChunkPart::MAPPED_BUFFER)
+      continue;
+
+    uint32_t first = std::max(position, part.position());
+    uint32_t last =
+      std::min(position + length, part.position() + part.size());
+
+    if (first < last)
+      part.mark_dirty(first - part.position(), last - part.position());
+  }
+}
+
+bool
+Chunk::load(uint32_t position, uint32_t length) {
+  for (auto& part : *this) {
+    if (part.mapped() != ChunkPart::MAPPED_BUFFER)
+      continue;
+
+    uint32_t first = std::max(position, part.position());
+    uint32_t last =
+      std::min(position + length, part.position() + part.size());
+
+    if (first < last &&
+        !part.load(first - part.position(), last - part.position()))
+      return false;
+  }
+
+  return true;
+}
+
 void
 Chunk::preload(uint32_t position, uint32_t length, bool useAdvise) {
   if (position >= m_chunkSize)
@@ -215,6 +248,9 @@ Chunk::to_buffer(void* buffer, uint32_t position, uint32_t length) {
   if (length == 0)
     return true;
 
+  if (!load(position, length))
+    return false;
+
   Chunk::data_type data;
   ChunkIterator    itr(this, position, position + length);
 
@@ -260,6 +296,7 @@ Chunk::from_buffer(const void* buffer, uint32_t position, uint32_t length) {
   // Stop intercepting SIGBUS
   sigaction(SIGBUS, &oldact, nullptr);
 
+  mark_dirty(position, length);
   return true;
 }
 
@@ -274,6 +311,9 @@ Chunk::compare_buffer(const void* buffer, uint32_t position, uint32_t length) {
   if (length == 0)
     return true;
 
+  if (!load(position, length))
+    return false;
+
   Chunk::data_type data;
   ChunkIterator    itr(this, position, position + length);
 
@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#include <algorithm>
+
+#include "data/chunk_cache.h"
+#include "data/chunk_list.h"
+#include "torrent/exceptions.h"
+#include "utils/instrumentation.h"
+
+namespace torrent {
+
+bool
+ChunkCache::is_cached(const ChunkListNode* node) const {
+  auto itr = m_index.find(node);
+
+  return itr != m_index.end() && (itr->second.list == list_recent ||
+                                  itr->second.list == list_frequent);
+}
+
+void
+ChunkCache::push_front(list_type list, const entry& e) {
+  m_lists[list].entries.push_front(e);
+  m_lists[list].size += e.size;
+
+  m_index[e.node] = locator{ list, m_lists[list].entries.begin() };
+
+  if (list == list_recent || list == list_frequent) {
+    instrumentation_update(INSTRUMENTATION_READ_CACHE_COUNT, 1);
+    instrumentation_update(INSTRUMENTATION_READ_CACHE_USAGE, e.size);
+  }
+}
+
+void
+ChunkCache::remove(index_map::iterator itr) {
+  list_type list = itr->second.list;
+  uint32_t  size = itr->second.itr->size;
+
+  m_lists[list].entries.erase(itr->second.itr);
+  m_lists[list].size -= size;
+  m_index.erase(itr);
+
+  if (list == list_recent || list == list_frequent) {
+    instrumentation_update(INSTRUMENTATION_READ_CACHE_COUNT, -1);
+    instrumentation_update(INSTRUMENTATION_READ_CACHE_USAGE, -int64_t(size));
+  }
+}
+
+// Evicted chunks are remembered in the matching ghost list, while
+// evicting from a ghost list forgets the chunk.
+void
+ChunkCache::evict_lru(list_type list) {
+  entry e = m_lists[list].entries.back();
+
+  remove(m_index.find(e.node));
+
+  if (list == list_recent_ghost || list == list_frequent_ghost)
+    return;
+
+  push_front(list == list_recent ? list_recent_ghost : list_frequent_ghost, e);
+
+  instrumentation_update(INSTRUMENTATION_READ_CACHE_EVICTED, 1);
+
+  e.chunk_list->clear_cached(e.node);
+}
+
+void
+ChunkCache::trim_ghosts(uint64_t capacity) {
+  while (!m_lists[list_recent_ghost].entries.empty() &&
+         m_lists[list_recent].size + m_lists[list_recent_ghost].size >
+           capacity)
+    evict_lru(list_recent_ghost);
+
+  while (!m_lists[list_frequent_ghost].entries.empty() &&
+         usage() + m_lists[list_recent_ghost].size +
+             m_lists[list_frequent_ghost].size >
+           2 * capacity)
+    evict_lru(list_frequent_ghost);
+}
+
+// Evicts from the recent list while it is larger than its target
+// size, otherwise from the frequent list.
+void
+ChunkCache::replace(uint64_t capacity) {
+  while (usage() > capacity) {
+    bool recent_empty   = m_lists[list_recent].entries.empty();
+    bool frequent_empty = m_lists[list_frequent].entries.empty();
+
+    if (!recent_empty &&
+        (m_lists[list_recent].size > m_recent_target || frequent_empty))
+      evict_lru(list_recent);
+    else
+      evict_lru(list_frequent);
+  }
+}
+
+bool
+ChunkCache::insert(ChunkList*     chunk_list,
+                   ChunkListNode* node,
+                   uint32_t       size,
+                   uint64_t       capacity) {
+  list_type list = list_recent;
+
+  if (node->cache_frequent()) {
+    node->set_cache_frequent(false);
+    list = list_frequent;
+  }
+
+  if (size > capacity)
+    return false;
+
+  auto itr = m_index.find(node);
+
+  if (itr != m_index.end()) {
+    uint64_t recent_ghost   = m_lists[list_recent_ghost].size;
+    uint64_t frequent_ghost = m_lists[list_frequent_ghost].size;
+
+    switch (itr->second.list) {
+    case list_recent_ghost:
+      m_recent_target =
+        std::min(capacity,
+                 m_recent_target +
+                   std::max<uint64_t>(size, size * frequent_ghost /
+                                              recent_ghost));
+      break;
+
+    case list_frequent_ghost: {
+      uint64_t delta =
+        std::max<uint64_t>(size, size * recent_ghost / frequent_ghost);
+
+      m_recent_target = m_recent_target > delta ? m_recent_target - delta : 0;
+      break;
+    }
+
+    default:
+      throw internal_error("ChunkCache::insert(...) node already cached.");
+    }
+
+    remove(itr);
+    list = list_frequent;
+  }
+
+  // Make room before inserting, so the new chunk is never the one
+  // evicted.
+  replace(capacity - size);
+  push_front(list, entry{ chunk_list, node, size });
+  trim_ghosts(capacity);
+
+  return true;
+}
+
+void
+ChunkCache::hit(ChunkListNode* node) {
+  auto itr = m_index.find(node);
+
+  if (itr == m_index.end() || (itr->second.list != list_recent &&
+                               itr->second.list != list_frequent))
+    throw internal_error("ChunkCache::hit(...) node not cached.");
+
+  remove(itr);
+  node->set_cache_frequent(true);
+
+  instrumentation_update(INSTRUMENTATION_READ_CACHE_HIT, 1);
+}
+
+void
+ChunkCache::evict(uint64_t capacity) {
+  replace(capacity);
+  trim_ghosts(capacity);
+}
+
+void
+ChunkCache::erase(ChunkList* chunk_list) {
+  for (int list = list_recent; list != list_max_size; list++) {
+    auto& entries = m_lists[list].entries;
+
+    for (auto itr = entries.begin(); itr != entries.end();) {
+      entry e = *itr++;
+
+      if (e.chunk_list != chunk_list)
+        continue;
+
+      remove(m_index.find(e.node));
+
+      if (list == list_recent || list == list_frequent)
+        chunk_list->clear_cached(e.node);
+    }
+  }
+}
+
+void
+ChunkCache::erase(ChunkListNode* node) {
+  auto itr = m_index.find(node);
+
+  if (itr == m_index.end() || (itr->second.list != list_recent &&
+                               itr->second.list != list_frequent))
+    return;
+
+  ChunkList* chunk_list = itr->second.itr->chunk_list;
+
+  remove(itr);
+  chunk_list->clear_cached(node);
+}
+
+} // namespace torrent
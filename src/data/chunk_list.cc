@@ -1,7 +1,13 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
 #include "data/chunk.h"
+#include "data/chunk_cache.h"
+#include "data/sync_queue.h"
 #include "globals.h"
 #include "torrent/chunk_manager.h"
 #include "torrent/data/download_data.h"
@@ -71,6 +77,13 @@ void
 ChunkList::clear() {
   LT_LOG_THIS(INFO, "Clearing.", 0);
 
+  // Syncs passed to the sync thread still reference their chunks, so
+  // wait for them before tearing down the nodes.
+  wait_syncing();
+
+  if (m_manager != nullptr)
+    m_manager->read_cache()->erase(this);
+
   // Don't do any sync'ing as whomever decided to shut down really
   // doesn't care, so just de-reference all chunks in queue.
   for (auto& node : m_queue) {
@@ -107,6 +120,27 @@ ChunkList::clear() {
   base_type::clear();
 }
 
+void
+ChunkList::clear_cached(ChunkListNode* node) {
+  if (node->references() != 0)
+    throw internal_error(
+      "ChunkList::clear_cached(...) node is still referenced.");
+
+  clear_chunk(node);
+}
+
+// Any chunk that was modified while syncing, or failed to sync, is
+// put back in the queue.
+void
+ChunkList::wait_syncing() {
+  while (m_syncing != 0) {
+    if (m_manager->sync_queue() == nullptr ||
+        m_manager->sync_queue()->wait() == 0)
+      throw internal_error(
+        "ChunkList::wait_syncing() could not wait for in-flight syncs.");
+  }
+}
+
 ChunkHandle
 ChunkList::get(size_type index, int flags) {
   LT_LOG_THIS(DEBUG, "Get: index:%" PRIu32 " flags:%#x.", index, flags);
@@ -120,6 +154,12 @@ ChunkList::get(size_type index, int flags) {
   int prot_flags = MemoryChunk::prot_read |
                    ((flags & get_writable) ? MemoryChunk::prot_write : 0);
 
+  // Unreferenced chunks are only kept mapped by the read cache.
+  if (node->is_valid() && node->references() == 0)
+    m_manager->read_cache()->hit(node);
+  else if (!node->is_valid() && !(flags & (get_writable | get_dont_log)))
+    instrumentation_update(INSTRUMENTATION_READ_CACHE_MISS, 1);
+
   if (!node->is_valid()) {
     if (!m_manager->allocate(m_chunk_size, allocate_flags)) {
       LT_LOG_THIS(DEBUG,
@@ -174,6 +214,21 @@ ChunkList::get(size_type index, int flags) {
     node->set_time_modified(utils::timer());
   }
 
+  // Buffered chunks are only filled from the file once something
+  // reads them, which for a downloaded piece is just the ranges that
+  // were not received, e.g. when it gets hashed.
+  if (!(flags & get_writable) &&
+      !node->chunk()->load(0, node->chunk()->chunk_size())) {
+    utils::error_number current_error = utils::error_number::current();
+
+    LT_LOG_THIS(DEBUG,
+                "Could not load: index:%" PRIu32 " errno:%i errmsg:%s.",
+                index,
+                current_error.value(),
+                current_error.message().c_str());
+    return ChunkHandle::from_error(current_error);
+  }
+
   node->inc_references();
 
   if (flags & get_writable) {
@@ -241,7 +296,14 @@ ChunkList::release(ChunkHandle* handle, int release_flags) {
         throw internal_error(
           "ChunkList::release(...) tried to unmap a queued chunk.");
 
-      clear_chunk(handle->object(), release_flags);
+      // Chunks released by hash checks are read once, and would only
+      // push other chunks out of the read cache.
+      if ((release_flags & get_dont_log) ||
+          !m_manager->read_cache()->insert(this,
+                                           handle->object(),
+                                           m_chunk_size,
+                                           m_manager->read_cache_max_usage()))
+        clear_chunk(handle->object(), release_flags);
     }
   }
 
@@ -258,6 +320,9 @@ ChunkList::clear_chunk(ChunkListNode* node, int flags) {
 
   m_manager->deallocate(
     m_chunk_size, (flags & get_dont_log) ? ChunkManager::allocate_dont_log : 0);
+
+  if (m_slot_chunk_cleared)
+    m_slot_chunk_cleared(node->index());
 }
 
 inline bool
@@ -285,19 +350,77 @@ ChunkList::sync_chunk(ChunkListNode* node, std::pair<int, bool> options) {
   return true;
 }
 
+// Passes the sync to the disk thread, the node keeps its writable
+// reference until 'sync_chunk_done' is called. Returns false if the
+// caller should sync in place.
+bool
+ChunkList::sync_chunk_thread(ChunkListNode* node, int flags) {
+  if (node->references() <= 0 || node->writable() <= 0)
+    throw internal_error("ChunkList::sync_chunk_thread(...) got a node with "
+                         "invalid reference count.");
+
+  if (!m_manager->sync_queue()->push_back(
+        node->chunk(), flags, [this, node](int error) {
+          sync_chunk_done(node, error);
+        }))
+    return false;
+
+  node->set_sync_triggered(true);
+  m_syncing++;
+
+  return true;
+}
+
+void
+ChunkList::sync_chunk_done(ChunkListNode* node, int error) {
+  LT_LOG_THIS(DEBUG,
+              "Sync done: index:%" PRIu32 " error:%i.",
+              node->index(),
+              error);
+
+  if (m_syncing == 0)
+    throw internal_error("ChunkList::sync_chunk_done(...) m_syncing == 0.");
+
+  m_syncing--;
+
+  if (error != 0)
+    m_slot_storage_error(std::string("Could not sync chunk: ") +
+                         std::strerror(error));
+
+  // The chunk was written to while syncing, so it needs to be synced
+  // again before it can be released.
+  if (!node->sync_triggered() || error != 0) {
+    if (is_queued(node))
+      throw internal_error(
+        "ChunkList::sync_chunk_done(...) tried to queue an already queued chunk.");
+
+    m_queue.push_back(node);
+    return;
+  }
+
+  node->dec_rw();
+
+  if (node->references() == 0)
+    clear_chunk(node);
+}
+
 uint32_t
 ChunkList::sync_chunks(int flags) {
   LT_LOG_THIS(DEBUG, "Sync chunks: flags:%#x.", flags);
 
   Queue::iterator split;
 
-  if (flags & sync_all)
+  // Chunks still syncing must be back in the queue when syncing all,
+  // so that none are left unsynced.
+  if (flags & sync_all) {
+    wait_syncing();
     split = m_queue.begin();
-  else
+  } else {
     split = std::stable_partition(
       m_queue.begin(), m_queue.end(), [](ChunkListNode* n) {
         return 1 != n->writable();
       });
+  }
 
   // Allow a flag that does more culling, so that we only get large
   // continous sections.
@@ -321,6 +444,12 @@ ChunkList::sync_chunks(int flags) {
   if ((flags & sync_use_timeout) && !(flags & sync_force))
     split = partition_optimize(split, m_queue.end(), 50, 5, false);
 
+  // Chunks that are released by the sync are passed to the sync
+  // thread when available, so that the main thread only partitions
+  // the queue. Closing the download must sync in place.
+  bool use_thread =
+    !(flags & sync_all) && m_manager->sync_queue() != nullptr;
+
   uint32_t failed = 0;
 
   for (auto itr = split, last = m_queue.end(); itr != last; ++itr) {
@@ -336,6 +465,10 @@ ChunkList::sync_chunks(int flags) {
 
     std::pair<int, bool> options = sync_options(*itr, flags);
 
+    if (use_thread && options.second &&
+        sync_chunk_thread(*itr, options.first))
+      continue;
+
     if (!sync_chunk(*itr, options)) {
       std::iter_swap(itr, split++);
 
@@ -2,9 +2,14 @@
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
 #include <algorithm>
+#include <cerrno>
 #include <unistd.h>
 
 #include "data/chunk_part.h"
+#include "data/mapping_manager.h"
+#include "manager.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/data/file.h"
 #include "torrent/exceptions.h"
 
 namespace torrent {
@@ -13,16 +18,151 @@ void
 ChunkPart::clear() {
   switch (m_mapped) {
     case MAPPED_MMAP:
+    case MAPPED_BUFFER:
       m_chunk.unmap();
       break;
 
-    default:
+    case MAPPED_WINDOW:
+      manager->chunk_manager()->mapping_manager()->release(m_chunk);
+      break;
+
     case MAPPED_STATIC:
-      throw internal_error("ChunkPart::clear() only MAPPED_MMAP supported.");
       break;
+
+    default:
+      throw internal_error("ChunkPart::clear() invalid mapped type.");
   }
 
   m_chunk.clear();
+  m_dirty.clear();
+  m_loaded.clear();
+}
+
+bool
+ChunkPart::sync(int flags) {
+  if (m_mapped == MAPPED_STATIC)
+    return true;
+
+  if (m_mapped != MAPPED_BUFFER)
+    return m_chunk.sync(0, size(), flags);
+
+  if (!flush())
+    return false;
+
+  if (!(flags & MemoryChunk::sync_sync))
+    return true;
+
+  if (!m_file->prepare(MemoryChunk::prot_read | MemoryChunk::prot_write))
+    return false;
+
+  return ::fdatasync(m_file->file_descriptor()) == 0;
+}
+
+bool
+ChunkPart::flush() {
+  if (m_dirty.empty())
+    return true;
+
+  if (m_file == nullptr)
+    throw internal_error("ChunkPart::flush() buffer has no file.");
+
+  // The file manager may have closed the file since the chunk was
+  // created.
+  if (!m_file->prepare(MemoryChunk::prot_read | MemoryChunk::prot_write))
+    return false;
+
+  return write_ranges(
+    m_file->file_descriptor(), m_chunk.begin(), m_file_offset, &m_dirty);
+}
+
+// Only the gaps between written or loaded ranges are read, so a
+// piece downloaded in full is never read back from the file. Reading
+// past the end of the file leaves the buffer zeroed.
+bool
+ChunkPart::load(uint32_t first, uint32_t last) {
+  if (m_mapped != MAPPED_BUFFER)
+    return true;
+
+  if (m_file == nullptr)
+    throw internal_error("ChunkPart::load() buffer has no file.");
+
+  last = std::min(last, size());
+
+  while (first < last) {
+    auto itr = m_loaded.find(first);
+
+    if (itr != m_loaded.end() && itr->first <= first) {
+      first = itr->second;
+      continue;
+    }
+
+    uint32_t gap_last =
+      itr != m_loaded.end() ? std::min(last, itr->first) : last;
+
+    if (!m_file->prepare(MemoryChunk::prot_read | MemoryChunk::prot_write))
+      return false;
+
+    for (uint32_t position = first; position < gap_last;) {
+      ssize_t result = ::pread(m_file->file_descriptor(),
+                               m_chunk.begin() + position,
+                               gap_last - position,
+                               m_file_offset + position);
+
+      if (result == -1 && errno == EINTR)
+        continue;
+
+      if (result == -1)
+        return false;
+
+      if (result == 0)
+        break;
+
+      position += result;
+    }
+
+    m_loaded.insert(first, gap_last);
+    first = gap_last;
+  }
+
+  return true;
+}
+
+// Each dirty range is written with as few calls as possible, so
+// pieces that were downloaded in one go become a single large write.
+bool
+ChunkPart::write_ranges(int               fd,
+                        const char*       buffer,
+                        uint64_t          offset,
+                        ranges<uint32_t>* dirty) {
+  while (!dirty->empty()) {
+    auto range = *dirty->begin();
+
+    while (range.first != range.second) {
+      ssize_t result = ::pwrite(fd,
+                                buffer + range.first,
+                                range.second - range.first,
+                                offset + range.first);
+
+      if (result == -1 && errno == EINTR)
+        continue;
+
+      if (result <= 0) {
+        // Keep the unwritten part dirty, so a later sync retries.
+        dirty->erase(dirty->begin()->first, range.first);
+
+        if (result == 0)
+          errno = ENOSPC;
+
+        return false;
+      }
+
+      range.first += result;
+    }
+
+    dirty->erase(dirty->begin()->first, range.second);
+  }
+
+  return true;
 }
 
 bool
@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#include "data/chunk.h"
+#include "data/chunk_list_node.h"
+#include "data/hash_chunk.h"
+#include "torrent/data/file.h"
+#include "torrent/exceptions.h"
+
+#include "data/disk_scheduler.h"
+
+namespace torrent {
+
+DiskScheduler::location
+DiskScheduler::locate(HashChunk* hash_chunk) {
+  location loc;
+
+  for (auto& part : *hash_chunk->chunk()->chunk()) {
+    if (part.file() == nullptr)
+      continue;
+
+    loc.device = part.file()->device();
+    loc.inode  = part.file()->inode();
+    loc.offset = part.file_offset();
+    break;
+  }
+
+  return loc;
+}
+
+size_t
+DiskScheduler::pending(uint64_t device) const {
+  auto itr = m_devices.find(device);
+
+  return itr != m_devices.end() ? itr->second.queue.size() : 0;
+}
+
+void
+DiskScheduler::set_device_limit(unsigned int limit) {
+  if (limit == 0)
+    throw internal_error("DiskScheduler::set_device_limit(...) limit == 0.");
+
+  m_device_limit = limit;
+}
+
+void
+DiskScheduler::push(HashChunk*      hash_chunk,
+                    const location& loc,
+                    uint32_t        size,
+                    bool            single) {
+  auto itr = m_devices[loc.device].queue.emplace(
+    key_type(loc.inode, loc.offset), request{ hash_chunk, size, single });
+
+  if (!m_queued.emplace(hash_chunk, queued_type(loc.device, itr)).second)
+    throw internal_error("DiskScheduler::push(...) chunk already queued.");
+
+  m_size++;
+}
+
+// Continue from the head in a single direction, wrapping around to
+// the lowest position when passing the last request.
+DiskScheduler::queue_iterator
+DiskScheduler::next_request(device& dev) {
+  auto itr = dev.queue.lower_bound(dev.head);
+
+  // Don't let one large file starve the others.
+  if (itr != dev.queue.end() && itr->first.first == dev.head.first &&
+      dev.head_bytes >= sweep_limit) {
+    auto next = dev.queue.lower_bound(key_type(dev.head.first + 1, 0));
+
+    if (next == dev.queue.end())
+      next = dev.queue.begin();
+
+    if (next->first.first != dev.head.first)
+      itr = next;
+  }
+
+  if (itr == dev.queue.end())
+    itr = dev.queue.begin();
+
+  return itr;
+}
+
+unsigned int
+DiskScheduler::pop(HashChunk** chunks, unsigned int max_count) {
+  if (m_size == 0 || max_count == 0)
+    return 0;
+
+  // Round-robin between the devices, so that each makes progress.
+  auto first = m_devices.lower_bound(m_next_device);
+
+  for (size_t i = 0; i < m_devices.size(); i++, ++first) {
+    if (first == m_devices.end())
+      first = m_devices.begin();
+
+    if (first->second.queue.empty() ||
+        first->second.active >= m_device_limit)
+      continue;
+
+    return pop_from(first, chunks, max_count);
+  }
+
+  return 0;
+}
+
+unsigned int
+DiskScheduler::pop_device(uint64_t     device,
+                          HashChunk**  chunks,
+                          unsigned int max_count) {
+  auto itr = m_devices.find(device);
+
+  if (itr == m_devices.end() || itr->second.queue.empty() ||
+      itr->second.active >= m_device_limit || max_count == 0)
+    return 0;
+
+  return pop_from(itr, chunks, max_count);
+}
+
+unsigned int
+DiskScheduler::pop_from(device_map::iterator first,
+                        HashChunk**          chunks,
+                        unsigned int         max_count) {
+  device&      dev   = first->second;
+  auto         itr   = next_request(dev);
+  uint32_t     size  = itr->second.size;
+  bool         alone = itr->second.single;
+  unsigned int count = 0;
+
+  do {
+    if (itr->first.first != dev.head.first)
+      dev.head_bytes = 0;
+
+    dev.head = key_type(itr->first.first, itr->first.second + size);
+    dev.head_bytes += size;
+
+    chunks[count++] = itr->second.chunk;
+    m_active[itr->second.chunk] = first->first;
+    m_queued.erase(itr->second.chunk);
+
+    itr = dev.queue.erase(itr);
+
+  } while (!alone && count < max_count && itr != dev.queue.end() &&
+           !itr->second.single && itr->second.size == size);
+
+  dev.active++;
+
+  m_size -= count;
+  m_next_device = first->first + 1;
+
+  return count;
+}
+
+void
+DiskScheduler::finished(HashChunk* const* chunks, unsigned int count) {
+  if (count == 0)
+    throw internal_error("DiskScheduler::finished(...) count == 0.");
+
+  auto dev_itr = m_devices.end();
+
+  for (unsigned int i = 0; i < count; i++) {
+    auto itr = m_active.find(chunks[i]);
+
+    if (itr == m_active.end())
+      throw internal_error(
+        "DiskScheduler::finished(...) chunk was not dispatched.");
+
+    dev_itr = m_devices.find(itr->second);
+    m_active.erase(itr);
+  }
+
+  if (dev_itr == m_devices.end() || dev_itr->second.active == 0)
+    throw internal_error("DiskScheduler::finished(...) bad device.");
+
+  dev_itr->second.active--;
+}
+
+bool
+DiskScheduler::remove(HashChunk* hash_chunk) {
+  auto itr = m_queued.find(hash_chunk);
+
+  if (itr == m_queued.end())
+    return false;
+
+  m_devices[itr->second.first].queue.erase(itr->second.second);
+  m_queued.erase(itr);
+  m_size--;
+  return true;
+}
+
+} // namespace torrent
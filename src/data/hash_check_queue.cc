@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
+#include <chrono>
+
 #include "data/hash_check_queue.h"
 #include "data/hash_chunk.h"
 #include "torrent/hash_string.h"
@@ -8,6 +10,181 @@
 
 namespace torrent {
 
+static inline void
+instrumentation_lane_update(HashChunk* hash_chunk, int64_t change) {
+  instrumentation_update(hash_chunk->is_recheck()
+                           ? INSTRUMENTATION_HASHING_RECHECK_QUEUED
+                           : INSTRUMENTATION_HASHING_INTERACTIVE_QUEUED,
+                         change);
+}
+
+// Called when the chunks are taken by a hash thread, all chunks are
+// from the same lane.
+static void
+instrumentation_lane_dispatch([[maybe_unused]] HashChunk* const* chunks,
+                              [[maybe_unused]] unsigned int      count) {
+#ifdef LT_INSTRUMENTATION
+  bool recheck = chunks[0]->is_recheck();
+  auto now     = std::chrono::steady_clock::now();
+
+  int64_t wait = 0;
+
+  for (unsigned int i = 0; i < count; i++)
+    wait += std::chrono::duration_cast<std::chrono::microseconds>(
+              now - chunks[i]->m_queue_time)
+              .count();
+
+  instrumentation_update(recheck ? INSTRUMENTATION_HASHING_RECHECK_QUEUED
+                                 : INSTRUMENTATION_HASHING_INTERACTIVE_QUEUED,
+                         -int64_t(count));
+  instrumentation_update(recheck ? INSTRUMENTATION_HASHING_RECHECK_DISPATCHED
+                                 : INSTRUMENTATION_HASHING_INTERACTIVE_DISPATCHED,
+                         count);
+  instrumentation_update(recheck ? INSTRUMENTATION_HASHING_RECHECK_WAIT
+                                 : INSTRUMENTATION_HASHING_INTERACTIVE_WAIT,
+                         wait);
+#endif
+}
+
+void
+HashCheckQueue::link_back(HashChunk* hash_chunk) {
+  device_lane& lane  = m_lanes[hash_chunk->m_queue_device];
+  owner_queue& queue = lane.owners[hash_chunk->owner()];
+
+  hash_chunk->m_queue_state = HashChunk::queue_pending;
+  hash_chunk->m_queue_prev  = queue.last;
+  hash_chunk->m_queue_next  = nullptr;
+
+  if (queue.last != nullptr)
+    queue.last->m_queue_next = hash_chunk;
+  else
+    queue.first = hash_chunk;
+
+  queue.last    = hash_chunk;
+  m_last_device = hash_chunk->m_queue_device;
+  m_last_owner  = hash_chunk->owner();
+  lane.size++;
+  m_size++;
+}
+
+void
+HashCheckQueue::unlink(HashChunk* hash_chunk) {
+  auto lane_itr = m_lanes.find(hash_chunk->m_queue_device);
+
+  if (lane_itr == m_lanes.end())
+    throw internal_error("HashCheckQueue::unlink(...) device not found.");
+
+  device_lane& lane = lane_itr->second;
+  auto         itr  = lane.owners.find(hash_chunk->owner());
+
+  if (itr == lane.owners.end())
+    throw internal_error("HashCheckQueue::unlink(...) owner not found.");
+
+  owner_queue& queue = itr->second;
+
+  if (hash_chunk->m_queue_prev != nullptr)
+    hash_chunk->m_queue_prev->m_queue_next = hash_chunk->m_queue_next;
+  else
+    queue.first = hash_chunk->m_queue_next;
+
+  if (hash_chunk->m_queue_next != nullptr)
+    hash_chunk->m_queue_next->m_queue_prev = hash_chunk->m_queue_prev;
+  else
+    queue.last = hash_chunk->m_queue_prev;
+
+  hash_chunk->m_queue_state = HashChunk::queue_none;
+  hash_chunk->m_queue_prev  = nullptr;
+  hash_chunk->m_queue_next  = nullptr;
+  lane.size--;
+  m_size--;
+
+  // Owners with nothing queued don't keep their deficit, as in
+  // regular deficit round robin.
+  if (queue.first == nullptr)
+    lane.owners.erase(itr);
+
+  if (lane.owners.empty())
+    m_lanes.erase(lane_itr);
+}
+
+// With 'any_device' the lanes are taken in turn, starting after the
+// device last popped from.
+HashCheckQueue::lane_map::iterator
+HashCheckQueue::next_lane(uint64_t device) {
+  if (device != any_device)
+    return m_lanes.find(device);
+
+  auto itr = m_lanes.lower_bound(m_next_device);
+
+  if (itr == m_lanes.end())
+    itr = m_lanes.begin();
+
+  return itr;
+}
+
+// Stays on the current owner while its deficit covers the next
+// chunk, otherwise moves on to the next owner and grants it a
+// quantum.
+HashCheckQueue::owner_map::iterator
+HashCheckQueue::next_owner(device_lane& lane) {
+  auto itr = lane.owners.lower_bound(lane.current_owner);
+
+  if (itr == lane.owners.end() || itr->first != lane.current_owner) {
+    if (itr == lane.owners.end())
+      itr = lane.owners.begin();
+
+    itr->second.deficit += owner_quantum;
+    lane.current_owner = itr->first;
+  }
+
+  while (itr->second.deficit <
+         itr->second.first->chunk()->chunk()->chunk_size()) {
+    if (++itr == lane.owners.end())
+      itr = lane.owners.begin();
+
+    itr->second.deficit += owner_quantum;
+    lane.current_owner = itr->first;
+  }
+
+  return itr;
+}
+
+HashChunk*
+HashCheckQueue::front() {
+  if (empty())
+    return nullptr;
+
+  return next_owner(next_lane(any_device)->second)->second.first;
+}
+
+HashChunk*
+HashCheckQueue::back() {
+  auto lane_itr = m_lanes.find(m_last_device);
+
+  if (lane_itr == m_lanes.end())
+    return nullptr;
+
+  auto itr = lane_itr->second.owners.find(m_last_owner);
+
+  if (itr == lane_itr->second.owners.end())
+    return nullptr;
+
+  return itr->second.last;
+}
+
+// Invalidates 'lane' if it was the last chunk of the lane.
+HashChunk*
+HashCheckQueue::pop_front(lane_map::iterator lane) {
+  auto       itr        = next_owner(lane->second);
+  HashChunk* hash_chunk = itr->second.first;
+
+  itr->second.deficit -= hash_chunk->chunk()->chunk()->chunk_size();
+  m_next_device = lane->first + 1;
+  unlink(hash_chunk);
+
+  return hash_chunk;
+}
+
 // Always poke thread_disk after calling this.
 void
 HashCheckQueue::push_back(HashChunk* hash_chunk) {
@@ -15,17 +192,46 @@ HashCheckQueue::push_back(HashChunk* hash_chunk) {
       !hash_chunk->chunk()->is_blocking())
     throw internal_error("Invalid hash chunk passed to HashCheckQueue.");
 
-  std::lock_guard lk(m_lock);
+  uint32_t chunk_size = hash_chunk->chunk()->chunk()->chunk_size();
 
-  // Set blocking...(? this needs to be possible to do after getting
-  // the chunk) When doing this make sure we verify that the handle is
-  // not previously blocked.
+  DiskScheduler::location loc = DiskScheduler::locate(hash_chunk);
 
-  base_type::push_back(hash_chunk);
+  {
+    std::lock_guard lk(m_lock);
 
-  int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
+    // Set blocking...(? this needs to be possible to do after getting
+    // the chunk) When doing this make sure we verify that the handle is
+    // not previously blocked.
+
+    if (hash_chunk->m_queue_state != HashChunk::queue_none)
+      throw internal_error(
+        "HashCheckQueue::push_back(...) chunk already queued.");
+
+#ifdef LT_INSTRUMENTATION
+    hash_chunk->m_queue_time = std::chrono::steady_clock::now();
+#endif
+
+    hash_chunk->m_queue_device = loc.device;
+
+    if (hash_chunk->is_recheck()) {
+      hash_chunk->m_queue_state = HashChunk::queue_scheduled;
+      m_scheduler.push(hash_chunk,
+                       loc,
+                       chunk_size,
+                       hash_chunk->read_mode() !=
+                         ChunkManager::recheck_read_mmap);
+    } else {
+      link_back(hash_chunk);
+    }
+  }
+
+  int64_t size = chunk_size;
+  instrumentation_lane_update(hash_chunk, 1);
   instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, 1);
   instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, size);
+
+  if (m_slot_interrupt)
+    m_slot_interrupt(loc.device);
 }
 
 // erase...
@@ -46,52 +252,172 @@ bool
 HashCheckQueue::remove(HashChunk* hash_chunk) {
   std::lock_guard lk(m_lock);
 
-  bool result;
-  auto itr = std::find(begin(), end(), hash_chunk);
+  switch (hash_chunk->m_queue_state) {
+  case HashChunk::queue_pending:
+    unlink(hash_chunk);
+    break;
 
-  if (itr != end()) {
-    base_type::erase(itr);
-    result = true;
+  case HashChunk::queue_scheduled:
+    if (!m_scheduler.remove(hash_chunk))
+      throw internal_error(
+        "HashCheckQueue::remove(...) scheduled chunk not found.");
 
-    int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
-    instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
-    instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
+    hash_chunk->m_queue_state = HashChunk::queue_none;
+    break;
 
-  } else {
-    result = false;
+  default:
+    // Being hashed, or already done.
+    return false;
   }
 
-  return result;
+  int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
+  instrumentation_lane_update(hash_chunk, -1);
+  instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
+  instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
+
+  return true;
+}
+
+size_t
+HashCheckQueue::scheduled_size() {
+  std::lock_guard lk(m_lock);
+  return m_scheduler.size();
+}
+
+size_t
+HashCheckQueue::pending(uint64_t device) {
+  std::lock_guard lk(m_lock);
+
+  auto   itr   = m_lanes.find(device);
+  size_t count = itr != m_lanes.end() ? itr->second.size : 0;
+
+  return count + m_scheduler.pending(device);
+}
+
+unsigned int
+HashCheckQueue::device_limit() {
+  std::lock_guard lk(m_lock);
+  return m_scheduler.device_limit();
+}
+
+void
+HashCheckQueue::set_device_limit(unsigned int limit) {
+  std::lock_guard lk(m_lock);
+  m_scheduler.set_device_limit(limit);
 }
 
+// When the CPU supports wide enough vector instructions, consecutive
+// chunks of the same size are popped together and hashed in one pass
+// by HashChunk::perform_multi.
+//
+// Scheduled rechecks are only dispatched when no other chunks are
+// waiting, and the thread returns if every device is busy as the
+// threads hashing them will continue once done.
+//
+// A device thread passes its device, and only hashes the chunks
+// stored on it.
 void
-HashCheckQueue::perform() {
+HashCheckQueue::perform(uint64_t device) {
+  unsigned int max_batch = Sha1Multi::preferred_lanes();
+
   m_lock.lock();
 
-  while (!empty()) {
-    HashChunk* hash_chunk = base_type::front();
-    base_type::pop_front();
+  while (true) {
+    HashChunk*   batch[Sha1Multi::max_lanes];
+    unsigned int batch_size = 0;
+    uint32_t     chunk_size = 0;
+    bool         scheduled  = next_lane(device) == m_lanes.end();
 
-    if (!hash_chunk->chunk()->is_loaded()) {
-      m_lock.unlock();
-      throw internal_error(
-        "HashCheckQueue::perform(): !entry.node->is_loaded().");
+    if (scheduled) {
+      batch_size = device == any_device
+                     ? m_scheduler.pop(batch, max_batch)
+                     : m_scheduler.pop_device(device, batch, max_batch);
+
+      if (batch_size == 0)
+        break;
+
+      for (unsigned int i = 0; i < batch_size; i++)
+        batch[i]->m_queue_state = HashChunk::queue_none;
+
+      chunk_size = batch[0]->chunk()->chunk()->chunk_size();
+
+      instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT,
+                             -int64_t(batch_size));
+      instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE,
+                             -int64_t(chunk_size) * batch_size);
     }
 
-    int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
-    instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
-    instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
+    while (!scheduled && batch_size < max_batch) {
+      auto lane = next_lane(device);
+
+      if (lane == m_lanes.end())
+        break;
+
+      HashChunk* hash_chunk = next_owner(lane->second)->second.first;
+
+      if (!hash_chunk->chunk()->is_loaded()) {
+        m_lock.unlock();
+        throw internal_error(
+          "HashCheckQueue::perform(): !entry.node->is_loaded().");
+      }
+
+      bool is_read =
+        hash_chunk->read_mode() != ChunkManager::recheck_read_mmap;
+
+      // Chunks read with pread are always hashed alone.
+      if (batch_size == 0)
+        chunk_size = hash_chunk->chunk()->chunk()->chunk_size();
+      else if (is_read ||
+               hash_chunk->chunk()->chunk()->chunk_size() != chunk_size)
+        break;
+
+      batch[batch_size++] = pop_front(lane);
+
+      instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
+      instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE,
+                             -int64_t(chunk_size));
+
+      if (is_read)
+        break;
+    }
+
+    instrumentation_lane_dispatch(batch, batch_size);
 
     m_lock.unlock();
 
-    if (!hash_chunk->perform(~uint32_t(), true))
-      throw internal_error("HashCheckQueue::perform(): "
-                           "!hash_chunk->perform(~uint32_t(), true).");
+    HashString hashes[Sha1Multi::max_lanes];
+
+    if (batch_size == 1) {
+      // Fall back to the mapping if the files could not be read.
+      bool is_read =
+        batch[0]->read_mode() != ChunkManager::recheck_read_mmap &&
+        batch[0]->perform_read();
+
+      if (!is_read && !batch[0]->perform(~uint32_t(), true))
+        throw internal_error("HashCheckQueue::perform(): "
+                             "!hash_chunk->perform(~uint32_t(), true).");
+
+      batch[0]->hash_c(hashes[0].data());
+
+    } else {
+      char* buffers[Sha1Multi::max_lanes];
+
+      for (unsigned int i = 0; i < batch_size; i++)
+        buffers[i] = hashes[i].data();
+
+      HashChunk::perform_multi(batch, batch_size, buffers);
+    }
+
+    // Release the device before the chunks are passed on, as the
+    // owner may delete them.
+    if (scheduled) {
+      std::lock_guard lk(m_lock);
+      m_scheduler.finished(batch, batch_size);
+    }
 
-    HashString hash;
-    hash_chunk->hash_c(hash.data());
+    for (unsigned int i = 0; i < batch_size; i++)
+      m_slot_chunk_done(batch[i], hashes[i]);
 
-    m_slot_chunk_done(hash_chunk, hash);
     m_lock.lock();
   }
 
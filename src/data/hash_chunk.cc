@@ -1,13 +1,43 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
+#include <cstdlib>
+#include <fcntl.h>
+#include <memory>
+#include <unistd.h>
+
 #include "data/chunk.h"
 #include "data/chunk_list_node.h"
+#include "torrent/buildinfo.h"
+#include "torrent/data/file.h"
 
 #include "data/hash_chunk.h"
 
 namespace torrent {
 
+// Each hash thread reuses one aligned buffer for reading chunks. The
+// alignment and size satisfy O_DIRECT, and reads are large enough for
+// the kernel's readahead to keep the device streaming.
+static constexpr uint32_t hash_read_buffer_size = 1 << 20;
+static constexpr uint32_t hash_read_alignment   = 4096;
+
+static char*
+hash_read_buffer() {
+  static thread_local std::unique_ptr<char, decltype(&std::free)> buffer(
+    nullptr, &std::free);
+
+  if (buffer == nullptr) {
+    void* ptr = nullptr;
+
+    if (posix_memalign(&ptr, hash_read_alignment, hash_read_buffer_size) != 0)
+      return nullptr;
+
+    buffer.reset(static_cast<char*>(ptr));
+  }
+
+  return buffer.get();
+}
+
 bool
 HashChunk::perform(uint32_t length, bool force) {
   length = std::min(length, remaining());
@@ -29,6 +59,169 @@ HashChunk::perform(uint32_t length, bool force) {
   return complete;
 }
 
+void
+HashChunk::perform_multi(HashChunk* const* chunks,
+                         unsigned int      count,
+                         char* const*      hashes) {
+  if (count == 0 || count > Sha1Multi::max_lanes)
+    throw internal_error(
+      "HashChunk::perform_multi(...) received an invalid chunk count");
+
+  uint32_t size = chunks[0]->remaining();
+
+  for (unsigned int i = 0; i < count; i++)
+    if (chunks[i]->m_position != 0 || chunks[i]->remaining() != size)
+      throw internal_error(
+        "HashChunk::perform_multi(...) received chunks of unequal size");
+
+  Sha1Multi hash;
+  hash.init(count);
+
+  uint32_t position = 0;
+
+  // The chunk parts may be split at different positions, so each
+  // update covers the largest range contiguous in all chunks.
+  while (position != size) {
+    const void* data[Sha1Multi::max_lanes];
+    uint32_t    length = size - position;
+
+    for (unsigned int i = 0; i < count; i++) {
+      auto itr = chunks[i]->m_chunk.chunk()->at_position(position);
+
+      length  = std::min(length, chunks[i]->remaining_part(itr, position));
+      data[i] = itr->chunk().begin() + position - itr->position();
+    }
+
+    hash.update(data, length);
+    position += length;
+  }
+
+  for (unsigned int i = 0; i < count; i++)
+    chunks[i]->m_position = size;
+
+  hash.final_c(hashes);
+}
+
+void
+HashChunk::set_read_mode(uint32_t mode) {
+  if (!m_chunk.is_loaded() || m_position != 0)
+    throw internal_error(
+      "HashChunk::set_read_mode(...) called on an invalid or started chunk");
+
+  m_read_mode = mode;
+  m_extents.clear();
+
+  if (mode == ChunkManager::recheck_read_mmap)
+    return;
+
+  for (auto& part : *m_chunk.chunk()) {
+    if (part.size() == 0)
+      continue;
+
+    // Buffered parts may hold data not yet written to the file.
+    if (part.file() == nullptr || !part.is_file_mapping()) {
+      m_read_mode = ChunkManager::recheck_read_mmap;
+      m_extents.clear();
+      return;
+    }
+
+    m_extents.push_back(read_extent{ part.file()->frozen_path(),
+                                     part.file_offset(),
+                                     part.position(),
+                                     part.size() });
+  }
+}
+
+bool
+HashChunk::perform_read() {
+  if (m_read_mode == ChunkManager::recheck_read_mmap || m_position != 0)
+    throw internal_error(
+      "HashChunk::perform_read() called on an invalid or started chunk");
+
+  char* buffer = hash_read_buffer();
+
+  if (buffer == nullptr)
+    return false;
+
+  for (const auto& extent : m_extents) {
+    if (!perform_read_extent(extent, buffer)) {
+      m_hash.init();
+      return false;
+    }
+  }
+
+  m_position = m_chunk.chunk()->chunk_size();
+  return true;
+}
+
+// Reads are aligned to the page size so the same loop works with
+// O_DIRECT, the bytes outside the extent are skipped when hashing.
+// Pages that were not cached before the read are dropped afterwards.
+bool
+HashChunk::perform_read_extent(const read_extent& extent, char* buffer) {
+  int  fd        = -1;
+  bool is_direct = false;
+
+#ifdef O_DIRECT
+  if (m_read_mode == ChunkManager::recheck_read_direct) {
+    fd        = ::open(extent.path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+    is_direct = fd != -1;
+  }
+#endif
+
+  // Not all file systems support O_DIRECT, fall back to buffered reads.
+  if (fd == -1)
+    fd = ::open(extent.path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd == -1)
+    return false;
+
+  bool was_incore =
+    !is_direct &&
+    m_chunk.chunk()->is_incore(extent.position, extent.length);
+
+#ifdef LT_USE_POSIX_FADVISE
+  if (!is_direct)
+    posix_fadvise(fd, extent.offset, extent.length, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  uint64_t first    = extent.offset - extent.offset % hash_read_alignment;
+  uint64_t last     = extent.offset + extent.length;
+  uint64_t position = first;
+
+  while (position < last) {
+    uint64_t length = last - position;
+
+    length += (hash_read_alignment - length % hash_read_alignment) %
+              hash_read_alignment;
+    length = std::min<uint64_t>(length, hash_read_buffer_size);
+
+    ssize_t result = ::pread(fd, buffer, length, position);
+
+    if (result <= 0)
+      break;
+
+    uint64_t data_first = std::max(position, extent.offset);
+    uint64_t data_last  = std::min(position + result, last);
+
+    if (data_last > data_first)
+      m_hash.update(buffer + (data_first - position), data_last - data_first);
+
+    position += result;
+  }
+
+#ifdef LT_USE_POSIX_FADVISE
+  if (!was_incore)
+    posix_fadvise(fd, extent.offset, extent.length, POSIX_FADV_DONTNEED);
+#else
+  (void)was_incore;
+#endif
+
+  ::close(fd);
+
+  return position >= last;
+}
+
 void
 HashChunk::advise_willneed(uint32_t length) {
   if (!m_chunk.is_valid())
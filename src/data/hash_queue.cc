@@ -65,18 +65,43 @@ HashQueue::HashQueue(thread_disk* thread)
 void
 HashQueue::push_back(ChunkHandle            handle,
                      HashQueueNode::id_type id,
-                     slot_done_type         d) {
+                     slot_done_type         d,
+                     uint32_t               read_mode,
+                     bool                   recheck) {
   LT_LOG_DATA(id, DEBUG, "Adding index:%" PRIu32 " to queue.", handle.index());
 
   if (!handle.is_loaded())
     throw internal_error("HashQueue::add(...) received an invalid chunk");
 
   auto hash_chunk = new HashChunk(handle);
+  hash_chunk->set_read_mode(read_mode);
+  hash_chunk->set_recheck(recheck);
+  hash_chunk->set_owner(id);
 
-  base_type::push_back(HashQueueNode(id, hash_chunk, std::move(d)));
+  hash_chunk->m_node =
+    base_type::insert(end(), HashQueueNode(id, hash_chunk, std::move(d)));
 
   m_thread_disk->hash_queue()->push_back(hash_chunk);
-  m_thread_disk->interrupt();
+  m_thread_disk->interrupt_hash();
+}
+
+void
+HashQueue::push_back_hashed(ChunkHandle            handle,
+                            HashQueueNode::id_type id,
+                            const HashString&      hash,
+                            slot_done_type         d) {
+  LT_LOG_DATA(
+    id, DEBUG, "Adding hashed index:%" PRIu32 " to queue.", handle.index());
+
+  if (!handle.is_loaded())
+    throw internal_error("HashQueue::add(...) received an invalid chunk");
+
+  auto hash_chunk = new HashChunk(handle);
+
+  hash_chunk->m_node =
+    base_type::insert(end(), HashQueueNode(id, hash_chunk, std::move(d)));
+
+  chunk_done(hash_chunk, hash);
 }
 
 bool
@@ -92,48 +117,53 @@ HashQueue::has(HashQueueNode::id_type id, uint32_t index) {
 
 void
 HashQueue::remove(HashQueueNode::id_type id) {
-  erase(std::remove_if(
-          begin(),
-          end(),
-          [id, this](HashQueueNode& node) {
-            if (node.id() != id) {
-              return false;
-            }
-
-            HashChunk* hash_chunk = node.get_chunk();
-
-            LT_LOG_DATA(id,
-                        DEBUG,
-                        "Removing index:%" PRIu32 " from queue.",
-                        hash_chunk->handle().index());
-
-            thread_base::release_global_lock();
-            bool result = m_thread_disk->hash_queue()->remove(hash_chunk);
-            thread_base::acquire_global_lock();
-
-            // The hash chunk was not found, so we need to wait until the hash
-            // check finishes.
-            if (!result) {
-              m_done_chunks_lock.lock();
-              done_chunks_type::iterator done_itr;
-
-              while ((done_itr = m_done_chunks.find(hash_chunk)) ==
-                     m_done_chunks.end()) {
-                m_done_chunks_lock.unlock();
-                std::this_thread::sleep_for(std::chrono::microseconds(100));
-                m_done_chunks_lock.lock();
-              }
-
-              m_done_chunks.erase(done_itr);
-              m_done_chunks_lock.unlock();
-            }
-
-            node.slot_done()(*hash_chunk->chunk(), nullptr);
-            node.clear();
-
-            return true;
-          }),
-        end());
+  for (auto& node : *this) {
+    if (node.id() != id)
+      continue;
+
+    HashChunk* hash_chunk = node.get_chunk();
+
+    LT_LOG_DATA(id,
+                DEBUG,
+                "Removing index:%" PRIu32 " from queue.",
+                hash_chunk->handle().index());
+
+    thread_base::release_global_lock();
+    bool result = m_thread_disk->hash_queue()->remove(hash_chunk);
+    thread_base::acquire_global_lock();
+
+    // The hash chunk was not found, so we need to wait until the hash
+    // check finishes.
+    if (!result) {
+      receive_done();
+
+      while (!hash_chunk->m_done) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        receive_done();
+      }
+    }
+  }
+
+  m_done_chunks.erase(std::remove_if(m_done_chunks.begin(),
+                                     m_done_chunks.end(),
+                                     [id](HashChunk* hash_chunk) {
+                                       return hash_chunk->m_node->id() == id;
+                                     }),
+                      m_done_chunks.end());
+
+  remove_if([id](HashQueueNode& node) {
+    if (node.id() != id)
+      return false;
+
+    node.slot_done()(*node.get_chunk()->chunk(), nullptr);
+    node.clear();
+    return true;
+  });
+
+  // Chunks of other downloads may have been received while waiting,
+  // make sure they get passed on.
+  if (!m_done_chunks.empty())
+    m_slot_has_work(false);
 }
 
 void
@@ -149,45 +179,51 @@ HashQueue::clear() {
 
 void
 HashQueue::work() {
-  std::lock_guard lk(m_done_chunks_lock);
+  receive_done();
 
   while (!m_done_chunks.empty()) {
-    HashChunk* hash_chunk = m_done_chunks.begin()->first;
-    HashString hash_value = m_done_chunks.begin()->second;
-    m_done_chunks.erase(m_done_chunks.begin());
+    HashChunk* hash_chunk = m_done_chunks.front();
+    auto       itr        = hash_chunk->m_node;
 
-    // TODO: This is not optimal as we jump around... Check for front
-    // of HashQueue in done_chunks instead.
-
-    auto itr =
-      std::find_if(begin(), end(), [hash_chunk](torrent::HashQueueNode n) {
-        return hash_chunk == n.get_chunk();
-      });
-
-    // TODO: Fix this...
-    if (itr == end())
-      throw internal_error("Could not find done chunk's node.");
+    m_done_chunks.pop_front();
 
     LT_LOG_DATA(itr->id(),
                 DEBUG,
                 "Passing index:%" PRIu32 " to owner: %s.",
                 hash_chunk->handle().index(),
-                hash_string_to_hex_str(hash_value).c_str());
+                hash_string_to_hex_str(hash_chunk->m_done_hash).c_str());
 
     HashQueueNode::slot_done_type slotDone = itr->slot_done();
     base_type::erase(itr);
 
-    slotDone(hash_chunk->handle(), hash_value.c_str());
+    slotDone(hash_chunk->handle(), hash_chunk->m_done_hash.c_str());
     delete hash_chunk;
   }
 }
 
+void
+HashQueue::receive_done() {
+  HashChunk* hash_chunk = m_done_queue.pop_all();
+
+  while (hash_chunk != nullptr) {
+    HashChunk* next = hash_chunk->m_done_next;
+
+    hash_chunk->m_done_next = nullptr;
+    hash_chunk->m_done      = true;
+    m_done_chunks.push_back(hash_chunk);
+
+    hash_chunk = next;
+  }
+}
+
+// The main thread only needs to be signaled when the queue was empty,
+// otherwise a signal is already pending.
 void
 HashQueue::chunk_done(HashChunk* hash_chunk, const HashString& hash_value) {
-  std::lock_guard lk(m_done_chunks_lock);
+  hash_chunk->m_done_hash = hash_value;
 
-  m_done_chunks[hash_chunk] = hash_value;
-  m_slot_has_work(m_done_chunks.empty());
+  if (m_done_queue.push(hash_chunk))
+    m_slot_has_work(false);
 }
 
 } // namespace torrent
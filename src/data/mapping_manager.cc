@@ -0,0 +1,221 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#include <algorithm>
+#include <sys/mman.h>
+
+#include "data/mapping_manager.h"
+#include "data/socket_file.h"
+#include "torrent/data/file.h"
+#include "torrent/exceptions.h"
+#include "utils/instrumentation.h"
+
+namespace torrent {
+
+MappingManager::~MappingManager() {
+  if (m_unused.size() != m_addresses.size())
+    destruct_error(
+      "MappingManager::~MappingManager() windows still referenced.");
+
+  evict(0);
+}
+
+void
+MappingManager::set_window_size(uint64_t size) {
+  if (size % MemoryChunk::page_size() != 0)
+    throw input_error(
+      "Mapping window size must be a multiple of the page size.");
+
+  m_window_size = size;
+
+  // Windows of the old size no longer match any lookups.
+  evict(0);
+}
+
+void
+MappingManager::set_address_budget(uint64_t budget) {
+  m_address_budget = budget;
+  evict(budget);
+}
+
+MemoryChunk
+MappingManager::create_chunk(File*    file,
+                             uint64_t offset,
+                             uint32_t length,
+                             int      prot) {
+  if (m_window_size == 0 || m_window_size > m_address_budget)
+    return MemoryChunk();
+
+  uint64_t window_offset = offset - offset % m_window_size;
+
+  if (offset + length > window_offset + m_window_size) {
+    instrumentation_update(INSTRUMENTATION_MAPPING_FALLBACK, 1);
+    return MemoryChunk();
+  }
+
+  bool writable = prot & MemoryChunk::prot_write;
+  auto itr      = m_index.find(key_type(file, window_offset, writable));
+
+  window* w = nullptr;
+
+  if (itr != m_index.end()) {
+    w = itr->second;
+
+    // The file has grown since the window was mapped.
+    if (offset + length > window_offset + w->length) {
+      if (w->refs != 0) {
+        instrumentation_update(INSTRUMENTATION_MAPPING_FALLBACK, 1);
+        return MemoryChunk();
+      }
+
+      unmap_window(w);
+      w = nullptr;
+    }
+  }
+
+  if (w == nullptr) {
+    w = map_window(file, window_offset, writable);
+
+    if (w == nullptr) {
+      instrumentation_update(INSTRUMENTATION_MAPPING_FALLBACK, 1);
+      return MemoryChunk();
+    }
+
+    // Beyond the end of the file, let the caller fail the same way it
+    // would have without windows.
+    if (offset + length > window_offset + w->length)
+      return MemoryChunk();
+
+  } else {
+    instrumentation_update(INSTRUMENTATION_MAPPING_HIT, 1);
+  }
+
+  if (w->refs++ == 0)
+    m_unused.erase(w->unused_itr);
+
+  uint64_t position = offset - window_offset;
+  char*    begin    = w->ptr + position;
+  char*    ptr      = w->ptr + (position - position % MemoryChunk::page_size());
+
+  return MemoryChunk(ptr,
+                     begin,
+                     begin + length,
+                     writable ? MemoryChunk::prot_read | MemoryChunk::prot_write
+                              : MemoryChunk::prot_read,
+                     MemoryChunk::map_shared);
+}
+
+void
+MappingManager::release(const MemoryChunk& chunk) {
+  auto itr = m_addresses.upper_bound(chunk.ptr());
+
+  if (itr == m_addresses.begin())
+    throw internal_error("MappingManager::release(...) window not found.");
+
+  window* w = (--itr)->second;
+
+  if (chunk.ptr() >= w->ptr + w->length || w->refs == 0)
+    throw internal_error("MappingManager::release(...) window not found.");
+
+  if (--w->refs != 0)
+    return;
+
+  if (!w->indexed) {
+    unmap_window(w);
+    return;
+  }
+
+  m_unused.push_front(w);
+  w->unused_itr = m_unused.begin();
+}
+
+void
+MappingManager::erase(File* file) {
+  auto first = m_index.lower_bound(key_type(file, 0, false));
+
+  while (first != m_index.end() && std::get<0>(first->first) == file) {
+    window* w = (first++)->second;
+
+    if (w->refs == 0) {
+      unmap_window(w);
+      continue;
+    }
+
+    m_index.erase(w->index_itr);
+    w->indexed = false;
+  }
+}
+
+void
+MappingManager::evict(uint64_t budget) {
+  while (m_usage > budget && !m_unused.empty())
+    unmap_window(m_unused.back());
+}
+
+// Unreferenced windows are evicted to make room, and the new window
+// starts out in the unused list.
+MappingManager::window*
+MappingManager::map_window(File* file, uint64_t offset, bool writable) {
+  uint64_t file_size = SocketFile(file->file_descriptor()).size();
+
+  if (offset >= file_size)
+    return nullptr;
+
+  uint64_t length = std::min(m_window_size, file_size - offset);
+
+  if (m_usage + length > m_address_budget)
+    evict(m_address_budget - length);
+
+  if (m_usage + length > m_address_budget)
+    return nullptr;
+
+  int   prot = writable ? MemoryChunk::prot_read | MemoryChunk::prot_write
+                        : MemoryChunk::prot_read;
+  char* ptr  = static_cast<char*>(
+    mmap(nullptr, length, prot, MAP_SHARED, file->file_descriptor(), offset));
+
+  if (ptr == MAP_FAILED)
+    return nullptr;
+
+#ifdef MADV_HUGEPAGE
+  if (m_hugepages)
+    madvise(ptr, length, MADV_HUGEPAGE);
+#endif
+
+  auto w = new window{ ptr, length };
+
+  w->index_itr = m_index.emplace(key_type(file, offset, writable), w).first;
+  m_addresses.emplace(ptr, w);
+  m_unused.push_front(w);
+  w->unused_itr = m_unused.begin();
+  m_usage += length;
+
+  instrumentation_update(INSTRUMENTATION_MAPPING_MAPPED, 1);
+  instrumentation_update(INSTRUMENTATION_MAPPING_USAGE, length);
+
+  return w;
+}
+
+void
+MappingManager::unmap_window(window* w) {
+  if (w->refs != 0)
+    throw internal_error(
+      "MappingManager::unmap_window(...) window referenced.");
+
+  if (w->indexed) {
+    m_index.erase(w->index_itr);
+    m_unused.erase(w->unused_itr);
+  }
+
+  if (munmap(w->ptr, w->length) != 0)
+    throw internal_error("MappingManager::unmap_window(...) munmap failed.");
+
+  m_addresses.erase(w->ptr);
+  m_usage -= w->length;
+
+  instrumentation_update(INSTRUMENTATION_MAPPING_USAGE, -int64_t(w->length));
+
+  delete w;
+}
+
+} // namespace torrent
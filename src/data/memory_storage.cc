@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#include <cerrno>
+#include <sys/mman.h>
+
+#include "data/memory_storage.h"
+#include "torrent/data/file.h"
+
+namespace torrent {
+
+MemoryStorage::~MemoryStorage() {
+  for (auto& entry : m_buffers)
+    munmap(entry.second.ptr, entry.second.size);
+}
+
+MemoryChunk
+MemoryStorage::create_chunk(File*                   file,
+                            uint64_t                offset,
+                            uint32_t                length,
+                            int                     prot,
+                            ChunkPart::mapped_type* mapped) {
+  auto itr = m_buffers.find(file);
+
+  if (itr == m_buffers.end()) {
+    // The pages are only backed by memory once written to.
+    void* ptr = mmap(nullptr,
+                     file->size_bytes(),
+                     MemoryChunk::prot_read | MemoryChunk::prot_write,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                     -1,
+                     0);
+
+    if (ptr == MAP_FAILED)
+      return MemoryChunk();
+
+    buffer b{ static_cast<char*>(ptr), file->size_bytes() };
+    itr = m_buffers.emplace(file, b).first;
+  }
+
+  if (length == 0 || offset + length > itr->second.size) {
+    errno = EINVAL;
+    return MemoryChunk();
+  }
+
+  char* begin = itr->second.ptr + offset;
+  char* ptr   = itr->second.ptr + (offset - offset % MemoryChunk::page_size());
+
+  *mapped = ChunkPart::MAPPED_STATIC;
+  return MemoryChunk(ptr, begin, begin + length, prot, 0);
+}
+
+void
+MemoryStorage::erase_file(File* file) {
+  auto itr = m_buffers.find(file);
+
+  if (itr == m_buffers.end())
+    return;
+
+  munmap(itr->second.ptr, itr->second.size);
+  m_buffers.erase(itr);
+}
+
+} // namespace torrent
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#include "data/mapping_manager.h"
+#include "data/mmap_storage.h"
+#include "data/socket_file.h"
+#include "manager.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/data/file.h"
+#include "torrent/data/file_manager.h"
+
+namespace torrent {
+
+MemoryChunk
+MmapStorage::create_chunk(File*                   file,
+                          uint64_t                offset,
+                          uint32_t                length,
+                          int                     prot,
+                          ChunkPart::mapped_type* mapped) {
+  if (!file->prepare(prot))
+    return MemoryChunk();
+
+  SocketFile fd(file->file_descriptor());
+
+  if ((prot & MemoryChunk::prot_write) &&
+      manager->chunk_manager()->write_mode() == ChunkManager::write_buffered) {
+    *mapped = ChunkPart::MAPPED_BUFFER;
+    return fd.create_buffer(offset, length);
+  }
+
+  MemoryChunk mc = manager->chunk_manager()->mapping_manager()->create_chunk(
+    file, offset, length, prot);
+
+  if (mc.is_valid()) {
+    *mapped = ChunkPart::MAPPED_WINDOW;
+    return mc;
+  }
+
+  *mapped = ChunkPart::MAPPED_MMAP;
+  return fd.create_chunk(offset, length, prot, MemoryChunk::map_shared);
+}
+
+void
+MmapStorage::close_file(File* file) {
+  manager->file_manager()->close(file);
+  manager->chunk_manager()->mapping_manager()->erase(file);
+}
+
+} // namespace torrent
@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "data/chunk_list.h"
+#include "data/memory_chunk.h"
+#include "data/prefetch_queue.h"
+#include "globals.h"
+#include "torrent/data/file.h"
+#include "torrent/data/file_list.h"
+
+namespace torrent {
+
+PrefetchQueue::~PrefetchQueue() {
+  for (auto& device : m_pending)
+    for (auto& j : device.second)
+      ::close(j.fd);
+}
+
+size_t
+PrefetchQueue::size() {
+  std::lock_guard lk(m_lock);
+  return m_size;
+}
+
+size_t
+PrefetchQueue::pending(uint64_t device) {
+  std::lock_guard lk(m_lock);
+
+  auto itr = m_pending.find(device);
+  return itr != m_pending.end() ? itr->second.size() : 0;
+}
+
+bool
+PrefetchQueue::push_back(const void* owner,
+                         FileList*   file_list,
+                         uint64_t    position,
+                         uint32_t    length) {
+  auto itr    = file_list_contains_position(file_list, position);
+  bool failed = false;
+
+  for (; length != 0 && itr != file_list->end(); ++itr) {
+    File* file = *itr;
+
+    if (file->size_bytes() == 0)
+      continue;
+
+    uint64_t offset = position - file->offset();
+    uint32_t size   = std::min<uint64_t>(length, file->size_bytes() - offset);
+
+    uint64_t file_position = position;
+
+    position += size;
+    length -= size;
+
+    // Skip the start of the range that a pending job already covers,
+    // which is all of it for repeated requests.
+    {
+      std::lock_guard lk(m_lock);
+
+      auto pending = m_pending.find(file->device());
+
+      if (pending != m_pending.end()) {
+        for (const auto& j : pending->second) {
+          if (j.file_list != file_list || file_position < j.position ||
+              file_position >= j.position + j.length)
+            continue;
+
+          uint32_t covered = std::min<uint64_t>(
+            size, j.position + j.length - file_position);
+
+          file_position += covered;
+          offset += covered;
+          size -= covered;
+        }
+      }
+    }
+
+    if (size == 0)
+      continue;
+
+    int fd = -1;
+
+    if (file->prepare(MemoryChunk::prot_read))
+      fd = ::dup(file->file_descriptor());
+
+    if (fd == -1) {
+      failed = true;
+      continue;
+    }
+
+    std::unique_lock lk(m_lock);
+
+    if (m_size >= max_pending) {
+      lk.unlock();
+      ::close(fd);
+      return false;
+    }
+
+    m_pending[file->device()].push_back(
+      job{ fd, owner, file_list, file_position, offset, size });
+    m_size++;
+
+    lk.unlock();
+
+    if (m_slot_interrupt)
+      m_slot_interrupt(file->device());
+  }
+
+  return !failed;
+}
+
+uint64_t
+PrefetchQueue::push_pieces(const void*             owner,
+                           ChunkList*              chunk_list,
+                           FileList*               file_list,
+                           const Piece&            current,
+                           const std::list<Piece>& upcoming,
+                           uint64_t                budget) {
+  uint64_t queued     = 0;
+  uint32_t last_index = Piece::invalid_index;
+
+  auto prefetch = [&](const Piece& piece) {
+    if (piece.index() == last_index || piece.index() >= chunk_list->size())
+      return;
+
+    last_index = piece.index();
+
+    ChunkListNode* node = &(*chunk_list)[piece.index()];
+
+    if (node->time_preloaded() >= cachedTime - utils::timer::from_seconds(60))
+      return;
+
+    uint32_t chunk_size = file_list->chunk_index_size(piece.index());
+
+    if (piece.offset() >= chunk_size)
+      return;
+
+    uint32_t length =
+      std::min<uint64_t>(chunk_size - piece.offset(), budget - queued);
+    uint64_t position =
+      uint64_t(piece.index()) * file_list->chunk_size() + piece.offset();
+
+    if (!push_back(owner, file_list, position, length))
+      return;
+
+    // Only whole tails are remembered, so a partial prefetch is
+    // continued by the next call.
+    if (length == chunk_size - piece.offset())
+      node->set_time_preloaded(cachedTime);
+
+    queued += length;
+  };
+
+  prefetch(current);
+
+  for (const auto& piece : upcoming) {
+    if (queued == budget)
+      break;
+
+    prefetch(piece);
+  }
+
+  return queued;
+}
+
+size_t
+PrefetchQueue::erase(const void* owner, uint64_t position, uint64_t length) {
+  std::lock_guard lk(m_lock);
+
+  size_t erased = 0;
+
+  for (auto itr = m_pending.begin(); itr != m_pending.end();) {
+    auto last = std::remove_if(
+      itr->second.begin(), itr->second.end(), [&](const job& j) {
+        if (j.owner != owner || j.position + j.length <= position ||
+            position + length <= j.position)
+          return false;
+
+        ::close(j.fd);
+        return true;
+      });
+
+    erased += std::distance(last, itr->second.end());
+    itr->second.erase(last, itr->second.end());
+
+    if (itr->second.empty())
+      itr = m_pending.erase(itr);
+    else
+      ++itr;
+  }
+
+  m_size -= erased;
+  return erased;
+}
+
+void
+PrefetchQueue::perform(uint64_t device, device_stats* stats) {
+  while (true) {
+    job j;
+
+    {
+      std::lock_guard lk(m_lock);
+
+      auto itr = m_pending.find(device);
+
+      if (itr == m_pending.end())
+        return;
+
+      j = itr->second.front();
+      itr->second.pop_front();
+      m_size--;
+
+      if (itr->second.empty())
+        m_pending.erase(itr);
+    }
+
+    auto start = device_stats::clock_type::now();
+
+#ifdef POSIX_FADV_WILLNEED
+    ::posix_fadvise(j.fd, j.offset, j.length, POSIX_FADV_WILLNEED);
+#endif
+
+    ::close(j.fd);
+
+    device_stats::update(stats, j.length, start);
+  }
+}
+
+} // namespace torrent
@@ -3,6 +3,7 @@
 
 #include "torrent/buildinfo.h"
 
+#include <cerrno>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -116,6 +117,35 @@ SocketFile::set_size(uint64_t size, int flags) const {
   return false;
 }
 
+bool
+SocketFile::punch_hole(uint64_t offset, uint64_t length) const {
+  if (!is_open())
+    throw internal_error("SocketFile::punch_hole() called on a closed file");
+
+  if (length == 0)
+    return true;
+
+#ifdef LT_HAVE_FALLOCATE
+  if (fallocate(m_fd,
+                FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                offset,
+                length) == 0)
+    return true;
+
+  if (errno != EOPNOTSUPP && errno != ENOSYS)
+    return false;
+#endif
+
+  uint64_t file_size = size();
+
+  if (offset + length < file_size) {
+    errno = EOPNOTSUPP;
+    return false;
+  }
+
+  return ftruncate(m_fd, offset) == 0 && ftruncate(m_fd, file_size) == 0;
+}
+
 MemoryChunk
 SocketFile::create_chunk(uint64_t offset,
                          uint32_t length,
@@ -140,4 +170,22 @@ SocketFile::create_chunk(uint64_t offset,
   return MemoryChunk(ptr, ptr + align, ptr + align + length, prot, flags);
 }
 
+MemoryChunk
+SocketFile::create_buffer(uint64_t offset, uint32_t length) const {
+  if (!is_open())
+    throw internal_error("SocketFile::create_buffer() called on a closed file");
+
+  if (length == 0 || offset > size() || offset + length > size())
+    return MemoryChunk();
+
+  int   prot = MemoryChunk::prot_read | MemoryChunk::prot_write;
+  char* ptr =
+    (char*)mmap(nullptr, length, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (ptr == MAP_FAILED)
+    return MemoryChunk();
+
+  return MemoryChunk(ptr, ptr, ptr + length, prot, MAP_PRIVATE | MAP_ANONYMOUS);
+}
+
 } // namespace torrent
@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#include <cerrno>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <unistd.h>
+
+#include "data/chunk.h"
+#include "data/sync_queue.h"
+#include "torrent/data/file.h"
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+SyncQueue::~SyncQueue() {
+  for (auto& device : m_pending) {
+    for (auto j : device.second) {
+      for (auto& part : j->parts)
+        if (part.fd != -1)
+          ::close(part.fd);
+
+      delete j;
+    }
+  }
+
+  for (job* j = m_done_queue.pop_all(); j != nullptr;)
+    delete std::exchange(j, j->m_done_next);
+}
+
+bool
+SyncQueue::push_back(Chunk* chunk, int flags, slot_result slot) {
+  auto j = std::make_unique<job>();
+
+  j->flags = flags;
+  j->slot  = std::move(slot);
+
+  for (auto& part : *chunk) {
+    if (part.mapped() == ChunkPart::MAPPED_STATIC)
+      continue;
+
+    if (j->parts.empty() && part.file() != nullptr)
+      j->device = part.file()->device();
+
+    sync_part sp{ &part, part.chunk(), -1, part.file_offset(), {} };
+
+    if (part.mapped() == ChunkPart::MAPPED_BUFFER) {
+      if (!part.is_dirty() && !(flags & MemoryChunk::sync_sync))
+        continue;
+
+      if (part.file() == nullptr)
+        throw internal_error("SyncQueue::push_back(...) buffer has no file.");
+
+      if (part.file()->prepare(MemoryChunk::prot_read |
+                               MemoryChunk::prot_write))
+        sp.fd = ::dup(part.file()->file_descriptor());
+
+      if (sp.fd == -1) {
+        for (auto& prepared : j->parts)
+          if (prepared.fd != -1)
+            ::close(prepared.fd);
+
+        return false;
+      }
+    }
+
+    j->parts.push_back(std::move(sp));
+  }
+
+  // Only take the dirty ranges once nothing can fail, they are put
+  // back by 'work' if the job could not write them.
+  for (auto& sp : j->parts)
+    if (sp.fd != -1)
+      sp.dirty = sp.part->take_dirty();
+
+  uint64_t device = j->device;
+
+  m_size++;
+
+  {
+    std::lock_guard lk(m_lock);
+    m_pending[device].push_back(j.release());
+  }
+
+  if (m_slot_interrupt)
+    m_slot_interrupt(device);
+
+  return true;
+}
+
+size_t
+SyncQueue::pending(uint64_t device) {
+  std::lock_guard lk(m_lock);
+
+  auto itr = m_pending.find(device);
+  return itr != m_pending.end() ? itr->second.size() : 0;
+}
+
+uint64_t
+SyncQueue::perform_job(job* j) {
+  uint64_t bytes = 0;
+
+  for (auto& sp : j->parts) {
+    bytes += sp.memory.size();
+
+    bool result;
+
+    if (sp.fd == -1) {
+      result = sp.memory.sync(0, sp.memory.size(), j->flags);
+    } else {
+      result = ChunkPart::write_ranges(
+        sp.fd, sp.memory.begin(), sp.offset, &sp.dirty);
+
+      if (result && (j->flags & MemoryChunk::sync_sync))
+        result = ::fdatasync(sp.fd) == 0;
+    }
+
+    if (!result && j->error == 0)
+      j->error = errno != 0 ? errno : EIO;
+  }
+
+  return bytes;
+}
+
+void
+SyncQueue::perform(uint64_t device, device_stats* stats) {
+  while (true) {
+    job* j;
+
+    {
+      std::lock_guard lk(m_lock);
+
+      auto itr = m_pending.find(device);
+
+      if (itr == m_pending.end())
+        return;
+
+      j = itr->second.front();
+      itr->second.pop_front();
+
+      if (itr->second.empty())
+        m_pending.erase(itr);
+    }
+
+    auto start = device_stats::clock_type::now();
+
+    device_stats::update(stats, perform_job(j), start);
+
+    if (m_done_queue.push(j) && m_slot_has_work)
+      m_slot_has_work();
+  }
+}
+
+void
+SyncQueue::perform_all() {
+  while (true) {
+    uint64_t device;
+
+    {
+      std::lock_guard lk(m_lock);
+
+      if (m_pending.empty())
+        return;
+
+      device = m_pending.begin()->first;
+    }
+
+    perform(device, nullptr);
+  }
+}
+
+void
+SyncQueue::work() {
+  for (job* j = m_done_queue.pop_all(); j != nullptr;) {
+    std::unique_ptr<job> done(std::exchange(j, j->m_done_next));
+
+    for (auto& sp : done->parts) {
+      if (sp.fd == -1)
+        continue;
+
+      ::close(sp.fd);
+
+      for (auto& range : sp.dirty)
+        sp.part->mark_dirty(range.first, range.second);
+    }
+
+    if (m_size == 0)
+      throw internal_error("SyncQueue::work() m_size == 0.");
+
+    m_size--;
+    done->slot(done->error);
+  }
+}
+
+// Jobs still pending are performed here rather than waiting for the
+// device workers, which might not be running during shutdown.
+size_t
+SyncQueue::wait() {
+  if (m_size == 0)
+    return 0;
+
+  perform_all();
+
+  while (m_done_queue.empty())
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+  size_t size = m_size;
+  work();
+
+  return size - m_size;
+}
+
+} // namespace torrent
@@ -1,19 +1,30 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <iterator>
+#include <vector>
 
+#include "data/block_list_hasher.h"
+#include "data/chunk_cache.h"
 #include "data/chunk_list.h"
 #include "data/hash_queue.h"
 #include "data/hash_torrent.h"
 #include "download/available_list.h"
 #include "download/chunk_selector.h"
+#include "download/delegator.h"
 #include "download/download_wrapper.h"
+#include "manager.h"
 #include "protocol/handshake_manager.h"
 #include "protocol/peer_connection_base.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/data/block_list.h"
 #include "torrent/data/file.h"
 #include "torrent/data/file_list.h"
 #include "torrent/data/file_manager.h"
+#include "torrent/data/transfer_list.h"
 #include "torrent/exceptions.h"
 #include "torrent/object.h"
 #include "torrent/peer/connection_list.h"
@@ -72,6 +83,10 @@ DownloadWrapper::DownloadWrapper()
   m_main->chunk_list()->slot_storage_error() = [this](const std::string& msg) {
     receive_storage_error(msg);
   };
+
+  m_main->chunk_list()->slot_chunk_cleared() = [this](uint32_t index) {
+    receive_chunk_cleared(index);
+  };
 }
 
 DownloadWrapper::~DownloadWrapper() {
@@ -267,10 +282,32 @@ DownloadWrapper::check_chunk_hash(ChunkHandle handle) {
     m_main->chunk_list()->get(handle.index(), ChunkList::get_blocking);
   m_main->chunk_list()->release(&handle);
 
-  hash_queue()->push_back(
-    new_handle, data(), [this](ChunkHandle handle, const char* hash) {
-      receive_hash_done(handle, hash);
-    });
+  auto slot_done = [this](ChunkHandle handle, const char* hash) {
+    receive_hash_done(handle, hash);
+  };
+
+  // Pieces hashed as their blocks arrived skip the hash check thread,
+  // though the result is still delivered through the queue.
+  TransferList* transfer_list = m_main->delegator()->transfer_list();
+  auto          block_list    = transfer_list->find(new_handle.index());
+  HashString    hash;
+
+  if (block_list != transfer_list->end() &&
+      (*block_list)->hasher()->hash_c(hash.data())) {
+    hash_queue()->push_back_hashed(new_handle, data(), hash, slot_done);
+    return;
+  }
+
+  // Rechecks may stream the chunks to avoid evicting the data we are
+  // seeding from the page cache, and are ordered by their position on
+  // disk together with those of other downloads.
+  uint32_t read_mode = ChunkManager::recheck_read_mmap;
+  bool     recheck   = m_hashChecker->is_checking();
+
+  if (recheck)
+    read_mode = manager->chunk_manager()->recheck_read_mode();
+
+  hash_queue()->push_back(new_handle, data(), slot_done, read_mode, recheck);
 }
 
 void
@@ -312,6 +349,9 @@ DownloadWrapper::receive_tick(uint32_t ticks) {
   if (!info()->is_open())
     return;
 
+  if (m_migrateReady)
+    migrate_part_files();
+
   // Every 2 minutes.
   if (ticks % 4 == 0) {
     if (info()->is_active()) {
@@ -334,6 +374,8 @@ DownloadWrapper::receive_tick(uint32_t ticks) {
           itr, ConnectionList::disconnect_available);
       else
         itr++;
+
+    reclaim_space();
   }
 
   DownloadMain::have_queue_type* haveQueue = m_main->have_queue();
@@ -352,6 +394,8 @@ DownloadWrapper::receive_tick(uint32_t ticks) {
 
 void
 DownloadWrapper::receive_update_priorities() {
+  migrate_part_files();
+
   if (m_main->chunk_selector()->empty())
     return;
 
@@ -394,6 +438,8 @@ DownloadWrapper::receive_update_priorities() {
 
   m_main->chunk_selector()->update_priorities();
 
+  reclaim_space();
+
   for (const auto& peer : *m_main->connection_list()) {
     peer->m_ptr()->update_interested();
   }
@@ -414,6 +460,145 @@ DownloadWrapper::receive_update_priorities() {
   }
 }
 
+// Files kept in the part file are created once they are wanted
+// again, checked when the priorities change and on the tick after a
+// boundary chunk of a waiting file is unmapped. The modified chunks
+// are passed to the sync queue, and unreferenced ones dropped from
+// the read cache, so that the boundary chunks get unmapped.
+void
+DownloadWrapper::migrate_part_files() {
+  m_migrateWaiting = false;
+
+  // Retried on the first tick after the download is opened.
+  if (!info()->is_open()) {
+    m_migrateReady = true;
+    return;
+  }
+
+  m_migrateReady = false;
+
+  ChunkList* chunk_list = m_main->chunk_list();
+
+  for (auto file : *file_list()) {
+    if (!file->is_part_file() || file->priority() == PRIORITY_OFF)
+      continue;
+
+    File::range_type range = file->range();
+
+    if (range.first != range.second &&
+        ((*chunk_list)[range.first].is_valid() ||
+         (*chunk_list)[range.second - 1].is_valid())) {
+      m_migrateWaiting = true;
+      continue;
+    }
+
+    if (!file_list()->migrate_part_file(file))
+      LT_LOG_STORAGE_ERRORS("could not move '%s' out of the part file",
+                            file->path()->as_string().c_str());
+  }
+
+  if (!m_migrateWaiting)
+    return;
+
+  chunk_list->sync_chunks(ChunkList::sync_force);
+  manager->chunk_manager()->read_cache()->erase(chunk_list);
+}
+
+void
+DownloadWrapper::receive_chunk_cleared(uint32_t index) {
+  if (!m_migrateWaiting || m_migrateReady)
+    return;
+
+  m_migrateReady =
+    std::any_of(file_list()->begin(), file_list()->end(), [index](File* f) {
+      return f->is_part_file() && f->priority() != PRIORITY_OFF &&
+             f->range().first != f->range().second &&
+             (index == f->range().first || index == f->range().second - 1);
+    });
+}
+
+// Chunks of files with priority off that are referenced or being
+// downloaded are skipped, and retried the next time around. Those
+// only kept mapped by the read cache are evicted, as their data is
+// about to be discarded.
+//
+// There is no message telling peers a chunk is no longer available,
+// so peers lacking any of the cleared chunks are disconnected and get
+// the new bitfield once they reconnect. A request for one of those
+// chunks would otherwise be treated as invalid.
+void
+DownloadWrapper::reclaim_space() {
+  if (!info()->is_open() || m_hashChecker->is_checking())
+    return;
+
+  ChunkList*    chunk_list    = m_main->chunk_list();
+  ChunkCache*   read_cache    = manager->chunk_manager()->read_cache();
+  TransferList* transfer_list = m_main->delegator()->transfer_list();
+
+  std::vector<File::range_type> cleared;
+
+  auto is_busy = [&](File::range_type range) {
+    for (uint32_t index = range.first; index != range.second; index++) {
+      ChunkListNode* node = &(*chunk_list)[index];
+
+      if (node->is_valid() && node->references() == 0)
+        read_cache->erase(node);
+
+      if (node->is_valid() ||
+          transfer_list->find(index) != transfer_list->end())
+        return true;
+    }
+
+    return false;
+  };
+
+  for (auto file : *file_list()) {
+    File::range_type range = file_list()->reclaim_range(file);
+
+    if (range.first == range.second || is_busy(range))
+      continue;
+
+    if (!file_list()->reclaim_space(file)) {
+      LT_LOG_STORAGE_ERRORS("could not reclaim space of '%s': %s",
+                            file->path()->as_string().c_str(),
+                            std::strerror(errno));
+      continue;
+    }
+
+    cleared.push_back(range);
+
+    // Let the cleared chunks be downloaded again should the file be
+    // wanted later.
+    if (m_main->chunk_selector()->empty())
+      continue;
+
+    for (uint32_t index = range.first; index != range.second; index++)
+      if (!data()->untouched_bitfield()->get(index))
+        m_main->chunk_selector()->not_using_index(index);
+  }
+
+  if (cleared.empty())
+    return;
+
+  auto has_cleared = [&cleared](Peer* peer) {
+    return std::all_of(
+      cleared.begin(), cleared.end(), [peer](File::range_type range) {
+        for (uint32_t index = range.first; index != range.second; index++)
+          if (!peer->bitfield()->get(index))
+            return false;
+
+        return true;
+      });
+  };
+
+  ConnectionList* connection_list = m_main->connection_list();
+
+  connection_list->erase_remaining(std::partition(connection_list->begin(),
+                                                  connection_list->end(),
+                                                  has_cleared),
+                                   ConnectionList::disconnect_available);
+}
+
 void
 DownloadWrapper::finished_download() {
   // We delay emitting the signal to allow the delegator to
@@ -50,6 +50,29 @@ Manager::Manager()
       m_main_thread_main.send_event_signal(signal, do_interrupt);
     };
 
+  SyncQueue* sync_queue = m_main_thread_disk.sync_queue();
+
+  sync_queue->slot_has_work() =
+    [this,
+     signal = m_main_thread_main.signal_bitfield()->add_signal(
+       [sync_queue]() { sync_queue->work(); })]() {
+      m_main_thread_main.send_event_signal(signal, true);
+    };
+
+  m_chunkManager->set_sync_queue(sync_queue);
+  m_chunkManager->set_prefetch_queue(m_main_thread_disk.prefetch_queue());
+
+  AllocateQueue* allocate_queue = m_main_thread_disk.allocate_queue();
+
+  allocate_queue->slot_has_work() =
+    [this,
+     signal = m_main_thread_main.signal_bitfield()->add_signal(
+       [allocate_queue]() { allocate_queue->work(); })]() {
+      m_main_thread_main.send_event_signal(signal, true);
+    };
+
+  m_chunkManager->set_allocate_queue(allocate_queue);
+
   m_taskTick.slot() = [this]() { receive_tick(); };
 
   priority_queue_insert(
@@ -83,6 +106,7 @@ Manager::~Manager() {
 
   delete m_downloadManager;
   delete m_fileManager;
+
   delete m_handshakeManager;
   delete m_hashQueue;
 
@@ -139,8 +163,10 @@ void
 Manager::receive_tick() {
   m_ticks++;
 
-  if (m_ticks % 2 == 0)
+  if (m_ticks % 2 == 0) {
     instrumentation_tick();
+    m_main_thread_disk.instrumentation_tick();
+  }
 
   m_resourceManager->receive_tick();
   m_chunkManager->periodic_sync();
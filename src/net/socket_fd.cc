@@ -1,11 +1,14 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
+#include "torrent/buildinfo.h"
+
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <netinet/in_systm.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -75,6 +78,33 @@ SocketFd::set_receive_buffer_size(uint32_t s) {
   return setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt)) == 0;
 }
 
+bool
+SocketFd::set_zerocopy(bool state) {
+  check_valid();
+
+#ifdef LT_HAVE_MSG_ZEROCOPY
+  int opt = state;
+
+  return setsockopt(m_fd, SOL_SOCKET, SO_ZEROCOPY, &opt, sizeof(opt)) == 0;
+#else
+  return !state;
+#endif
+}
+
+bool
+SocketFd::set_cork(bool state) {
+  check_valid();
+  int opt = state;
+
+#if defined(TCP_CORK)
+  return setsockopt(m_fd, IPPROTO_TCP, TCP_CORK, &opt, sizeof(opt)) == 0;
+#elif defined(TCP_NOPUSH)
+  return setsockopt(m_fd, IPPROTO_TCP, TCP_NOPUSH, &opt, sizeof(opt)) == 0;
+#else
+  return !state;
+#endif
+}
+
 int
 SocketFd::get_error() const {
   check_valid();
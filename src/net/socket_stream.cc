@@ -1,6 +1,19 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
+#include "torrent/buildinfo.h"
+
+#include <cerrno>
+
+#ifdef LT_HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
+#ifdef LT_HAVE_MSG_ZEROCOPY
+#include <ctime>
+#include <linux/errqueue.h>
+#endif
+
 #include "net/socket_stream.h"
 #include "torrent/utils/error_number.h"
 
@@ -17,29 +30,105 @@ int_to_string(int v) {
 
 uint32_t
 SocketStream::read_stream_throws(void* buf, uint32_t length) {
-  int r = read_stream(buf, length);
-
-  if (r == 0)
-    throw close_connection();
+  return stream_result_throws(read_stream(buf, length));
+}
 
-  if (r < 0) {
-    if (utils::error_number::current().is_blocked_momentary())
-      return 0;
-    else if (utils::error_number::current().is_closed())
-      throw close_connection();
-    else if (utils::error_number::current().is_blocked_prolonged())
-      throw blocked_connection();
-    else
-      throw connection_error(utils::error_number::current().value());
-  }
+uint32_t
+SocketStream::read_vector_throws(const iovec* iov, int count) {
+  if (count == 0)
+    throw internal_error("Tried to read to an empty vector.");
 
-  return r;
+  return stream_result_throws(::readv(m_fileDesc, iov, count));
 }
 
 uint32_t
 SocketStream::write_stream_throws(const void* buf, uint32_t length) {
-  int r = write_stream(buf, length);
+  return stream_result_throws(write_stream(buf, length));
+}
+
+uint32_t
+SocketStream::write_vector_throws(const iovec* iov, int count) {
+  if (count == 0)
+    throw internal_error("Tried to write an empty vector.");
+
+  return stream_result_throws(::writev(m_fileDesc, iov, count));
+}
+
+int
+SocketStream::write_file_throws(int fd, uint64_t offset, uint32_t length) {
+  if (length == 0)
+    throw internal_error("Tried to write a file range of length 0.");
+
+#ifdef LT_HAVE_SENDFILE
+  off_t position = offset;
+  int   r        = ::sendfile(m_fileDesc, fd, &position, length);
+
+  if (r == -1 && (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP))
+    return -1;
+
+  return stream_result_throws(r);
+#else
+  return -1;
+#endif
+}
+
+int
+SocketStream::write_zerocopy_throws(const void* buf, uint32_t length) {
+  if (length == 0)
+    throw internal_error("Tried to write to buffer length 0.");
+
+#ifdef LT_HAVE_MSG_ZEROCOPY
+  int r = ::send(m_fileDesc, buf, length, MSG_ZEROCOPY);
+
+  // The pages could not be pinned within the socket's option memory
+  // limit.
+  if (r == -1 && errno == ENOBUFS)
+    return -1;
+
+  return stream_result_throws(r);
+#else
+  return -1;
+#endif
+}
+
+bool
+SocketStream::read_zerocopy_completions(uint32_t* last, bool* copied) {
+  bool found = false;
 
+#ifdef LT_HAVE_MSG_ZEROCOPY
+  while (true) {
+    char   control[128];
+    msghdr msg{};
+
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (::recvmsg(m_fileDesc, &msg, MSG_ERRQUEUE) == -1)
+      break;
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg          = CMSG_NXTHDR(&msg, cmsg)) {
+      auto err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+
+      if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+
+      if (!found || int32_t(err->ee_data - *last) > 0)
+        *last = err->ee_data;
+
+      if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+        *copied = true;
+
+      found = true;
+    }
+  }
+#endif
+
+  return found;
+}
+
+uint32_t
+SocketStream::stream_result_throws(int r) {
   if (r == 0)
     throw close_connection();
 
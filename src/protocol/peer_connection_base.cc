@@ -1,11 +1,14 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
+#include <algorithm>
 #include <cstdio>
 #include <fcntl.h>
 
+#include "data/block_list_hasher.h"
 #include "data/chunk_iterator.h"
 #include "data/chunk_list.h"
+#include "data/prefetch_queue.h"
 #include "download/chunk_selector.h"
 #include "download/chunk_statistics.h"
 #include "download/download_main.h"
@@ -16,6 +19,8 @@
 #include "torrent/chunk_manager.h"
 #include "torrent/connection_manager.h"
 #include "torrent/data/block.h"
+#include "torrent/data/block_list.h"
+#include "torrent/data/file.h"
 #include "torrent/download/choke_group.h"
 #include "torrent/download/choke_queue.h"
 #include "torrent/download_info.h"
@@ -111,6 +116,14 @@ PeerConnectionBase::initialize(DownloadMain*      download,
   m_encryption = *encryptionInfo;
   m_extensions = extensions;
 
+#ifdef LT_HAVE_SENDFILE
+  m_upSendfile = !m_encryption.is_encrypted();
+#endif
+
+  m_upZerocopy = !m_encryption.is_encrypted() &&
+                 manager->connection_manager()->is_zerocopy() &&
+                 get_fd().set_zerocopy(true);
+
   m_extensions->set_connection(this);
 
   m_upChoke.set_entry(m_download->up_group_entry());
@@ -183,6 +196,11 @@ PeerConnectionBase::cleanup() {
   // TODO: Verify that transfer counter gets modified by this...
   m_request_list.clear();
 
+  // Completions still queued on the socket release their chunks now,
+  // the rest are kept until the socket is closed.
+  if (!m_upZerocopyChunks.empty())
+    up_zerocopy_complete();
+
   up_chunk_release();
   down_chunk_release();
 
@@ -208,6 +226,8 @@ PeerConnectionBase::cleanup() {
   get_fd().close();
   get_fd().clear();
 
+  up_zerocopy_release();
+
   m_up->throttle()->erase(m_peerChunks.upload_throttle());
   m_down->throttle()->erase(m_peerChunks.download_throttle());
 
@@ -407,6 +427,56 @@ PeerConnectionBase::load_up_chunk() {
                              cm->preload_type() == 1);
 }
 
+// Prefetches the rest of each chunk in the upload queue, starting at
+// the first requested block. Chunks prefetched recently, by this or
+// any other peer, are skipped and are not preloaded by
+// 'load_up_chunk' either.
+void
+PeerConnectionBase::up_prefetch() {
+  ChunkManager*  cm    = manager->chunk_manager();
+  PrefetchQueue* queue = cm->prefetch_queue();
+
+  if (queue == nullptr || cm->prefetch_lookahead() == 0)
+    return;
+
+  uint64_t budget = std::max<uint64_t>(
+    m_peerChunks.upload_throttle()->rate()->rate() * cm->prefetch_lookahead(),
+    cm->preload_min_size());
+
+  queue->push_pieces(this,
+                     m_download->chunk_list(),
+                     m_download->file_list(),
+                     m_upPiece,
+                     *m_peerChunks.upload_queue(),
+                     budget);
+}
+
+// Drops the pending prefetch of the piece's chunk once no requests
+// for it remain, and lets the chunk be prefetched again if anything
+// was dropped.
+void
+PeerConnectionBase::up_prefetch_erase(const Piece& piece) {
+  PrefetchQueue* queue = manager->chunk_manager()->prefetch_queue();
+
+  if (queue == nullptr || piece.index() >= m_download->chunk_list()->size())
+    return;
+
+  if (std::any_of(m_peerChunks.upload_queue()->begin(),
+                  m_peerChunks.upload_queue()->end(),
+                  [&piece](const Piece& p) {
+                    return p.index() == piece.index();
+                  }))
+    return;
+
+  FileList* file_list = m_download->file_list();
+
+  if (queue->erase(this,
+                   uint64_t(piece.index()) * file_list->chunk_size(),
+                   file_list->chunk_index_size(piece.index())) != 0)
+    (*m_download->chunk_list())[piece.index()].set_time_preloaded(
+      utils::timer());
+}
+
 void
 PeerConnectionBase::cancel_transfer(BlockTransfer* transfer) {
   if (!get_fd().is_valid())
@@ -429,6 +499,11 @@ PeerConnectionBase::cancel_transfer(BlockTransfer* transfer) {
 
 void
 PeerConnectionBase::event_error() {
+  // Completions of MSG_ZEROCOPY sends are reported through the error
+  // queue.
+  if (!m_upZerocopyChunks.empty() && up_zerocopy_complete())
+    return;
+
   m_download->connection_list()->erase(this, 0);
 }
 
@@ -507,6 +582,11 @@ PeerConnectionBase::down_chunk_finished() {
       throw internal_error("PeerConnectionBase::down_chunk_finished() Transfer "
                            "is the leader, but no chunk allocated.");
 
+    // Hash the block before the piece completes, while the data is
+    // still in the cache.
+    transfer->block()->parent()->hasher()->block_completed(
+      transfer->block(), m_downChunk.chunk());
+
     request_list()->finished();
     m_downChunk.object()->set_time_modified(cachedTime);
 
@@ -555,8 +635,15 @@ PeerConnectionBase::down_chunk() {
     return false;
   }
 
-  uint32_t       bytesTransfered = 0;
-  BlockTransfer* transfer        = m_request_list.transfer();
+  BlockTransfer* transfer = m_request_list.transfer();
+
+  // Another piece is expected after this block, so read its header
+  // into the empty message buffer with the rest of the block.
+  if (quota >= transfer->piece().length() - transfer->position() &&
+      m_down->buffer()->size_end() == 0 && !m_request_list.queued_empty())
+    return down_chunk_vectored();
+
+  uint32_t bytesTransfered = 0;
 
   Chunk::data_type data;
   ChunkIterator    itr(
@@ -576,6 +663,8 @@ PeerConnectionBase::down_chunk() {
 
   } while (data.second != 0 && itr.forward(data.second));
 
+  m_downChunk.chunk()->mark_dirty(
+    transfer->piece().offset() + transfer->position(), bytesTransfered);
   transfer->adjust_position(bytesTransfered);
 
   m_down->throttle()->node_used(m_peerChunks.download_throttle(),
@@ -585,6 +674,64 @@ PeerConnectionBase::down_chunk() {
   return transfer->is_finished();
 }
 
+// The header area is only appended when all of the block's segments
+// fit in the iovec array, as it must follow the end of the block. Any
+// message may follow the block, so the bytes read into the header
+// area are parsed as usual.
+bool
+PeerConnectionBase::down_chunk_vectored() {
+  BlockTransfer* transfer = m_request_list.transfer();
+
+  uint32_t first = transfer->piece().offset() + transfer->position();
+  uint32_t last  = transfer->piece().offset() + transfer->piece().length();
+
+  iovec    iov[max_read_vectors + 1];
+  int      iov_count = 0;
+  uint32_t length    = 0;
+
+  ChunkIterator itr(m_downChunk.chunk(), first, last);
+
+  do {
+    Chunk::data_type data = itr.data();
+
+    iov[iov_count++] = iovec{ data.first, data.second };
+    length += data.second;
+
+  } while (iov_count != max_read_vectors && itr.next());
+
+  if (first + length == last)
+    iov[iov_count++] =
+      iovec{ m_down->buffer()->end(), ProtocolBase::sizeof_piece };
+
+  uint32_t result = read_vector_throws(iov, iov_count);
+
+  if (is_encrypted()) {
+    uint32_t left = result;
+
+    for (int i = 0; left != 0; i++) {
+      uint32_t size = std::min<uint32_t>(left, iov[i].iov_len);
+
+      m_encryption.decrypt(iov[i].iov_base, size);
+      left -= size;
+    }
+  }
+
+  uint32_t blockBytes  = std::min(result, length);
+  uint32_t headerBytes = result - blockBytes;
+
+  m_downChunk.chunk()->mark_dirty(first, blockBytes);
+  transfer->adjust_position(blockBytes);
+
+  m_down->throttle()->node_used(m_peerChunks.download_throttle(), blockBytes);
+  m_download->info()->mutable_down_rate()->insert(blockBytes);
+
+  m_down->buffer()->move_end(
+    m_down->throttle()->node_used_unthrottled(headerBytes));
+  m_downHeaderRead = headerBytes == ProtocolBase::sizeof_piece;
+
+  return transfer->is_finished();
+}
+
 bool
 PeerConnectionBase::down_chunk_from_buffer() {
   m_down->buffer()->consume(down_chunk_process(m_down->buffer()->position(),
@@ -848,9 +995,19 @@ PeerConnectionBase::up_chunk() {
                       m_upPiece.offset() + std::min(quota, m_upPiece.length()));
 
     do {
-      data        = itr.data();
-      data.second = write_stream_throws(data.first, data.second);
+      data       = itr.data();
+      int result = m_upSendfile ? up_chunk_sendfile(itr.chunk_part(),
+                                                    itr.memory_chunk_first(),
+                                                    data.second)
+                                : -1;
+
+      if (result == -1 && m_upZerocopy)
+        result = up_chunk_zerocopy(data.first, data.second);
 
+      if (result == -1)
+        result = write_stream_throws(data.first, data.second);
+
+      data.second = result;
       bytesTransfered += data.second;
 
     } while (data.second != 0 && itr.forward(data.second));
@@ -867,6 +1024,308 @@ PeerConnectionBase::up_chunk() {
   return m_upPiece.length() == 0;
 }
 
+// Only parts that are shared mappings of an open file are sent from
+// the page cache, buffered and static parts may hold data the file
+// does not. If the file cannot be sent this way the connection falls
+// back to copying for the rest of its lifetime.
+int
+PeerConnectionBase::up_chunk_sendfile(const ChunkPart& part,
+                                      uint32_t         first,
+                                      uint32_t         length) {
+  if (!part.is_file_mapping() || part.file() == nullptr ||
+      part.file()->file_descriptor() == -1)
+    return -1;
+
+  int result = write_file_throws(
+    part.file()->file_descriptor(), part.file_offset() + first, length);
+
+  if (result == -1)
+    m_upSendfile = false;
+
+  return result;
+}
+
+int
+PeerConnectionBase::up_chunk_zerocopy(const void* buf, uint32_t length) {
+  if (length < zerocopy_min_size)
+    return -1;
+
+  int result = write_zerocopy_throws(buf, length);
+
+  if (result <= 0)
+    return result;
+
+  uint32_t id = m_upZerocopyNext++;
+
+  if (!m_upZerocopyChunks.empty() &&
+      m_upZerocopyChunks.back().second.object() == m_upChunk.object()) {
+    m_upZerocopyChunks.back().first = id;
+    return result;
+  }
+
+  ChunkHandle handle = m_download->chunk_list()->get(m_upChunk.index());
+
+  if (!handle.is_valid())
+    throw internal_error("PeerConnectionBase::up_chunk_zerocopy() could not "
+                         "reference a loaded chunk.");
+
+  m_upZerocopyChunks.emplace_back(id, handle);
+  return result;
+}
+
+// Releases the chunks of completed sends. If the kernel had to copy
+// the data, e.g. on loopback, the connection stops using MSG_ZEROCOPY.
+bool
+PeerConnectionBase::up_zerocopy_complete() {
+  uint32_t last   = 0;
+  bool     copied = false;
+
+  if (!read_zerocopy_completions(&last, &copied))
+    return false;
+
+  while (!m_upZerocopyChunks.empty() &&
+         int32_t(last - m_upZerocopyChunks.front().first) >= 0) {
+    m_download->chunk_list()->release(&m_upZerocopyChunks.front().second);
+    m_upZerocopyChunks.pop_front();
+  }
+
+  if (copied)
+    m_upZerocopy = false;
+
+  return true;
+}
+
+// Only called once the socket is closed. The kernel then holds its own
+// references to the pages of sends still in flight, and uploaded
+// chunks are not modified, so the chunks can be released.
+void
+PeerConnectionBase::up_zerocopy_release() {
+  if (get_fd().is_valid())
+    throw internal_error("PeerConnectionBase::up_zerocopy_release() called "
+                         "with the socket still open.");
+
+  for (auto& entry : m_upZerocopyChunks)
+    m_download->chunk_list()->release(&entry.second);
+
+  m_upZerocopyChunks.clear();
+}
+
+// Writes the vectors in order and stops at the first short write.
+// Chunk data that can be sent from the file or with MSG_ZEROCOPY goes
+// out on its own, and everything in between, such as the buffered
+// messages and the next piece header, is gathered into one writev.
+//
+// The socket is corked while this takes more than one call, so that
+// headers are sent in the same segments as the data that follows, and
+// uncorked after the last block of the batch.
+uint32_t
+PeerConnectionBase::up_write_vectors(const iovec*         iov,
+                                     const vector_source* sources,
+                                     int                  count) {
+  auto is_direct = [&](int i) {
+    return sources[i].part != nullptr &&
+           ((m_upSendfile && sources[i].part->is_file_mapping()) ||
+            (m_upZerocopy && iov[i].iov_len >= zerocopy_min_size));
+  };
+
+  bool corked = false;
+
+  for (int i = 0; i != count; i++) {
+    if (is_direct(i)) {
+      corked = count > 1 && get_fd().set_cork(true);
+      break;
+    }
+  }
+
+  uint32_t written = 0;
+
+  for (int i = 0; i != count;) {
+    int    result = -1;
+    int    last   = i + 1;
+    size_t length = iov[i].iov_len;
+
+    if (is_direct(i)) {
+      if (m_upSendfile)
+        result =
+          up_chunk_sendfile(*sources[i].part, sources[i].first, length);
+
+      if (result == -1 && m_upZerocopy)
+        result = up_chunk_zerocopy(iov[i].iov_base, length);
+    }
+
+    if (result == -1) {
+      while (last != count && !is_direct(last))
+        length += iov[last++].iov_len;
+
+      result = write_vector_throws(iov + i, last - i);
+    }
+
+    written += result;
+
+    if (size_t(result) != length)
+      break;
+
+    i = last;
+  }
+
+  if (corked)
+    get_fd().set_cork(false);
+
+  return written;
+}
+
+// When 'batch' is set, the following pieces of the same chunk in the
+// upload queue are gathered as well while the throttle quota lasts,
+// with their headers appended to the message buffer. They are only
+// taken off the queue once the write reaches them.
+//
+// The state is left as MSG if the write stopped within a header, as
+// WRITE_PIECE if it stopped within the data or the quota ran out, and
+// otherwise as IDLE.
+bool
+PeerConnectionBase::up_chunk_vectored(bool batch) {
+  if (!m_up->throttle()->is_throttled(m_peerChunks.upload_throttle()))
+    throw internal_error("PeerConnectionBase::up_chunk_vectored() tried to "
+                         "write a piece but is not in throttle list");
+
+  if (!m_upChunk.chunk()->is_readable())
+    throw internal_error("PeerConnectionBase::up_chunk_vectored() chunk not "
+                         "readable, permission denided");
+
+  struct batch_piece {
+    ProtocolBuffer<512>::iterator header_first;
+    ProtocolBuffer<512>::iterator header_last;
+    uint32_t                      length;
+    bool                          complete;
+  };
+
+  iovec         iov[max_write_vectors];
+  vector_source sources[max_write_vectors];
+  batch_piece   pieces[max_write_pieces];
+  int         iov_count   = 0;
+  unsigned    piece_count = 0;
+  uint32_t    total       = 0;
+
+  uint32_t quota = m_up->throttle()->node_quota(m_peerChunks.upload_throttle());
+
+  auto gather = [&](const Piece& piece) {
+    uint32_t length = std::min(quota, piece.length());
+    uint32_t result = 0;
+
+    if (length == 0)
+      return result;
+
+    ChunkIterator itr(
+      m_upChunk.chunk(), piece.offset(), piece.offset() + length);
+
+    do {
+      Chunk::data_type data = itr.data();
+
+      sources[iov_count] = vector_source{ &itr.chunk_part(),
+                                          itr.memory_chunk_first() };
+      iov[iov_count++]   = iovec{ data.first, data.second };
+      result += data.second;
+
+    } while (iov_count != max_write_vectors && itr.next());
+
+    quota -= result;
+    return result;
+  };
+
+  auto push_piece = [&](const Piece&                  piece,
+                        ProtocolBuffer<512>::iterator header_first) {
+    batch_piece& p = pieces[piece_count++];
+
+    p.header_first = header_first;
+    p.header_last  = m_up->buffer()->end();
+
+    sources[iov_count] = vector_source{ nullptr, 0 };
+    iov[iov_count++]   = iovec{ p.header_first,
+                                size_t(p.header_last - p.header_first) };
+
+    p.length   = gather(piece);
+    p.complete = p.length == piece.length();
+
+    total += (p.header_last - p.header_first) + p.length;
+  };
+
+  push_piece(m_upPiece, m_up->buffer()->position());
+
+  auto itr = m_peerChunks.upload_queue()->begin();
+
+  while (batch && quota != 0 && pieces[piece_count - 1].complete &&
+         piece_count != max_write_pieces &&
+         iov_count + 2 <= max_write_vectors &&
+         itr != m_peerChunks.upload_queue()->end() &&
+         itr->index() == m_upPiece.index() && m_up->can_write_piece() &&
+         m_download->file_list()->is_valid_piece(*itr)) {
+    const Piece&                  piece        = *itr++;
+    ProtocolBuffer<512>::iterator header_first = m_up->buffer()->end();
+
+    m_up->write_piece(piece);
+    push_piece(piece, header_first);
+  }
+
+  uint32_t written = up_write_vectors(iov, sources, iov_count);
+  bool     result  = written == total;
+
+  uint32_t message_bytes = 0;
+  uint32_t piece_bytes   = 0;
+
+  m_up->set_state(ProtocolWrite::IDLE);
+
+  for (unsigned i = 0; i != piece_count; i++) {
+    batch_piece& p      = pieces[i];
+    uint32_t     header = p.header_last - p.header_first;
+
+    if (i != 0) {
+      if (written == 0)
+        break;
+
+      m_upPiece = m_peerChunks.upload_queue()->front();
+      m_peerChunks.upload_queue()->pop_front();
+
+      LT_LOG_PIECE_EVENTS("(up)   batched          %" PRIu32 " %" PRIu32
+                          " %" PRIu32,
+                          m_upPiece.index(),
+                          m_upPiece.length(),
+                          m_upPiece.offset());
+    }
+
+    if (written < header) {
+      m_up->buffer()->set_position_itr(p.header_first + written);
+      m_up->buffer()->set_end_itr(p.header_last);
+      m_up->set_state(ProtocolWrite::MSG);
+
+      message_bytes += written;
+      break;
+    }
+
+    uint32_t sent = std::min(written - header, p.length);
+
+    written -= header + sent;
+    message_bytes += header;
+    piece_bytes += sent;
+
+    m_upPiece.set_offset(m_upPiece.offset() + sent);
+    m_upPiece.set_length(m_upPiece.length() - sent);
+
+    if (m_upPiece.length() != 0) {
+      m_up->set_state(ProtocolWrite::WRITE_PIECE);
+      break;
+    }
+  }
+
+  if (m_up->get_state() != ProtocolWrite::MSG)
+    m_up->buffer()->reset();
+
+  m_up->throttle()->node_used_unthrottled(message_bytes);
+  m_up->throttle()->node_used(m_peerChunks.upload_throttle(), piece_bytes);
+  m_download->info()->mutable_up_rate()->insert(piece_bytes);
+
+  return result;
+}
+
 bool
 PeerConnectionBase::up_extension() {
   if (m_extensionOffset == extension_must_encrypt) {
@@ -959,6 +1418,7 @@ PeerConnectionBase::read_cancel_piece(const Piece& p) {
 
   if (itr != m_peerChunks.upload_queue()->end()) {
     m_peerChunks.upload_queue()->erase(itr);
+    up_prefetch_erase(p);
 
     LT_LOG_PIECE_EVENTS("(up)   cancel_requested %" PRIu32 " %" PRIu32
                         " %" PRIu32,
@@ -1001,6 +1461,7 @@ PeerConnectionBase::write_prepare_piece() {
   }
 
   m_up->write_piece(m_upPiece);
+  up_prefetch();
 
   LT_LOG_PIECE_EVENTS("(up)   prepared         %" PRIu32 " %" PRIu32
                       " %" PRIu32,
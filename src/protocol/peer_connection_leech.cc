@@ -3,6 +3,7 @@
 
 #include <cstring>
 #include <sstream>
+#include <utility>
 
 #include "data/chunk_list_node.h"
 #include "download/chunk_selector.h"
@@ -367,8 +368,13 @@ PeerConnection<type>::event_read() {
     do {
 
       switch (m_down->get_state()) {
-        case ProtocolRead::IDLE:
-          if (m_down->buffer()->size_end() < read_size) {
+        case ProtocolRead::IDLE: {
+          // A piece header read along with the previous block is parsed
+          // before reading more, so that the piece data is read
+          // directly into the chunk.
+          bool headerRead = std::exchange(m_downHeaderRead, false);
+
+          if (m_down->buffer()->size_end() < read_size && !headerRead) {
             unsigned int length =
               read_stream_throws(m_down->buffer()->end(),
                                  read_size - m_down->buffer()->size_end());
@@ -383,13 +389,14 @@ PeerConnection<type>::event_read() {
           while (read_message())
             ;
 
-          if (m_down->buffer()->size_end() == read_size) {
+          if (m_down->buffer()->size_end() == read_size || headerRead) {
             m_down->buffer()->move_unused();
             break;
           } else {
             m_down->buffer()->move_unused();
             return;
           }
+        }
 
         case ProtocolRead::READ_PIECE:
           if (type != Download::CONNECTION_LEECH)
@@ -496,8 +503,15 @@ PeerConnection<type>::fill_write_buffer() {
     if (m_upChoke.choked()) {
       m_up->throttle()->erase(m_peerChunks.upload_throttle());
       up_chunk_release();
+
+      auto queued = std::move(*m_peerChunks.upload_queue());
       m_peerChunks.upload_queue()->clear();
 
+      up_prefetch_erase(m_upPiece);
+
+      for (const auto& piece : queued)
+        up_prefetch_erase(piece);
+
       if (m_encryptBuffer != nullptr) {
         if (m_encryptBuffer->remaining())
           throw internal_error(
@@ -601,6 +615,18 @@ PeerConnection<type>::event_write() {
 
           // fallthrough
         case ProtocolWrite::MSG:
+          // Unencrypted pieces are written along with the buffered
+          // messages.
+          if (m_up->last_command() == ProtocolBase::PIECE &&
+              !is_encrypted()) {
+            load_up_chunk();
+
+            if (!up_chunk_vectored(type == Download::CONNECTION_LEECH))
+              return;
+
+            break;
+          }
+
           if (!m_up->buffer()->consume(
                 m_up->throttle()->node_used_unthrottled(write_stream_throws(
                   m_up->buffer()->position(), m_up->buffer()->remaining()))))
@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#include "data/allocate_queue.h"
+#include "data/hash_check_queue.h"
+#include "data/prefetch_queue.h"
+#include "data/sync_queue.h"
+
+#include "thread_device.h"
+
+namespace torrent {
+
+size_t
+thread_device::pending() const {
+  return m_sync_queue->pending(m_device) +
+         m_hash_queue->pending(m_device) +
+         m_prefetch_queue->pending(m_device) +
+         m_allocate_queue->pending(m_device);
+}
+
+void
+thread_device::perform() {
+  m_sync_queue->perform(m_device, &m_stats);
+  m_hash_queue->perform(m_device);
+  m_allocate_queue->perform(m_device, &m_stats);
+  m_prefetch_queue->perform(m_device, &m_stats);
+}
+
+} // namespace torrent
@@ -1,48 +1,173 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
+#include <chrono>
+#include <cinttypes>
+#include <thread>
+
 #include "torrent/exceptions.h"
-#include "torrent/poll.h"
 #include "torrent/utils/log.h"
-#include "torrent/utils/timer.h"
-#include "utils/instrumentation.h"
 
 #include "thread_disk.h"
 
 namespace torrent {
 
+// The workers call into the queues owned by thread_disk until they
+// have left their event loop, so they must not be destroyed while
+// still running.
+static void
+wait_worker_stopped(thread_base* worker) {
+  if (!worker->is_started())
+    return;
+
+  worker->stop_thread();
+
+  while (!worker->is_inactive())
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+thread_disk::~thread_disk() {
+  for (auto& worker : m_hash_workers)
+    wait_worker_stopped(worker.get());
+
+  for (auto& device : m_devices)
+    wait_worker_stopped(device.second.get());
+}
+
 void
-thread_disk::init_thread() {
-  if (!Poll::slot_create_poll())
+thread_disk::set_hash_thread_count(unsigned int count) {
+  if (count == 0)
     throw internal_error(
-      "thread_disk::init_thread(): Poll::slot_create_poll() not valid.");
+      "thread_disk::set_hash_thread_count(...) count == 0.");
+
+  while (hash_thread_count() > count) {
+    std::unique_ptr<thread_hash> worker = std::move(m_hash_workers.back());
+    m_hash_workers.pop_back();
+
+    // Any chunks the worker is currently hashing are completed
+    // before it stops, the rest are left to the remaining threads. A
+    // worker that was just started may not be active yet, but still
+    // needs to see the shutdown flag before it is joined.
+    if (worker->is_started())
+      worker->stop_thread_wait();
+  }
 
-  m_poll  = Poll::slot_create_poll()();
-  m_state = STATE_INITIALIZED;
+  while (hash_thread_count() < count) {
+    m_hash_workers.push_back(std::make_unique<thread_hash>(&m_hash_queue));
+    m_hash_workers.back()->init_thread();
 
-  m_instrumentation_index =
-    INSTRUMENTATION_POLLING_DO_POLL_DISK - INSTRUMENTATION_POLLING_DO_POLL;
+    if (m_thread != nullptr && !has_do_shutdown())
+      m_hash_workers.back()->start_thread();
+  }
+
+  lt_log_print(
+    LOG_THREAD_NOTICE, "%s: Using %u hash threads.", name(), count);
 }
 
 void
-thread_disk::call_events() {
-  // lt_log_print_locked(torrent::LOG_THREAD_NOTICE, "Got thread_disk tick.");
+thread_disk::init_thread() {
+  thread_worker::init_thread();
 
-  // TODO: Consider moving this into timer events instead.
-  if ((m_flags & flag_do_shutdown)) {
-    if ((m_flags & flag_did_shutdown))
-      throw internal_error("Already trigged shutdown.");
+  auto interrupt = [this](uint64_t device) {
+    device_thread(device)->interrupt();
+  };
 
-    m_flags |= flag_did_shutdown;
-    throw shutdown_exception();
+  m_sync_queue.slot_interrupt()     = interrupt;
+  m_hash_queue.slot_interrupt()     = interrupt;
+  m_prefetch_queue.slot_interrupt() = interrupt;
+  m_allocate_queue.slot_interrupt() = interrupt;
+}
+
+void
+thread_disk::start_thread() {
+  thread_base::start_thread();
+
+  for (auto& device : m_devices)
+    device.second->start_thread();
+
+  for (auto& worker : m_hash_workers)
+    worker->start_thread();
+}
+
+void
+thread_disk::stop_thread() {
+  for (auto& worker : m_hash_workers)
+    worker->stop_thread();
+
+  for (auto& device : m_devices)
+    device.second->stop_thread();
+
+  thread_base::stop_thread();
+}
+
+// Called from the main thread when a job is queued.
+thread_device*
+thread_disk::device_thread(uint64_t device) {
+  auto itr = m_devices.find(device);
+
+  if (itr != m_devices.end())
+    return itr->second.get();
+
+  auto worker = std::make_unique<thread_device>(device,
+                                                &m_sync_queue,
+                                                &m_hash_queue,
+                                                &m_prefetch_queue,
+                                                &m_allocate_queue);
+
+  worker->init_thread();
+
+  if (m_thread != nullptr && !has_do_shutdown())
+    worker->start_thread();
+
+  lt_log_print(LOG_THREAD_NOTICE,
+               "%s: Added thread for device %" PRIu64 ".",
+               name(),
+               device);
+
+  return m_devices.emplace(device, std::move(worker)).first->second.get();
+}
+
+void
+thread_disk::instrumentation_tick() {
+#ifdef LT_INSTRUMENTATION
+  for (auto& device : m_devices) {
+    device_stats* stats = device.second->stats();
+
+    lt_log_print(LOG_INSTRUMENTATION_DEVICES,
+                 "%" PRIu64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
+                 " %zu",
+                 device.first,
+                 stats->jobs.exchange(0),
+                 stats->bytes.exchange(0),
+                 stats->busy_usec.exchange(0),
+                 stats->max_usec.exchange(0),
+                 device.second->pending());
   }
+#endif
+}
 
-  m_hash_queue.perform();
+// Rotate the starting point so that a burst of new chunks wakes up
+// as many idle threads as possible, as a poked thread stays in the
+// polling state until it has returned from the poll call.
+void
+thread_disk::interrupt_hash() {
+  unsigned int count = hash_thread_count();
+
+  for (unsigned int i = 0; i < count; i++) {
+    unsigned int index  = m_hash_next++ % count;
+    thread_base* thread = index == 0 ? static_cast<thread_base*>(this)
+                                     : m_hash_workers[index - 1].get();
+
+    if (thread->is_polling()) {
+      thread->interrupt();
+      return;
+    }
+  }
 }
 
-int64_t
-thread_disk::next_timeout_usec() {
-  return utils::timer::from_seconds(10).round_seconds().usec();
+void
+thread_disk::perform() {
+  m_hash_queue.perform();
 }
 
 } // namespace torrent
@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#include "data/hash_check_queue.h"
+
+#include "thread_hash.h"
+
+namespace torrent {
+
+void
+thread_hash::perform() {
+  m_hash_queue->perform();
+}
+
+} // namespace torrent
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+#include "torrent/utils/timer.h"
+#include "utils/instrumentation.h"
+
+#include "thread_worker.h"
+
+namespace torrent {
+
+void
+thread_worker::init_thread() {
+  if (!Poll::slot_create_poll())
+    throw internal_error(std::string(name()) +
+                         ": init_thread(): Poll::slot_create_poll() not valid.");
+
+  m_poll  = Poll::slot_create_poll()();
+  m_state = STATE_INITIALIZED;
+
+  m_instrumentation_index =
+    INSTRUMENTATION_POLLING_DO_POLL_DISK - INSTRUMENTATION_POLLING_DO_POLL;
+}
+
+void
+thread_worker::call_events() {
+  if ((m_flags & flag_do_shutdown)) {
+    if ((m_flags & flag_did_shutdown))
+      throw internal_error("Already trigged shutdown.");
+
+    m_flags |= flag_did_shutdown;
+    throw shutdown_exception();
+  }
+
+  perform();
+}
+
+int64_t
+thread_worker::next_timeout_usec() {
+  return utils::timer::from_seconds(10).round_seconds().usec();
+}
+
+} // namespace torrent
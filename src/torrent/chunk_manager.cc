@@ -8,7 +8,11 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "data/chunk_cache.h"
 #include "data/chunk_list.h"
+#include "data/mapping_manager.h"
+#include "data/memory_storage.h"
+#include "data/mmap_storage.h"
 #include "globals.h"
 #include "torrent/chunk_manager.h"
 #include "torrent/exceptions.h"
@@ -16,7 +20,17 @@
 
 namespace torrent {
 
-ChunkManager::ChunkManager() {
+ChunkManager::ChunkManager()
+  : m_storage(new MmapStorage)
+  , m_readCache(new ChunkCache)
+  , m_mappingManager(new MappingManager) {
+
+  // Keep the windows well clear of the address space of 32 bit
+  // hosts.
+  if (sizeof(void*) >= 8) {
+    m_mappingManager->set_window_size(64 << 20);
+    m_mappingManager->set_address_budget(uint64_t(16) << 30);
+  }
 
   // 2/5 of the available memory should be enough for the client. If
   // the client really requires a lot more memory it should call this
@@ -25,6 +39,10 @@ ChunkManager::ChunkManager() {
 }
 
 ChunkManager::~ChunkManager() {
+  delete m_readCache;
+  delete m_mappingManager;
+  delete m_storage;
+
   if (m_memoryUsage != 0 || m_memoryBlockCount != 0) {
     destruct_error("ChunkManager::~ChunkManager() m_memoryUsage != 0 || "
                    "m_memoryBlockCount != 0.");
@@ -96,6 +114,80 @@ ChunkManager::safe_free_diskspace() const {
   return m_memoryUsage + ((uint64_t)512 << 20);
 }
 
+void
+ChunkManager::set_read_cache_ratio(uint32_t percent) {
+  if (percent > 50)
+    throw input_error("Read cache ratio must be 50 percent or less.");
+
+  m_readCacheRatio = percent;
+  m_readCache->evict(read_cache_max_usage());
+}
+
+uint64_t
+ChunkManager::read_cache_usage() const {
+  return m_readCache->usage();
+}
+
+void
+ChunkManager::set_storage_type(uint32_t type) {
+  if (type > storage_memory)
+    throw input_error("Invalid storage type.");
+
+  if (type == m_storageType)
+    return;
+
+  if (!base_type::empty())
+    throw input_error("Storage type can not be changed while there are "
+                      "downloads.");
+
+  delete m_storage;
+
+  if (type == storage_memory)
+    m_storage = new MemoryStorage;
+  else
+    m_storage = new MmapStorage;
+
+  m_storageType = type;
+}
+
+uint64_t
+ChunkManager::mapping_window_size() const {
+  return m_mappingManager->window_size();
+}
+
+void
+ChunkManager::set_mapping_window_size(uint64_t size) {
+  if (size != 0 && (size < (1 << 20) || size > (uint64_t(1) << 30)))
+    throw input_error("Mapping window size must be between 1 MiB and 1 GiB.");
+
+  m_mappingManager->set_window_size(size);
+}
+
+uint64_t
+ChunkManager::mapping_address_budget() const {
+  return m_mappingManager->address_budget();
+}
+
+void
+ChunkManager::set_mapping_address_budget(uint64_t budget) {
+  m_mappingManager->set_address_budget(budget);
+}
+
+bool
+ChunkManager::mapping_hugepages() const {
+  return m_mappingManager->hugepages();
+}
+
+void
+ChunkManager::set_mapping_hugepages(bool state) {
+  m_mappingManager->set_hugepages(state);
+}
+
+uint64_t
+ChunkManager::mapping_usage() const {
+  return m_mappingManager->usage();
+}
+
 void
 ChunkManager::insert(ChunkList* chunkList) {
   chunkList->set_manager(this);
@@ -109,6 +201,12 @@ ChunkManager::erase(ChunkList* chunkList) {
     throw internal_error(
       "ChunkManager::erase(...) chunkList->queue_size() != 0.");
 
+  if (chunkList->syncing_size() != 0)
+    throw internal_error(
+      "ChunkManager::erase(...) chunkList->syncing_size() != 0.");
+
+  m_readCache->erase(chunkList);
+
   auto itr = std::find(base_type::begin(), base_type::end(), chunkList);
 
   if (itr == base_type::end())
@@ -122,7 +220,18 @@ ChunkManager::erase(ChunkList* chunkList) {
 
 bool
 ChunkManager::allocate(uint32_t size, int flags) {
-  if (m_memoryUsage + size > (3 * m_maxMemoryUsage) / 4)
+  uint64_t threshold = (3 * m_maxMemoryUsage) / 4;
+
+  // Cached chunks are the cheapest to release, so shrink the read
+  // cache before syncing anything.
+  if (m_memoryUsage + size > threshold) {
+    uint64_t excess = m_memoryUsage + size - threshold;
+    uint64_t usage  = m_readCache->usage();
+
+    m_readCache->evict(usage > excess ? usage - excess : 0);
+  }
+
+  if (m_memoryUsage + size > threshold)
     try_free_memory((1 * m_maxMemoryUsage) / 4);
 
   if (m_memoryUsage + size > m_maxMemoryUsage) {
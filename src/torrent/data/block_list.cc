@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <functional>
 
+#include "data/block_list_hasher.h"
 #include "torrent/data/block_list.h"
 #include "torrent/data/block_transfer.h"
 #include "torrent/exceptions.h"
@@ -45,6 +46,8 @@ BlockList::BlockList(const Piece& piece, uint32_t blockLength) noexcept(false)
                                     (m_piece.length() % blockLength)
                                       ? m_piece.length() % blockLength
                                       : blockLength));
+
+  m_hasher = std::make_unique<BlockListHasher>(size());
 }
 
 BlockList::~BlockList() {
@@ -56,6 +59,8 @@ BlockList::do_all_failed() {
   clear_finished();
   set_attempt(0);
 
+  m_hasher->clear();
+
   // Clear leaders when we want to redownload the chunk.
   for (auto& block : *this) {
     block.failed_leader();
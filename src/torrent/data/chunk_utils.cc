@@ -25,7 +25,7 @@ chunk_list_mapping(Download* download) {
       continue;
 
     for (const auto& part : *chunk.chunk()) {
-      if (part.mapped() != ChunkPart::MAPPED_MMAP)
+      if (!part.is_file_mapping())
         continue;
 
       vm_mapping val = { part.chunk().ptr(), part.chunk().size_aligned() };
@@ -9,6 +9,7 @@
 #include "torrent/exceptions.h"
 #include "torrent/utils/error_number.h"
 #include "torrent/utils/file_stat.h"
+#include "utils/instrumentation.h"
 
 #include "torrent/data/file.h"
 
@@ -58,8 +59,10 @@ File::prepare(int prot, int flags) {
   // set. If so don't quit as we need to try re-sizing, instead call
   // resize_file.
 
-  if (is_open() && has_permissions(prot))
+  if (is_open() && has_permissions(prot)) {
+    instrumentation_update(INSTRUMENTATION_FILES_HIT, 1);
     return true;
+  }
 
   // For now don't allow overridding this check in prepare.
   if (m_flags & flag_create_queued)
@@ -2,22 +2,31 @@
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
 #include <algorithm>
+#include <cerrno>
+#include <cinttypes>
 #include <cstring>
 #include <filesystem>
 #include <functional>
 #include <limits>
 #include <memory>
 #include <set>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
+#include "data/allocate_queue.h"
 #include "data/chunk.h"
 #include "data/memory_chunk.h"
 #include "data/socket_file.h"
+#include "data/storage_backend.h"
 #include "manager.h"
+#include "torrent/chunk_manager.h"
 #include "torrent/data/file.h"
 #include "torrent/data/file_list.h"
 #include "torrent/data/file_manager.h"
 #include "torrent/data/piece.h"
 #include "torrent/exceptions.h"
+#include "torrent/hash_string.h"
 #include "torrent/path.h"
 #include "torrent/utils/error_number.h"
 #include "torrent/utils/file_stat.h"
@@ -48,10 +57,26 @@ FileList::~FileList() {
   // Can we skip close()?
   close();
 
+  // The storage only holds state for files of lists that have been
+  // opened, which is when the root dir gets frozen.
+  StorageBackend* storage = !m_frozenRootDir.empty()
+                              ? manager->chunk_manager()->storage()
+                              : nullptr;
+
   for (const auto& file : *this) {
+    if (storage != nullptr)
+      storage->erase_file(file);
+
     delete file;
   }
 
+  if (m_partFile != nullptr) {
+    if (storage != nullptr)
+      storage->erase_file(m_partFile);
+
+    delete m_partFile;
+  }
+
   base_type::clear();
   m_torrentSize = 0;
 }
@@ -382,7 +407,9 @@ FileList::open(int flags) {
   auto itr = end();
 
   try {
-    if (!(flags & open_no_create) && !make_root_path())
+    if (!(flags & open_no_create) &&
+        manager->chunk_manager()->storage()->is_file_backed() &&
+        !make_root_path())
       throw storage_error("Could not create directory '" + m_rootDir +
                           "': " + utils::error_number::current().message());
 
@@ -437,7 +464,7 @@ FileList::open(int flags) {
   } catch (local_error& e) {
     for (auto& file : *this) {
       file->unset_flags_protected(File::flag_active);
-      manager->file_manager()->close(file);
+      manager->chunk_manager()->storage()->close_file(file);
     }
 
     if (itr == end()) {
@@ -480,11 +507,25 @@ FileList::close() {
 
   LT_LOG_FL(INFO, "Closing.", 0);
 
+  // The allocations hold a reference to this file list, so cancel
+  // those not yet started and wait for the rest without restarting
+  // the download.
+  m_slotAllocated = nullptr;
+
+  if (is_allocating())
+    manager->chunk_manager()->allocate_queue()->erase(this);
+
+  if (is_allocating())
+    throw internal_error("FileList::close() still allocating.",
+                         data()->hash());
+
   for (auto& file : *this) {
     file->unset_flags_protected(File::flag_active);
-    manager->file_manager()->close(file);
+    manager->chunk_manager()->storage()->close_file(file);
   }
 
+  close_part_file(false);
+
   m_isOpen = false;
   m_indirectLinks.clear();
 
@@ -525,6 +566,10 @@ bool
 FileList::open_file(File* node, const Path& lastPath, int flags) {
   utils::error_number::clear_global();
 
+  // Nothing is created on disk for storage that isn't file backed.
+  if (!manager->chunk_manager()->storage()->is_file_backed())
+    return !node->path()->back().empty() || node->size_bytes() == 0;
+
   if (!(flags & open_no_create)) {
     const Path* path = node->path();
 
@@ -547,19 +592,25 @@ FileList::open_file(File* node, const Path& lastPath, int flags) {
     return node->size_bytes() == 0;
 
   utils::file_stat fileStat;
+  bool             exists = fileStat.update(node->frozen_path());
 
-  if (fileStat.update(node->frozen_path()) && !fileStat.is_regular() &&
-      !fileStat.is_link()) {
+  if (exists && !fileStat.is_regular() && !fileStat.is_link()) {
     // Might also bork on other kinds of file types, but there's no
     // suitable errno for all cases.
     utils::error_number::set_global(std::errc::is_a_directory);
     return false;
   }
 
+  if (!exists && use_part_file(node))
+    return true;
+
   // Resize on open and iteration of file list if user wants the space for
   // the whole torrent allocated at once. prot_write triggers the resize().
+  //
+  // With an allocate queue the resize is instead done by allocate().
   if (node->has_flags(File::flag_fallocate_all) &&
-      !node->is_previously_created() && node->priority() != PRIORITY_OFF) {
+      !node->is_previously_created() && node->priority() != PRIORITY_OFF &&
+      manager->chunk_manager()->allocate_queue() == nullptr) {
     if (!node->prepare(MemoryChunk::prot_read, 0)) {
       return false;
     }
@@ -574,25 +625,296 @@ FileList::open_file(File* node, const Path& lastPath, int flags) {
   return node->prepare(MemoryChunk::prot_read, 0);
 }
 
-MemoryChunk
-FileList::create_chunk_part(FileList::iterator itr,
-                            uint64_t           offset,
-                            uint32_t           length,
-                            int                prot) {
-  offset -= (*itr)->offset();
-  length = std::min<uint64_t>(length, (*itr)->size_bytes() - offset);
+bool
+FileList::allocate(std::function<void()> slot) {
+  AllocateQueue* queue = manager->chunk_manager()->allocate_queue();
+
+  if (!is_open() || queue == nullptr ||
+      !manager->chunk_manager()->storage()->is_file_backed())
+    return false;
+
+  if (is_allocating()) {
+    m_slotAllocated = std::move(slot);
+    return true;
+  }
+
+  for (auto file : *this) {
+    if (!file->is_resize_queued() || file->priority() == PRIORITY_OFF ||
+        !file->has_flags(File::flag_fallocate | File::flag_fallocate_all))
+      continue;
+
+    // Open for writing without letting File::prepare do the resize,
+    // if anything fails here it is left to be resized on first write.
+    file->unset_flags_protected(File::flag_resize_queued);
+
+    int fd = -1;
+
+    if (file->prepare(MemoryChunk::prot_read | MemoryChunk::prot_write, 0)) {
+      if (file->is_correct_size())
+        continue;
+
+      fd = ::dup(file->file_descriptor());
+    }
+
+    if (fd == -1) {
+      file->set_flags_protected(File::flag_resize_queued);
+      continue;
+    }
+
+    LT_LOG_FL(INFO,
+              "Allocating file: path:%s size:%" PRIu64 ".",
+              file->path()->as_string().c_str(),
+              file->size_bytes());
+
+    m_allocating++;
+
+    queue->push_back(
+      this,
+      file->device(),
+      fd,
+      file->size_bytes(),
+      SocketFile::flag_fallocate | SocketFile::flag_fallocate_blocking,
+      [this, file](int error) { receive_allocated(file, error); });
+  }
+
+  if (!is_allocating())
+    return false;
+
+  m_slotAllocated = std::move(slot);
+  return true;
+}
+
+// Failed files are resized without fallocate when first written to,
+// so that starting the download again does not retry them. Cancelled
+// files are allocated the next time the download is started.
+void
+FileList::receive_allocated(File* file, int error) {
+  if (error == ECANCELED) {
+    file->set_flags_protected(File::flag_resize_queued);
+
+  } else if (error != 0) {
+    LT_LOG_FL(ERROR,
+              "Could not allocate file: path:%s error:%s",
+              file->path()->as_string().c_str(),
+              std::strerror(error));
+
+    file->unset_flags_protected(File::flag_fallocate |
+                                File::flag_fallocate_all);
+    file->set_flags_protected(File::flag_resize_queued);
+  }
 
-  if ((int64_t)offset < 0)
-    throw internal_error("FileList::chunk_part(...) caught a negative offset",
+  if (m_allocating == 0)
+    throw internal_error("FileList::receive_allocated(...) m_allocating == 0.",
                          data()->hash());
 
-  // Check that offset != length of file.
+  if (--m_allocating == 0 && m_slotAllocated)
+    std::exchange(m_slotAllocated, nullptr)();
+}
 
-  if (!(*itr)->prepare(prot))
-    return MemoryChunk();
+// Priority-off files that don't exist are not created, the data of
+// the pieces they share with wanted files goes to the part file
+// instead. The choice sticks until the file is migrated.
+bool
+FileList::use_part_file(File* file) {
+  if (file->is_part_file())
+    return true;
+
+  if (file->priority() != PRIORITY_OFF || file->is_open() ||
+      file->is_previously_created() ||
+      !manager->chunk_manager()->storage()->is_file_backed() ||
+      file->is_created())
+    return false;
+
+  LT_LOG_FL(INFO,
+            "Using part file: path:%s.",
+            file->path()->as_string().c_str());
+
+  file->set_flags_protected(File::flag_part_file);
+  return true;
+}
+
+// Opened for writing so that it is created and given the torrent's
+// size, which leaves it sparse.
+File*
+FileList::part_file() {
+  if (m_partFile == nullptr)
+    m_partFile = new File;
+
+  if (!m_partFile->is_open()) {
+    m_partFile->set_frozen_path(m_frozenRootDir + "/." +
+                                hash_string_to_hex_str(data()->hash()) +
+                                ".parts");
+    m_partFile->set_size_bytes(m_torrentSize);
+    m_partFile->set_flags_protected(File::flag_create_queued |
+                                    File::flag_resize_queued);
+  }
 
-  return SocketFile((*itr)->file_descriptor())
-    .create_chunk(offset, length, prot, MemoryChunk::map_shared);
+  if (!m_partFile->prepare(MemoryChunk::prot_read | MemoryChunk::prot_write))
+    return nullptr;
+
+  return m_partFile;
+}
+
+void
+FileList::close_part_file(bool remove) {
+  if (m_partFile == nullptr)
+    return;
+
+  manager->chunk_manager()->storage()->close_file(m_partFile);
+
+  if (remove) {
+    LT_LOG_FL(INFO, "Removing part file.", 0);
+    ::unlink(m_partFile->frozen_path().c_str());
+  }
+}
+
+static bool
+copy_part_range(int src, int dst, uint64_t src_offset, uint64_t dst_offset,
+                uint64_t length) {
+  std::vector<char> buffer(std::min<uint64_t>(length, 1 << 20));
+
+  while (length != 0) {
+    ssize_t result = ::pread(
+      src, buffer.data(), std::min<uint64_t>(length, buffer.size()), src_offset);
+
+    if (result <= 0)
+      return false;
+
+    for (ssize_t written = 0; written < result;) {
+      ssize_t w = ::pwrite(
+        dst, buffer.data() + written, result - written, dst_offset + written);
+
+      if (w <= 0)
+        return false;
+
+      written += w;
+    }
+
+    src_offset += result;
+    dst_offset += result;
+    length -= result;
+  }
+
+  return true;
+}
+
+// Only the file's first and last chunks can hold data, as no other
+// chunk of an unwanted file is downloaded.
+bool
+FileList::migrate_part_file(File* file) {
+  if (!file->is_part_file())
+    return true;
+
+  LT_LOG_FL(INFO,
+            "Migrating from part file: path:%s.",
+            file->path()->as_string().c_str());
+
+  file->unset_flags_protected(File::flag_part_file);
+  file->set_flags_protected(File::flag_create_queued |
+                            File::flag_resize_queued);
+
+  if (!file->prepare(MemoryChunk::prot_read | MemoryChunk::prot_write)) {
+    file->set_flags_protected(File::flag_part_file);
+    return false;
+  }
+
+  bool success = true;
+
+  if (m_partFile != nullptr && m_partFile->is_created() &&
+      file->size_bytes() != 0) {
+    File* source = part_file();
+
+    uint64_t first = file->offset();
+    uint64_t last  = file->offset() + file->size_bytes();
+
+    uint64_t head_last =
+      std::min(last, uint64_t(file->range().first + 1) * chunk_size());
+    uint64_t tail_first = std::max(
+      head_last, uint64_t(file->range().second - 1) * chunk_size());
+
+    success =
+      source != nullptr &&
+      copy_part_range(source->file_descriptor(),
+                      file->file_descriptor(),
+                      first,
+                      0,
+                      head_last - first) &&
+      copy_part_range(source->file_descriptor(),
+                      file->file_descriptor(),
+                      tail_first,
+                      tail_first - first,
+                      last - tail_first);
+  }
+
+  if (std::none_of(
+        begin(), end(), [](File* f) { return f->is_part_file(); }))
+    close_part_file(true);
+
+  return success;
+}
+
+// Only chunks that lie entirely within the file are reclaimed, as the
+// others hold data of the neighbouring files. The range is trimmed to
+// its first and last completed chunks.
+File::range_type
+FileList::reclaim_range(File* file) const {
+  if (file->priority() != PRIORITY_OFF || file->size_bytes() == 0 ||
+      file->is_part_file() || bitfield()->empty() ||
+      !(m_reclaimSpace || file->has_flags(File::flag_reclaim_space)) ||
+      !manager->chunk_manager()->storage()->is_file_backed())
+    return File::range_type(0, 0);
+
+  uint64_t         last = file->offset() + file->size_bytes();
+  File::range_type range((file->offset() + chunk_size() - 1) / chunk_size(),
+                         last == m_torrentSize ? size_chunks()
+                                               : last / chunk_size());
+
+  while (range.first < range.second && !bitfield()->get(range.first))
+    range.first++;
+
+  while (range.first < range.second && !bitfield()->get(range.second - 1))
+    range.second--;
+
+  if (range.first >= range.second)
+    return File::range_type(0, 0);
+
+  return range;
+}
+
+bool
+FileList::reclaim_space(File* file) {
+  File::range_type range = reclaim_range(file);
+
+  if (range.first == range.second)
+    return true;
+
+  uint64_t first = chunk_index_position(range.first) - file->offset();
+  uint64_t last  = std::min(chunk_index_position(range.second),
+                           file->offset() + file->size_bytes()) -
+                  file->offset();
+
+  // The data is gone already if the file was removed, only the
+  // bitfield needs to be cleared.
+  if (file->is_created() &&
+      (!file->prepare(MemoryChunk::prot_read | MemoryChunk::prot_write) ||
+       !SocketFile(file->file_descriptor()).punch_hole(first, last - first)))
+    return false;
+
+  LT_LOG_FL(INFO,
+            "Reclaimed space: path:%s range:%" PRIu32 "-%" PRIu32 ".",
+            file->path()->as_string().c_str(),
+            range.first,
+            range.second);
+
+  for (uint32_t index = range.first; index != range.second; index++) {
+    if (!bitfield()->get(index))
+      continue;
+
+    m_data.mutable_completed_bitfield()->unset(index);
+    file->set_completed_protected(file->completed_chunks() - 1);
+  }
+
+  return true;
 }
 
 Chunk*
@@ -602,6 +924,7 @@ FileList::create_chunk(uint64_t offset, uint32_t length, int prot) {
                          data()->hash());
 
   std::unique_ptr<Chunk> chunk(new Chunk);
+  StorageBackend*        storage = manager->chunk_manager()->storage();
 
   for (auto itr = std::find_if(
          begin(),
@@ -617,7 +940,23 @@ FileList::create_chunk(uint64_t offset, uint32_t length, int prot) {
     if ((*itr)->size_bytes() == 0)
       continue;
 
-    MemoryChunk mc = create_chunk_part(itr, offset, length, prot);
+    File*    file        = *itr;
+    uint64_t file_offset = offset - file->offset();
+    uint32_t file_length =
+      std::min<uint64_t>(length, file->size_bytes() - file_offset);
+
+    // Parts of unwanted files are mapped from the part file, at their
+    // offset in the torrent.
+    if (use_part_file(file)) {
+      if ((file = part_file()) == nullptr)
+        return nullptr;
+
+      file_offset = offset;
+    }
+
+    ChunkPart::mapped_type mapped;
+    MemoryChunk            mc =
+      storage->create_chunk(file, file_offset, file_length, prot, &mapped);
 
     if (!mc.is_valid())
       return nullptr;
@@ -630,8 +969,8 @@ FileList::create_chunk(uint64_t offset, uint32_t length, int prot) {
       throw internal_error("FileList::create_chunk(...) mc.size() > length.",
                            data()->hash());
 
-    chunk->push_back(ChunkPart::MAPPED_MMAP, mc);
-    chunk->back().set_file(*itr, offset - (*itr)->offset());
+    chunk->push_back(mapped, mc);
+    chunk->back().set_file(file, file_offset);
 
     offset += mc.size();
     length -= mc.size();
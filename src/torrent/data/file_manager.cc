@@ -1,13 +1,14 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
-#include <algorithm>
+#include <sys/stat.h>
 
 #include "data/socket_file.h"
 #include "manager.h"
 #include "torrent/data/file.h"
 #include "torrent/data/file_manager.h"
 #include "torrent/exceptions.h"
+#include "utils/instrumentation.h"
 
 namespace torrent {
 
@@ -46,11 +47,22 @@ FileManager::open(value_type file, int prot, int flags) {
     return false;
   }
 
+  struct stat st;
+
+  if (::fstat(fd.fd(), &st) == 0) {
+    file->m_device = st.st_dev;
+    file->m_inode  = st.st_ino;
+  }
+
   file->set_protection(prot);
   file->set_file_descriptor(fd.fd());
+  file->m_managerIndex = size();
   base_type::push_back(file);
 
-  // Consider storing the position of the file here.
+  lru_push_front(file);
+
+  instrumentation_update(INSTRUMENTATION_FILES_OPENED, 1);
+  instrumentation_update(INSTRUMENTATION_FILES_OPEN, 1);
 
   m_filesOpenedCounter++;
   return true;
@@ -67,36 +79,68 @@ FileManager::close(value_type file) {
   file->set_protection(0);
   file->set_file_descriptor(-1);
 
-  auto itr = std::find(begin(), end(), file);
+  size_type index = file->m_managerIndex;
 
-  if (itr == end())
-    throw internal_error("FileManager::close_file(...) itr == end().");
+  if (index >= size() || base_type::operator[](index) != file)
+    throw internal_error("FileManager::close(...) file not found.");
 
-  *itr = back();
+  base_type::operator[](index)                 = back();
+  base_type::operator[](index)->m_managerIndex = index;
   base_type::pop_back();
 
+  lru_unlink(file);
+
+  instrumentation_update(INSTRUMENTATION_FILES_OPEN, -1);
+
   m_filesClosedCounter++;
 }
 
-struct FileManagerActivity {
-  FileManagerActivity()
-    : m_last(utils::timer::max().usec())
-    , m_file(nullptr) {}
+void
+FileManager::close_least_active() {
+  while (m_lruBack != nullptr) {
+    File* file = m_lruBack;
 
-  void operator()(File* f) {
-    if (f->is_open() && f->last_touched() <= m_last) {
-      m_last = f->last_touched();
-      m_file = f;
+    if (file->last_touched() > file->m_lruTouched) {
+      lru_unlink(file);
+      lru_push_front(file);
+      continue;
     }
+
+    instrumentation_update(INSTRUMENTATION_FILES_EVICTED, 1);
+
+    close(file);
+    return;
   }
+}
 
-  uint64_t m_last;
-  File*    m_file;
-};
+void
+FileManager::lru_push_front(File* file) {
+  file->m_lruTouched = file->last_touched();
+  file->m_lruPrev    = nullptr;
+  file->m_lruNext    = m_lruFront;
+
+  if (m_lruFront != nullptr)
+    m_lruFront->m_lruPrev = file;
+  else
+    m_lruBack = file;
+
+  m_lruFront = file;
+}
 
 void
-FileManager::close_least_active() {
-  close(std::for_each(begin(), end(), FileManagerActivity()).m_file);
+FileManager::lru_unlink(File* file) {
+  if (file->m_lruPrev != nullptr)
+    file->m_lruPrev->m_lruNext = file->m_lruNext;
+  else
+    m_lruFront = file->m_lruNext;
+
+  if (file->m_lruNext != nullptr)
+    file->m_lruNext->m_lruPrev = file->m_lruPrev;
+  else
+    m_lruBack = file->m_lruPrev;
+
+  file->m_lruPrev = nullptr;
+  file->m_lruNext = nullptr;
 }
 
 } // namespace torrent
@@ -5,6 +5,7 @@
 #include <functional>
 #include <set>
 
+#include "data/block_list_hasher.h"
 #include "data/chunk.h"
 #include "torrent/data/block_failed.h"
 #include "torrent/data/block_list.h"
@@ -164,6 +165,10 @@ TransferList::hash_failed(uint32_t index, Chunk* chunk) {
     throw internal_error(
       "TransferList::hash_failed(...) Finished blocks does not match size.");
 
+  // Retrying with blocks from the failed list rewrites the chunk, so
+  // any further checks need to go through the hash queue.
+  (*blockListItr)->hasher()->invalidate();
+
   m_failedCount++;
 
   // Could propably also check promoted against size of the block
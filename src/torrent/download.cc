@@ -73,7 +73,7 @@ Download::open(int flags) {
 
 void
 Download::close(int flags) {
-  if (m_ptr->info()->is_active())
+  if (m_ptr->info()->is_active() || m_ptr->info()->is_opening())
     stop(0);
 
   LT_LOG_THIS(INFO, "Closing torrent: flags:%0x.", flags);
@@ -93,7 +93,7 @@ Download::start(int flags) {
   if (m_ptr->data()->mutable_completed_bitfield()->empty())
     throw internal_error("Tried to start a download with empty bitfield.");
 
-  if (info->is_active())
+  if (info->is_active() || info->is_opening())
     return;
 
   LT_LOG_THIS(INFO, "Starting torrent: flags:%0x.", flags);
@@ -107,6 +107,23 @@ Download::start(int flags) {
   // flag_queued_create set.
   file_list()->open(flags & ~FileList::open_no_create);
 
+  // Preallocating large files may take minutes, so the download
+  // stays in the opening state until the disk thread is done and
+  // then gets started again.
+  DownloadWrapper* wrapper = m_ptr;
+
+  if (file_list()->allocate([wrapper, flags]() {
+        if (!wrapper->info()->is_opening())
+          return;
+
+        wrapper->info()->unset_flags(DownloadInfo::flag_opening);
+        Download(wrapper).start(flags);
+      })) {
+    LT_LOG_THIS(INFO, "Waiting for files to be allocated.", 0);
+    info->set_flags(DownloadInfo::flag_opening);
+    return;
+  }
+
   if (m_ptr->connection_type() == CONNECTION_INITIAL_SEED) {
     if (!m_ptr->main()->start_initial_seeding())
       set_connection_type(CONNECTION_SEED);
@@ -138,6 +155,12 @@ Download::start(int flags) {
 
 void
 Download::stop(int flags) {
+  if (m_ptr->info()->is_opening()) {
+    LT_LOG_THIS(INFO, "Stopping torrent while allocating files.", 0);
+    m_ptr->info()->unset_flags(DownloadInfo::flag_opening);
+    return;
+  }
+
   if (!m_ptr->info()->is_active())
     return;
 
@@ -202,6 +225,30 @@ Download::hash_stop() {
   m_ptr->hash_checker()->clear();
 }
 
+ranges<uint32_t>
+Download::hash_unchecked_ranges() const {
+  HashTorrent*     hash_checker = m_ptr->hash_checker();
+  ranges<uint32_t> result;
+
+  if (hash_checker->is_checked())
+    return result;
+
+  result = hash_checker->hashing_ranges();
+
+  if (!hash_checker->is_checking())
+    return result;
+
+  // Chunks before the position have been checked, except those still
+  // in the hash queue.
+  result.erase(0, hash_checker->position());
+
+  for (auto& node : *m_ptr->hash_queue())
+    if (node.id() == m_ptr->data())
+      result.insert(node.get_index(), node.get_index() + 1);
+
+  return result;
+}
+
 bool
 Download::is_hash_checked() const {
   return m_ptr->hash_checker()->is_checked();
@@ -165,6 +165,32 @@ hash_queue_size() {
   return manager->hash_queue()->size();
 }
 
+uint32_t
+hash_thread_count() {
+  return manager->main_thread_disk()->hash_thread_count();
+}
+
+void
+set_hash_thread_count(uint32_t count) {
+  if (count < 1 || count > 128)
+    throw input_error("Hash thread count must be between 1 and 128.");
+
+  manager->main_thread_disk()->set_hash_thread_count(count);
+}
+
+uint32_t
+hash_device_limit() {
+  return manager->main_thread_disk()->hash_queue()->device_limit();
+}
+
+void
+set_hash_device_limit(uint32_t limit) {
+  if (limit < 1 || limit > 128)
+    throw input_error("Hash device limit must be between 1 and 128.");
+
+  manager->main_thread_disk()->hash_queue()->set_device_limit(limit);
+}
+
 EncodingList*
 encoding_list() {
   return manager->encoding_list();
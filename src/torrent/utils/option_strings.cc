@@ -177,6 +177,11 @@ const char* option_list_log_group[] = { "critical",
                                         "instrumentation_choke",
                                         "instrumentation_polling",
                                         "instrumentation_transfers",
+                                        "instrumentation_hashing",
+                                        "instrumentation_read_cache",
+                                        "instrumentation_files",
+                                        "instrumentation_mapping",
+                                        "instrumentation_devices",
 
                                         "mock_calls",
 
@@ -1,6 +1,9 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
+#include <algorithm>
+#include <functional>
+
 #include "globals.h"
 #include "net/address_list.h"
 #include "torrent/bitfield.h"
@@ -65,7 +68,11 @@ resume_load_progress(Download download, const Object& object) {
     return;
   }
 
-  if (!resume_load_bitfield(download, object))
+  // A hash checkpoint replaces the bitfield and already handled files
+  // modified since it was saved, the checks below still apply.
+  bool checkpoint = resume_load_hash_checkpoint(download, object);
+
+  if (!checkpoint && !resume_load_bitfield(download, object))
     return;
 
   auto filesItr = files.begin();
@@ -81,14 +88,21 @@ resume_load_progress(Download download, const Object& object) {
     utils::file_stat fs;
 
     if (!filesItr->has_key_value("mtime")) {
-      LT_LOG_LOAD_FILE("no mtime found, file:create|resize range:clear|recheck",
-                       0);
-
       // If 'mtime' is erased, it means we should start hashing and
       // downloading the file as if it was a new torrent.
       (*listItr)->set_flags(File::flag_create_queued |
                             File::flag_resize_queued);
 
+      // A new torrent interrupted during the initial hash check has
+      // no 'mtime', keep the progress of the checkpoint.
+      if (checkpoint) {
+        LT_LOG_LOAD_FILE("no mtime found, file:create|resize range:checkpoint",
+                         0);
+        continue;
+      }
+
+      LT_LOG_LOAD_FILE("no mtime found, file:create|resize range:clear|recheck",
+                       0);
       download.update_range(Download::update_range_recheck |
                               Download::update_range_clear,
                             (*listItr)->range().first,
@@ -172,7 +186,11 @@ resume_load_progress(Download download, const Object& object) {
     // the file, else clear the range. This should be set only for
     // files that have completed and got no indices in
     // TransferList::completed_list().
-    if (mtimeValue == ~int64_t(2) || mtimeValue != fs.modified_time()) {
+    //
+    // With a checkpoint the 'mtime' predates the check, and the
+    // checkpoint's own mtimes were compared when it was loaded.
+    if (mtimeValue == ~int64_t(2) ||
+        (!checkpoint && mtimeValue != fs.modified_time())) {
       LT_LOG_LOAD_FILE(
         "resume data doesn't include uncertain pieces, range:clear|recheck", 0);
       download.update_range(Download::update_range_clear |
@@ -193,10 +211,17 @@ resume_save_progress(Download download, Object& object) {
   // We don't remove the old hash data since it might still be valid,
   // just that the client didn't finish the check this time.
   if (!download.is_hash_checked()) {
+    if (download.is_hash_checking()) {
+      resume_save_hash_checkpoint(download, object);
+      return;
+    }
+
     LT_LOG_SAVE("hash not checked, no progress saved", 0);
     return;
   }
 
+  object.erase_key("hash_checkpoint");
+
   download.sync_chunks();
 
   // If syncing failed, invalidate all resume data and return.
@@ -284,6 +309,150 @@ resume_save_progress(Download download, Object& object) {
 void
 resume_clear_progress(Download, Object& object) {
   object.erase_key("bitfield");
+  object.erase_key("hash_checkpoint");
+}
+
+// The checkpoint holds the bitfield of the chunks checked so far, the
+// ranges yet to be checked, and the file mtimes when it was saved. A
+// file modified since then is checked again in full.
+bool
+resume_load_hash_checkpoint(Download download, const Object& object) {
+  if (!object.has_key_map("hash_checkpoint"))
+    return false;
+
+  const Object& checkpoint = object.get_key("hash_checkpoint");
+  FileList*     fileList   = download.file_list();
+
+  if (!checkpoint.has_key_string("bitfield") ||
+      !checkpoint.has_key_string("unchecked") ||
+      !checkpoint.has_key_list("mtimes")) {
+    LT_LOG_LOAD_INVALID("hash checkpoint is missing keys", 0);
+    return false;
+  }
+
+  const auto& bitfield  = checkpoint.get_key_string("bitfield");
+  const auto& unchecked = checkpoint.get_key_string("unchecked");
+  const auto& mtimes    = checkpoint.get_key_list("mtimes");
+
+  if (bitfield.size() != fileList->bitfield()->size_bytes() ||
+      unchecked.size() % (2 * sizeof(uint32_t)) != 0 ||
+      mtimes.size() != fileList->size_files()) {
+    LT_LOG_LOAD_INVALID("hash checkpoint does not match torrent", 0);
+    return false;
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> ranges;
+
+  for (const char *itr  = unchecked.c_str(),
+                  *last = unchecked.c_str() + unchecked.size();
+       itr != last;
+       itr += 2 * sizeof(uint32_t)) {
+    uint32_t first = ntohl(*(uint32_t*)itr);
+    uint32_t end   = ntohl(*(uint32_t*)(itr + sizeof(uint32_t)));
+
+    if (first >= end || end > fileList->size_chunks()) {
+      LT_LOG_LOAD_INVALID("hash checkpoint has an invalid range", 0);
+      return false;
+    }
+
+    ranges.emplace_back(first, end);
+  }
+
+  if (!std::all_of(
+        mtimes.begin(), mtimes.end(), std::mem_fn(&Object::is_value))) {
+    LT_LOG_LOAD_INVALID("hash checkpoint has an invalid mtime", 0);
+    return false;
+  }
+
+  LT_LOG_LOAD("restoring hash checkpoint with %zu unchecked ranges",
+              ranges.size());
+
+  download.set_bitfield((uint8_t*)bitfield.c_str(),
+                        (uint8_t*)(bitfield.c_str() + bitfield.size()));
+
+  for (const auto& range : ranges)
+    download.update_range(
+      Download::update_range_recheck, range.first, range.second);
+
+  auto mtimesItr = mtimes.begin();
+
+  for (auto listItr = fileList->begin(), listLast = fileList->end();
+       listItr != listLast;
+       ++listItr, ++mtimesItr) {
+    unsigned int file_index = std::distance(fileList->begin(), listItr);
+
+    utils::file_stat fs;
+    int64_t          mtime = ~int64_t(0);
+
+    if (fs.update(fileList->root_dir() + (*listItr)->path()->as_string()))
+      mtime = fs.modified_time();
+
+    if (mtime == mtimesItr->as_value())
+      continue;
+
+    LT_LOG_LOAD_FILE("modified since hash checkpoint, range:clear|recheck", 0);
+    download.update_range(Download::update_range_clear |
+                            Download::update_range_recheck,
+                          (*listItr)->range().first,
+                          (*listItr)->range().second);
+  }
+
+  return true;
+}
+
+void
+resume_save_hash_checkpoint(Download download, Object& object) {
+  FileList* fileList = download.file_list();
+
+  if (!download.is_hash_checking() || fileList->bitfield()->empty()) {
+    LT_LOG_SAVE("not hash checking, no hash checkpoint saved", 0);
+    return;
+  }
+
+  resume_save_hash_checkpoint(download, download.hash_unchecked_ranges(), object);
+}
+
+void
+resume_save_hash_checkpoint(Download                download,
+                            const ranges<uint32_t>& unchecked,
+                            Object&                 object) {
+  FileList*             fileList = download.file_list();
+  std::vector<uint32_t> buffer;
+
+  buffer.reserve(unchecked.size() * 2);
+
+  for (const auto& range : unchecked) {
+    buffer.push_back(htonl(range.first));
+    buffer.push_back(htonl(range.second));
+  }
+
+  LT_LOG_SAVE("saving hash checkpoint: position:%" PRIu32
+              " unchecked_ranges:%zu",
+              download.chunks_hashed(),
+              unchecked.size());
+
+  Object& checkpoint =
+    object.insert_key("hash_checkpoint", Object::create_map());
+
+  checkpoint.insert_key("bitfield",
+                        std::string((const char*)fileList->bitfield()->begin(),
+                                    fileList->bitfield()->size_bytes()));
+  checkpoint.insert_key(
+    "unchecked",
+    std::string((const char*)buffer.data(), buffer.size() * sizeof(uint32_t)));
+
+  Object::list_type& mtimes =
+    checkpoint.insert_key("mtimes", Object::create_list()).as_list();
+
+  for (const auto& file : *fileList) {
+    utils::file_stat fs;
+    int64_t          mtime = ~int64_t(0);
+
+    if (fs.update(fileList->root_dir() + file->path()->as_string()))
+      mtime = fs.modified_time();
+
+    mtimes.push_back(mtime);
+  }
 }
 
 bool
@@ -115,6 +115,47 @@ instrumentation_tick() {
     instrumentation_values[INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_TOTAL],
 
     instrumentation_values[INSTRUMENTATION_TRANSFER_PEER_INFO_UNACCOUNTED]);
+
+  // The wait is the total time in microseconds the dispatched chunks
+  // spent queued.
+  lt_log_print(
+    LOG_INSTRUMENTATION_HASHING,
+    "%" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64,
+    instrumentation_values[INSTRUMENTATION_HASHING_INTERACTIVE_QUEUED],
+    instrumentation_fetch_and_clear(
+      INSTRUMENTATION_HASHING_INTERACTIVE_DISPATCHED),
+    instrumentation_fetch_and_clear(INSTRUMENTATION_HASHING_INTERACTIVE_WAIT),
+    instrumentation_values[INSTRUMENTATION_HASHING_RECHECK_QUEUED],
+    instrumentation_fetch_and_clear(INSTRUMENTATION_HASHING_RECHECK_DISPATCHED),
+    instrumentation_fetch_and_clear(INSTRUMENTATION_HASHING_RECHECK_WAIT));
+
+  lt_log_print(LOG_INSTRUMENTATION_READ_CACHE,
+               "%" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64,
+               instrumentation_fetch_and_clear(INSTRUMENTATION_READ_CACHE_HIT),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_READ_CACHE_MISS),
+               instrumentation_fetch_and_clear(
+                 INSTRUMENTATION_READ_CACHE_EVICTED),
+               instrumentation_values[INSTRUMENTATION_READ_CACHE_USAGE],
+               instrumentation_values[INSTRUMENTATION_READ_CACHE_COUNT]);
+
+  // Opens that found the file already open, files opened and files
+  // closed to make room for others.
+  lt_log_print(LOG_INSTRUMENTATION_FILES,
+               "%" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64,
+               instrumentation_fetch_and_clear(INSTRUMENTATION_FILES_HIT),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_FILES_OPENED),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_FILES_EVICTED),
+               instrumentation_values[INSTRUMENTATION_FILES_OPEN]);
+
+  // Chunk parts served from a mapped window, windows mapped, parts
+  // mapped on their own and the address space used by windows.
+  lt_log_print(
+    LOG_INSTRUMENTATION_MAPPING,
+    "%" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64,
+    instrumentation_fetch_and_clear(INSTRUMENTATION_MAPPING_HIT),
+    instrumentation_fetch_and_clear(INSTRUMENTATION_MAPPING_MAPPED),
+    instrumentation_fetch_and_clear(INSTRUMENTATION_MAPPING_FALLBACK),
+    instrumentation_values[INSTRUMENTATION_MAPPING_USAGE]);
 }
 
 void
@@ -179,6 +220,24 @@ instrumentation_reset() {
     INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_MOVED);
   instrumentation_fetch_and_clear(
     INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_REMOVED);
+
+  instrumentation_fetch_and_clear(
+    INSTRUMENTATION_HASHING_INTERACTIVE_DISPATCHED);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_HASHING_INTERACTIVE_WAIT);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_HASHING_RECHECK_DISPATCHED);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_HASHING_RECHECK_WAIT);
+
+  instrumentation_fetch_and_clear(INSTRUMENTATION_READ_CACHE_HIT);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_READ_CACHE_MISS);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_READ_CACHE_EVICTED);
+
+  instrumentation_fetch_and_clear(INSTRUMENTATION_FILES_HIT);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_FILES_OPENED);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_FILES_EVICTED);
+
+  instrumentation_fetch_and_clear(INSTRUMENTATION_MAPPING_HIT);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_MAPPING_MAPPED);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_MAPPING_FALLBACK);
 }
 #endif
 
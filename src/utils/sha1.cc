@@ -0,0 +1,301 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "torrent/exceptions.h"
+#include "utils/sha1.h"
+
+namespace torrent {
+
+// The multi-buffer kernels use the GCC vector extensions, compiled
+// for AVX2 and AVX-512 and selected at runtime. The state is stored
+// lane-wise, so that the state of each group of lanes can be loaded
+// directly into the vector registers.
+
+using sha1_v8u [[gnu::vector_size(32)]]  = uint32_t;
+using sha1_v16u [[gnu::vector_size(64)]] = uint32_t;
+
+using sha1_multi_kernel =
+  void (*)(uint32_t*, const unsigned char* const*, unsigned int);
+
+#define LT_SHA1_ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define LT_SHA1_ROUND(t, f, k)                                                 \
+  {                                                                            \
+    if ((t) >= 16)                                                             \
+      w[(t)&15] = LT_SHA1_ROL(w[((t)-3) & 15] ^ w[((t)-8) & 15] ^              \
+                                w[((t)-14) & 15] ^ w[(t)&15],                  \
+                              1);                                              \
+                                                                               \
+    V tmp = LT_SHA1_ROL(a, 5) + (f) + e + (k) + w[(t)&15];                     \
+    e     = d;                                                                 \
+    d     = c;                                                                 \
+    c     = LT_SHA1_ROL(b, 30);                                                \
+    b     = a;                                                                 \
+    a     = tmp;                                                               \
+  }
+
+static inline uint32_t
+sha1_load_be32(const unsigned char* p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+         (uint32_t)p[3];
+}
+
+static inline void
+sha1_store_be32(unsigned char* p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+// Vectors are not passed by value, as that would change the ABI of
+// the function depending on the target.
+template <typename V, unsigned int Width>
+static inline __attribute__((always_inline)) void
+sha1_multi_transform(uint32_t*                   state,
+                     const unsigned char* const* data,
+                     unsigned int                blocks) {
+  V a, b, c, d, e;
+
+  std::memcpy(&a, state + 0 * Sha1Multi::max_lanes, sizeof(V));
+  std::memcpy(&b, state + 1 * Sha1Multi::max_lanes, sizeof(V));
+  std::memcpy(&c, state + 2 * Sha1Multi::max_lanes, sizeof(V));
+  std::memcpy(&d, state + 3 * Sha1Multi::max_lanes, sizeof(V));
+  std::memcpy(&e, state + 4 * Sha1Multi::max_lanes, sizeof(V));
+
+  for (unsigned int block = 0; block < blocks; block++) {
+    V w[16];
+
+    for (unsigned int t = 0; t < 16; t++) {
+      uint32_t words[Width];
+
+      for (unsigned int lane = 0; lane < Width; lane++)
+        words[lane] = sha1_load_be32(data[lane] + block * 64 + t * 4);
+
+      std::memcpy(&w[t], words, sizeof(V));
+    }
+
+    V prev_a = a;
+    V prev_b = b;
+    V prev_c = c;
+    V prev_d = d;
+    V prev_e = e;
+
+    for (unsigned int t = 0; t < 20; t++)
+      LT_SHA1_ROUND(t, d ^ (b & (c ^ d)), 0x5a827999u);
+
+    for (unsigned int t = 20; t < 40; t++)
+      LT_SHA1_ROUND(t, b ^ c ^ d, 0x6ed9eba1u);
+
+    for (unsigned int t = 40; t < 60; t++)
+      LT_SHA1_ROUND(t, (b & c) | (d & (b | c)), 0x8f1bbcdcu);
+
+    for (unsigned int t = 60; t < 80; t++)
+      LT_SHA1_ROUND(t, b ^ c ^ d, 0xca62c1d6u);
+
+    a += prev_a;
+    b += prev_b;
+    c += prev_c;
+    d += prev_d;
+    e += prev_e;
+  }
+
+  std::memcpy(state + 0 * Sha1Multi::max_lanes, &a, sizeof(V));
+  std::memcpy(state + 1 * Sha1Multi::max_lanes, &b, sizeof(V));
+  std::memcpy(state + 2 * Sha1Multi::max_lanes, &c, sizeof(V));
+  std::memcpy(state + 3 * Sha1Multi::max_lanes, &d, sizeof(V));
+  std::memcpy(state + 4 * Sha1Multi::max_lanes, &e, sizeof(V));
+}
+
+#undef LT_SHA1_ROUND
+#undef LT_SHA1_ROL
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static void
+sha1_multi_transform_8(uint32_t*                   state,
+                       const unsigned char* const* data,
+                       unsigned int                blocks) {
+  sha1_multi_transform<sha1_v8u, 8>(state, data, blocks);
+}
+
+__attribute__((target("avx512f"))) static void
+sha1_multi_transform_16(uint32_t*                   state,
+                        const unsigned char* const* data,
+                        unsigned int                blocks) {
+  sha1_multi_transform<sha1_v16u, 16>(state, data, blocks);
+}
+#endif
+
+// SHA-NI hashes a single stream faster than the multi-buffer kernels
+// hash several, so CPUs that have it use Sha1, which OpenSSL runs on
+// SHA-NI, and keep the kernels for testing.
+struct sha1_multi_dispatch {
+  sha1_multi_dispatch() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+
+    unsigned int eax, ebx, ecx, edx;
+
+    // CPUID leaf 7, EBX bit 29.
+    bool sha_ni = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+                  (ebx & (1u << 29));
+
+    if (__builtin_cpu_supports("avx512f")) {
+      kernel = &sha1_multi_transform_16;
+      width  = 16;
+    } else if (__builtin_cpu_supports("avx2")) {
+      kernel = &sha1_multi_transform_8;
+      width  = 8;
+    }
+
+    if (kernel != nullptr && !sha_ni)
+      preferred_lanes = width;
+#endif
+  }
+
+  sha1_multi_kernel kernel{ nullptr };
+  unsigned int      width{ 0 };
+  unsigned int      preferred_lanes{ 1 };
+};
+
+static const sha1_multi_dispatch&
+sha1_multi_get_dispatch() {
+  static const sha1_multi_dispatch dispatch;
+  return dispatch;
+}
+
+unsigned int
+Sha1Multi::preferred_lanes() {
+  return sha1_multi_get_dispatch().preferred_lanes;
+}
+
+bool
+Sha1Multi::is_supported() {
+  return sha1_multi_get_dispatch().kernel != nullptr;
+}
+
+void
+Sha1Multi::init(unsigned int lanes) {
+  if (lanes == 0 || lanes > max_lanes)
+    throw internal_error("Sha1Multi::init(...) received an invalid lane count.");
+
+  if (!is_supported())
+    throw internal_error("Sha1Multi::init(...) no kernel for this CPU.");
+
+  static constexpr uint32_t initial_state[5] = {
+    0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+  };
+
+  m_lanes    = lanes;
+  m_buffered = 0;
+  m_length   = 0;
+
+  // Initialize unused lanes too, as the kernels always process a
+  // full vector width.
+  for (unsigned int i = 0; i < 5; i++)
+    std::fill(m_state[i], m_state[i] + max_lanes, initial_state[i]);
+}
+
+void
+Sha1Multi::update(const void* const* data, unsigned int length) {
+  const unsigned char* first[max_lanes];
+
+  for (unsigned int lane = 0; lane < m_lanes; lane++)
+    first[lane] = static_cast<const unsigned char*>(data[lane]);
+
+  m_length += length;
+
+  if (m_buffered != 0) {
+    unsigned int fill = std::min(length, 64 - m_buffered);
+
+    for (unsigned int lane = 0; lane < m_lanes; lane++) {
+      std::memcpy(m_buffer[lane] + m_buffered, first[lane], fill);
+      first[lane] += fill;
+    }
+
+    m_buffered += fill;
+    length -= fill;
+
+    if (m_buffered != 64)
+      return;
+
+    const unsigned char* buffers[max_lanes];
+
+    for (unsigned int lane = 0; lane < m_lanes; lane++)
+      buffers[lane] = m_buffer[lane];
+
+    transform(buffers, 1);
+    m_buffered = 0;
+  }
+
+  if (length >= 64) {
+    transform(first, length / 64);
+
+    for (unsigned int lane = 0; lane < m_lanes; lane++)
+      first[lane] += length - length % 64;
+
+    length %= 64;
+  }
+
+  for (unsigned int lane = 0; lane < m_lanes; lane++)
+    std::memcpy(m_buffer[lane], first[lane], length);
+
+  m_buffered = length;
+}
+
+void
+Sha1Multi::final_c(char* const* buffers) {
+  const unsigned char* blocks[max_lanes];
+  uint64_t             bits = m_length * 8;
+
+  for (unsigned int lane = 0; lane < m_lanes; lane++) {
+    blocks[lane]               = m_buffer[lane];
+    m_buffer[lane][m_buffered] = 0x80;
+    std::memset(m_buffer[lane] + m_buffered + 1, 0, 63 - m_buffered);
+  }
+
+  // No room left for the length, so it goes in an extra block.
+  if (m_buffered >= 56) {
+    transform(blocks, 1);
+
+    for (unsigned int lane = 0; lane < m_lanes; lane++)
+      std::memset(m_buffer[lane], 0, 56);
+  }
+
+  for (unsigned int lane = 0; lane < m_lanes; lane++) {
+    sha1_store_be32(m_buffer[lane] + 56, bits >> 32);
+    sha1_store_be32(m_buffer[lane] + 60, bits);
+  }
+
+  transform(blocks, 1);
+
+  for (unsigned int lane = 0; lane < m_lanes; lane++)
+    for (unsigned int i = 0; i < 5; i++)
+      sha1_store_be32(reinterpret_cast<unsigned char*>(buffers[lane]) + i * 4,
+                      m_state[i][lane]);
+}
+
+// Lanes beyond 'm_lanes' in the last group are fed the data of the
+// last valid lane, and their state is ignored.
+void
+Sha1Multi::transform(const unsigned char* const* data, unsigned int blocks) {
+  const sha1_multi_dispatch& dispatch = sha1_multi_get_dispatch();
+
+  for (unsigned int first = 0; first < m_lanes; first += dispatch.width) {
+    const unsigned char* group[max_lanes];
+
+    for (unsigned int i = 0; i < dispatch.width; i++)
+      group[i] = data[std::min(first + i, m_lanes - 1)];
+
+    dispatch.kernel(&m_state[0][first], group, blocks);
+  }
+}
+
+} // namespace torrent
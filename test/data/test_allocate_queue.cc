@@ -0,0 +1,177 @@
+#include <cerrno>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <sys/stat.h>
+
+#include "data/allocate_queue.h"
+#include "data/socket_file.h"
+
+#include "test/helpers/fixture.h"
+
+class test_allocate_queue : public test_fixture {};
+
+TEST_F(test_allocate_queue, test_basic) {
+  torrent::AllocateQueue queue;
+
+  int interrupts = 0;
+  queue.slot_interrupt() = [&interrupts](uint64_t) { interrupts++; };
+
+  char path[] = "/tmp/test_allocate_queue.XXXXXX";
+  int  fd     = mkstemp(path);
+  ASSERT_NE(fd, -1);
+
+  int results[2] = { -1, -1 };
+
+  queue.push_back(nullptr,
+                  0,
+                  ::dup(fd),
+                  1 << 20,
+                  torrent::SocketFile::flag_fallocate,
+                  [&results](int error) { results[0] = error; });
+  queue.push_back(nullptr, 0, ::dup(fd), 2 << 20, 0, [&results](int error) {
+    results[1] = error;
+  });
+
+  ASSERT_EQ(interrupts, 2);
+  ASSERT_EQ(queue.size(), 2);
+
+  queue.perform(0, nullptr);
+  queue.work();
+
+  ASSERT_EQ(queue.size(), 0);
+
+  ASSERT_EQ(results[0], 0);
+  ASSERT_EQ(results[1], 0);
+
+  struct stat st;
+  ASSERT_EQ(fstat(fd, &st), 0);
+  ASSERT_EQ(st.st_size, 2 << 20);
+
+  ::close(fd);
+  ::unlink(path);
+}
+
+TEST_F(test_allocate_queue, test_devices) {
+  torrent::AllocateQueue queue;
+  torrent::device_stats  stats;
+
+  std::vector<uint64_t> interrupts;
+  queue.slot_interrupt() = [&interrupts](uint64_t device) {
+    interrupts.push_back(device);
+  };
+
+  char path[] = "/tmp/test_allocate_queue.XXXXXX";
+  int  fd     = mkstemp(path);
+  ASSERT_NE(fd, -1);
+
+  int done = 0;
+
+  queue.push_back(nullptr, 1, ::dup(fd), 1 << 20, 0, [&done](int) { done++; });
+  queue.push_back(nullptr, 2, ::dup(fd), 2 << 20, 0, [&done](int) { done++; });
+
+  ASSERT_EQ(interrupts, std::vector<uint64_t>({ 1, 2 }));
+  ASSERT_EQ(queue.pending(1), 1);
+  ASSERT_EQ(queue.pending(2), 1);
+
+  // A worker only performs the jobs of its own device.
+  queue.perform(2, &stats);
+  queue.work();
+
+  ASSERT_EQ(done, 1);
+  ASSERT_EQ(queue.pending(1), 1);
+  ASSERT_EQ(queue.pending(2), 0);
+
+  ASSERT_EQ(stats.jobs, 1);
+  ASSERT_EQ(stats.bytes, 2 << 20);
+
+  queue.perform(1, nullptr);
+  queue.work();
+
+  ASSERT_EQ(done, 2);
+  ASSERT_EQ(stats.jobs, 1);
+
+  ::close(fd);
+  ::unlink(path);
+}
+
+TEST_F(test_allocate_queue, test_erase) {
+  torrent::AllocateQueue queue;
+
+  int has_work = 0;
+  queue.slot_has_work() = [&has_work]() { has_work++; };
+
+  char path[] = "/tmp/test_allocate_queue.XXXXXX";
+  int  fd     = mkstemp(path);
+  ASSERT_NE(fd, -1);
+
+  int owners[2];
+  int results[4] = { -1, -1, -1, -1 };
+
+  for (int i = 0; i < 4; i++)
+    queue.push_back(&owners[i % 2],
+                    i % 2,
+                    ::dup(fd),
+                    1 << 20,
+                    0,
+                    [&results, i](int error) { results[i] = error; });
+
+  // The second owner's job completes, but its slot is only called by
+  // 'work' on the main thread.
+  queue.perform(1, nullptr);
+  ASSERT_EQ(has_work, 1);
+
+  // Only the first owner's jobs are cancelled.
+  queue.erase(&owners[0]);
+
+  ASSERT_EQ(results[0], ECANCELED);
+  ASSERT_EQ(results[2], ECANCELED);
+  ASSERT_EQ(results[1], -1);
+  ASSERT_EQ(results[3], -1);
+  ASSERT_EQ(queue.size(), 2);
+  ASSERT_EQ(queue.pending(0), 0);
+
+  queue.work();
+
+  ASSERT_EQ(results[1], 0);
+  ASSERT_EQ(results[3], 0);
+  ASSERT_EQ(queue.size(), 0);
+
+  ::close(fd);
+  ::unlink(path);
+}
+
+TEST_F(test_allocate_queue, test_erase_running) {
+  torrent::AllocateQueue queue;
+
+  char path[] = "/tmp/test_allocate_queue.XXXXXX";
+  int  fd     = mkstemp(path);
+  ASSERT_NE(fd, -1);
+
+  int owner;
+
+  for (int i = 0; i < 20; i++) {
+    int result = -1;
+
+    queue.push_back(&owner,
+                    0,
+                    ::dup(fd),
+                    (i + 1) << 20,
+                    0,
+                    [&result](int error) { result = error; });
+
+    // Either the job is cancelled, or erase waits for the worker to
+    // complete it.
+    std::thread worker([&queue] { queue.perform(0, nullptr); });
+    queue.erase(&owner);
+
+    ASSERT_TRUE(result == 0 || result == ECANCELED);
+    ASSERT_EQ(queue.size(), 0);
+
+    worker.join();
+  }
+
+  ::close(fd);
+  ::unlink(path);
+}
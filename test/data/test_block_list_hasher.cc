@@ -0,0 +1,137 @@
+#include <sys/mman.h>
+#include <vector>
+
+#include "data/block_list_hasher.h"
+#include "data/chunk.h"
+#include "torrent/data/block_list.h"
+#include "torrent/exceptions.h"
+#include "torrent/hash_string.h"
+#include "utils/sha1.h"
+
+#include "test/helpers/fixture.h"
+
+class test_block_list_hasher : public test_fixture {};
+
+static const uint32_t piece_length = 5 * 16384 + 1000;
+static const uint32_t block_length = 16384;
+
+// Split the chunk in two parts at an offset not aligned to the blocks.
+static torrent::Chunk*
+create_chunk() {
+  auto chunk = new torrent::Chunk();
+
+  for (uint32_t length : { uint32_t{ 20000 }, piece_length - 20000 }) {
+    char* memory = (char*)mmap(
+      NULL, length, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+
+    if (memory == MAP_FAILED)
+      throw torrent::internal_error("create_chunk() mmap failed.");
+
+    for (uint32_t i = 0; i < length; i++)
+      memory[i] = (char)(i * 7 + length);
+
+    chunk->push_back(torrent::ChunkPart::MAPPED_MMAP,
+                     torrent::MemoryChunk(memory,
+                                          memory,
+                                          memory + length,
+                                          torrent::MemoryChunk::prot_read,
+                                          0));
+  }
+
+  return chunk;
+}
+
+static torrent::HashString
+hash_chunk(torrent::Chunk* chunk) {
+  std::vector<char> buffer(piece_length);
+  chunk->to_buffer(buffer.data(), 0, piece_length);
+
+  torrent::Sha1       sha1;
+  torrent::HashString hash;
+  sha1.init();
+  sha1.update(buffer.data(), piece_length);
+  sha1.final_c(hash.data());
+
+  return hash;
+}
+
+static bool
+complete_blocks(torrent::BlockList*              block_list,
+                torrent::Chunk*                  chunk,
+                const std::vector<unsigned int>& order,
+                torrent::HashString*             hash) {
+  for (auto index : order)
+    block_list->hasher()->block_completed(&(*block_list)[index], chunk);
+
+  return block_list->hasher()->hash_c(hash->data());
+}
+
+TEST_F(test_block_list_hasher, test_in_order) {
+  torrent::Chunk*     chunk = create_chunk();
+  torrent::BlockList  block_list(torrent::Piece(0, 0, piece_length),
+                                block_length);
+  torrent::HashString hash;
+
+  ASSERT_EQ(block_list.size(), 6u);
+  ASSERT_TRUE(complete_blocks(&block_list, chunk, { 0, 1, 2, 3, 4, 5 }, &hash));
+  ASSERT_EQ(hash, hash_chunk(chunk));
+  ASSERT_EQ(block_list.hasher()->pending_size(), 0u);
+
+  // The result may only be used once.
+  ASSERT_FALSE(block_list.hasher()->hash_c(hash.data()));
+
+  delete chunk;
+}
+
+TEST_F(test_block_list_hasher, test_out_of_order) {
+  torrent::Chunk*     chunk = create_chunk();
+  torrent::BlockList  block_list(torrent::Piece(0, 0, piece_length),
+                                block_length);
+  torrent::HashString hash;
+
+  ASSERT_FALSE(complete_blocks(&block_list, chunk, { 5, 2, 3 }, &hash));
+  ASSERT_EQ(block_list.hasher()->next_block(), 0u);
+  ASSERT_EQ(block_list.hasher()->pending_size(), 1000u + 2 * block_length);
+
+  ASSERT_FALSE(complete_blocks(&block_list, chunk, { 0, 1 }, &hash));
+  ASSERT_EQ(block_list.hasher()->next_block(), 4u);
+  ASSERT_EQ(block_list.hasher()->pending_size(), 1000u);
+
+  ASSERT_TRUE(complete_blocks(&block_list, chunk, { 4 }, &hash));
+  ASSERT_EQ(hash, hash_chunk(chunk));
+
+  delete chunk;
+}
+
+TEST_F(test_block_list_hasher, test_invalidate) {
+  torrent::Chunk*     chunk = create_chunk();
+  torrent::BlockList  block_list(torrent::Piece(0, 0, piece_length),
+                                block_length);
+  torrent::HashString hash;
+
+  ASSERT_FALSE(complete_blocks(&block_list, chunk, { 0, 1, 2 }, &hash));
+  block_list.hasher()->invalidate();
+  ASSERT_FALSE(complete_blocks(&block_list, chunk, { 3, 4, 5 }, &hash));
+
+  // Re-downloading the blocks restarts the hash.
+  block_list.hasher()->clear();
+  ASSERT_TRUE(complete_blocks(&block_list, chunk, { 1, 0, 2, 5, 4, 3 }, &hash));
+  ASSERT_EQ(hash, hash_chunk(chunk));
+
+  delete chunk;
+}
+
+TEST_F(test_block_list_hasher, test_completed_twice) {
+  torrent::Chunk*     chunk = create_chunk();
+  torrent::BlockList  block_list(torrent::Piece(0, 0, piece_length),
+                                block_length);
+  torrent::HashString hash;
+
+  ASSERT_FALSE(complete_blocks(&block_list, chunk, { 0, 2 }, &hash));
+  ASSERT_THROW(complete_blocks(&block_list, chunk, { 0 }, &hash),
+               torrent::internal_error);
+  ASSERT_THROW(complete_blocks(&block_list, chunk, { 2 }, &hash),
+               torrent::internal_error);
+
+  delete chunk;
+}
@@ -0,0 +1,143 @@
+#include "data/chunk_cache.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/exceptions.h"
+
+#include "test/helpers/chunk.h"
+#include "test/helpers/fixture.h"
+
+class test_chunk_cache : public test_fixture {};
+
+// Room for four chunks of 1 << 16 bytes.
+#define SETUP_CHUNK_CACHE()                                                    \
+  SETUP_CHUNK_LIST();                                                          \
+  chunk_manager->set_max_memory_usage(100 << 16);                              \
+  chunk_manager->set_read_cache_ratio(4);                                      \
+  torrent::ChunkCache* cache = chunk_manager->read_cache();
+
+static void
+read_chunk(torrent::ChunkList* chunk_list, uint32_t index, int flags = 0) {
+  torrent::ChunkHandle handle = chunk_list->get(index, flags);
+
+  if (!handle.is_valid())
+    throw torrent::internal_error("read_chunk(...) invalid handle.");
+
+  chunk_list->release(&handle, flags);
+}
+
+TEST_F(test_chunk_cache, test_basic) {
+  SETUP_CHUNK_CACHE();
+
+  ASSERT_EQ(chunk_manager->read_cache_max_usage(), 4 << 16);
+
+  for (uint32_t i = 0; i < 6; i++)
+    read_chunk(chunk_list, i);
+
+  ASSERT_EQ(cache->size(), 4);
+  ASSERT_EQ(cache->usage(), 4 << 16);
+  ASSERT_EQ(chunk_manager->memory_usage(), 4 << 16);
+
+  ASSERT_FALSE((*chunk_list)[0].is_valid());
+  ASSERT_FALSE((*chunk_list)[1].is_valid());
+
+  for (uint32_t i = 2; i < 6; i++) {
+    ASSERT_TRUE((*chunk_list)[i].is_valid());
+    ASSERT_EQ((*chunk_list)[i].references(), 0);
+    ASSERT_TRUE(cache->is_cached(&(*chunk_list)[i]));
+  }
+
+  // Referencing a cached chunk takes it out of the cache.
+  torrent::ChunkHandle handle = chunk_list->get(3);
+  ASSERT_FALSE(cache->is_cached(&(*chunk_list)[3]));
+  ASSERT_EQ(cache->size(), 3);
+
+  chunk_list->release(&handle);
+  ASSERT_TRUE(cache->is_cached(&(*chunk_list)[3]));
+  ASSERT_EQ(cache->frequent_usage(), 1 << 16);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+TEST_F(test_chunk_cache, test_frequent) {
+  SETUP_CHUNK_CACHE();
+
+  read_chunk(chunk_list, 0);
+  read_chunk(chunk_list, 0);
+
+  ASSERT_EQ(cache->recent_usage(), 0);
+  ASSERT_EQ(cache->frequent_usage(), 1 << 16);
+
+  // A scan of chunks read once only replaces the recent list.
+  for (uint32_t i = 1; i < 16; i++)
+    read_chunk(chunk_list, i);
+
+  ASSERT_TRUE((*chunk_list)[0].is_valid());
+  ASSERT_EQ(cache->recent_usage(), 3 << 16);
+  ASSERT_EQ(cache->frequent_usage(), 1 << 16);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+TEST_F(test_chunk_cache, test_ghost) {
+  SETUP_CHUNK_CACHE();
+
+  read_chunk(chunk_list, 9);
+  read_chunk(chunk_list, 9);
+
+  for (uint32_t i = 0; i < 4; i++)
+    read_chunk(chunk_list, i);
+
+  ASSERT_FALSE((*chunk_list)[0].is_valid());
+  ASSERT_EQ(cache->recent_target(), 0);
+
+  // Chunk 0 was evicted from the recent list too early, so the
+  // recent list is allowed to grow.
+  read_chunk(chunk_list, 0);
+
+  ASSERT_TRUE(cache->is_cached(&(*chunk_list)[0]));
+  ASSERT_TRUE(cache->is_cached(&(*chunk_list)[9]));
+  ASSERT_FALSE((*chunk_list)[1].is_valid());
+
+  ASSERT_EQ(cache->recent_target(), 1 << 16);
+  ASSERT_EQ(cache->recent_usage(), 2 << 16);
+  ASSERT_EQ(cache->frequent_usage(), 2 << 16);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+TEST_F(test_chunk_cache, test_not_cached) {
+  SETUP_CHUNK_CACHE();
+
+  read_chunk(chunk_list, 0, torrent::ChunkList::get_dont_log);
+  ASSERT_FALSE((*chunk_list)[0].is_valid());
+
+  read_chunk(chunk_list, 1);
+  read_chunk(chunk_list, 2);
+  ASSERT_EQ(cache->size(), 2);
+
+  chunk_manager->set_read_cache_ratio(0);
+  ASSERT_EQ(cache->size(), 0);
+  ASSERT_EQ(chunk_manager->memory_usage(), 0);
+
+  read_chunk(chunk_list, 1);
+  ASSERT_FALSE((*chunk_list)[1].is_valid());
+
+  ASSERT_THROW(chunk_manager->set_read_cache_ratio(51), torrent::input_error);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+TEST_F(test_chunk_cache, test_clear) {
+  SETUP_CHUNK_CACHE();
+
+  for (uint32_t i = 0; i < 4; i++)
+    read_chunk(chunk_list, i);
+
+  ASSERT_EQ(cache->size(), 4);
+
+  chunk_list->clear();
+
+  ASSERT_EQ(cache->size(), 0);
+  ASSERT_EQ(chunk_manager->memory_usage(), 0);
+
+  CLEANUP_CHUNK_LIST();
+}
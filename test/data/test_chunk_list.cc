@@ -1,4 +1,11 @@
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+#include "data/socket_file.h"
+#include "data/sync_queue.h"
 #include "torrent/chunk_manager.h"
+#include "torrent/data/file.h"
 #include "torrent/exceptions.h"
 #include "torrent/utils/error_number.h"
 
@@ -110,3 +117,255 @@ TEST_F(test_chunk_list, test_blocking) {
 
   CLEANUP_CHUNK_LIST();
 }
+
+TEST_F(test_chunk_list, test_buffered_sync) {
+  SETUP_CHUNK_LIST();
+
+  const uint32_t chunk_size = 3 * 4096;
+
+  char path[] = "/tmp/test_chunk_list.XXXXXX";
+  int  fd     = mkstemp(path);
+  ASSERT_NE(fd, -1);
+
+  std::string contents(2 * chunk_size, 'a');
+  ASSERT_EQ(pwrite(fd, contents.data(), contents.size(), 0),
+            ssize_t(contents.size()));
+
+  torrent::File file;
+  file.set_file_descriptor(fd);
+  file.set_protection(torrent::MemoryChunk::prot_read |
+                      torrent::MemoryChunk::prot_write);
+
+  chunk_list->set_chunk_size(chunk_size);
+  chunk_list->slot_create_chunk() = [fd, &file](uint32_t index, int) {
+    auto chunk = new torrent::Chunk();
+    chunk->push_back(
+      torrent::ChunkPart::MAPPED_BUFFER,
+      torrent::SocketFile(fd).create_buffer(index * chunk_size, chunk_size));
+    chunk->back().set_file(&file, index * chunk_size);
+    return chunk;
+  };
+
+  auto handle = chunk_list->get(1, torrent::ChunkList::get_writable);
+  ASSERT_TRUE(handle.is_valid());
+  ASSERT_TRUE(handle.chunk()->compare_buffer(contents.data(), 0, chunk_size));
+
+  ASSERT_TRUE(handle.chunk()->from_buffer("bbbb", 100, 4));
+  ASSERT_TRUE(handle.chunk()->from_buffer("cccc", 8000, 4));
+
+  // Nothing reaches the file before the chunk is synced, and ranges
+  // that were not written to are left alone.
+  ASSERT_EQ(pwrite(fd, "dddd", 4, chunk_size + 4096), 4);
+
+  char buffer[4];
+  ASSERT_EQ(pread(fd, buffer, 4, chunk_size + 100), 4);
+  ASSERT_EQ(std::string(buffer, 4), "aaaa");
+
+  chunk_list->release(&handle);
+  ASSERT_EQ(chunk_list->queue_size(), 1);
+
+  ASSERT_EQ(chunk_list->sync_chunks(torrent::ChunkList::sync_all |
+                                    torrent::ChunkList::sync_force),
+            0);
+  ASSERT_EQ(chunk_list->queue_size(), 0);
+  ASSERT_FALSE((*chunk_list)[1].is_valid());
+
+  ASSERT_EQ(pread(fd, buffer, 4, chunk_size + 100), 4);
+  ASSERT_EQ(std::string(buffer, 4), "bbbb");
+  ASSERT_EQ(pread(fd, buffer, 4, chunk_size + 4096), 4);
+  ASSERT_EQ(std::string(buffer, 4), "dddd");
+  ASSERT_EQ(pread(fd, buffer, 4, chunk_size + 8000), 4);
+  ASSERT_EQ(std::string(buffer, 4), "cccc");
+  ASSERT_EQ(pread(fd, buffer, 4, 100), 4);
+  ASSERT_EQ(std::string(buffer, 4), "aaaa");
+
+  ::close(fd);
+  ::unlink(path);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+TEST_F(test_chunk_list, test_buffered_load) {
+  SETUP_CHUNK_LIST();
+
+  const uint32_t chunk_size = 3 * 4096;
+
+  char path[] = "/tmp/test_chunk_list.XXXXXX";
+  int  fd     = mkstemp(path);
+  ASSERT_NE(fd, -1);
+
+  std::string contents(2 * chunk_size, 'a');
+  ASSERT_EQ(pwrite(fd, contents.data(), contents.size(), 0),
+            ssize_t(contents.size()));
+
+  torrent::File file;
+  file.set_file_descriptor(fd);
+  file.set_protection(torrent::MemoryChunk::prot_read |
+                      torrent::MemoryChunk::prot_write);
+
+  chunk_list->set_chunk_size(chunk_size);
+  chunk_list->slot_create_chunk() = [fd, &file](uint32_t index, int) {
+    auto chunk = new torrent::Chunk();
+    chunk->push_back(
+      torrent::ChunkPart::MAPPED_BUFFER,
+      torrent::SocketFile(fd).create_buffer(index * chunk_size, chunk_size));
+    chunk->back().set_file(&file, index * chunk_size);
+    return chunk;
+  };
+
+  auto handle = chunk_list->get(1, torrent::ChunkList::get_writable);
+  ASSERT_TRUE(handle.is_valid());
+  ASSERT_TRUE(handle.chunk()->from_buffer("bbbb", 100, 4));
+
+  // Nothing was read when the chunk was created, so changes to the
+  // file show up when the chunk gets read.
+  std::string first_page(4096, 'e');
+  ASSERT_EQ(pwrite(fd, first_page.data(), first_page.size(), chunk_size),
+            ssize_t(first_page.size()));
+
+  // A read-only get fills the ranges that were not written, without
+  // touching the written ones.
+  auto read_handle = chunk_list->get(1);
+  ASSERT_TRUE(read_handle.is_valid());
+
+  std::string expected = first_page + std::string(chunk_size - 4096, 'a');
+  expected.replace(100, 4, "bbbb");
+
+  ASSERT_TRUE(
+    read_handle.chunk()->compare_buffer(expected.data(), 0, chunk_size));
+
+  chunk_list->release(&read_handle);
+  chunk_list->release(&handle);
+
+  ASSERT_EQ(chunk_list->sync_chunks(torrent::ChunkList::sync_all |
+                                    torrent::ChunkList::sync_force),
+            0);
+
+  char buffer[4];
+  ASSERT_EQ(pread(fd, buffer, 4, chunk_size + 100), 4);
+  ASSERT_EQ(std::string(buffer, 4), "bbbb");
+  ASSERT_EQ(pread(fd, buffer, 4, chunk_size + 104), 4);
+  ASSERT_EQ(std::string(buffer, 4), "eeee");
+
+  ::close(fd);
+  ::unlink(path);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+TEST_F(test_chunk_list, test_sync_queue) {
+  SETUP_CHUNK_LIST();
+
+  torrent::SyncQueue sync_queue;
+  int                interrupts = 0;
+
+  sync_queue.slot_interrupt() = [&interrupts](uint64_t) { interrupts++; };
+  chunk_manager->set_sync_queue(&sync_queue);
+
+  auto handle = chunk_list->get(0, torrent::ChunkList::get_writable);
+  ASSERT_TRUE(handle.is_valid());
+
+  chunk_list->release(&handle);
+  ASSERT_EQ(chunk_list->queue_size(), 1);
+
+  // The chunk keeps its writable reference until the device thread is
+  // done with it.
+  ASSERT_EQ(chunk_list->sync_chunks(torrent::ChunkList::sync_force |
+                                    torrent::ChunkList::sync_safe),
+            0);
+  ASSERT_EQ(chunk_list->queue_size(), 0);
+  ASSERT_EQ(chunk_list->syncing_size(), 1);
+  ASSERT_EQ(sync_queue.size(), 1);
+  ASSERT_EQ(interrupts, 1);
+  ASSERT_TRUE((*chunk_list)[0].is_valid());
+  ASSERT_EQ((*chunk_list)[0].writable(), 1);
+
+  sync_queue.perform(0, nullptr);
+  ASSERT_EQ(chunk_list->syncing_size(), 1);
+  ASSERT_TRUE((*chunk_list)[0].is_valid());
+
+  sync_queue.work();
+  ASSERT_EQ(sync_queue.size(), 0);
+  ASSERT_EQ(chunk_list->syncing_size(), 0);
+  ASSERT_FALSE((*chunk_list)[0].is_valid());
+
+  CLEANUP_CHUNK_LIST();
+}
+
+TEST_F(test_chunk_list, test_sync_queue_buffered) {
+  SETUP_CHUNK_LIST();
+
+  const uint32_t chunk_size = 3 * 4096;
+
+  char path[] = "/tmp/test_chunk_list.XXXXXX";
+  int  fd     = mkstemp(path);
+  ASSERT_NE(fd, -1);
+
+  std::string contents(2 * chunk_size, 'a');
+  ASSERT_EQ(pwrite(fd, contents.data(), contents.size(), 0),
+            ssize_t(contents.size()));
+
+  torrent::File file;
+  file.set_file_descriptor(fd);
+  file.set_protection(torrent::MemoryChunk::prot_read |
+                      torrent::MemoryChunk::prot_write);
+
+  torrent::SyncQueue sync_queue;
+  chunk_manager->set_sync_queue(&sync_queue);
+
+  chunk_list->set_chunk_size(chunk_size);
+  chunk_list->slot_create_chunk() = [fd, &file](uint32_t index, int) {
+    auto chunk = new torrent::Chunk();
+    chunk->push_back(
+      torrent::ChunkPart::MAPPED_BUFFER,
+      torrent::SocketFile(fd).create_buffer(index * chunk_size, chunk_size));
+    chunk->back().set_file(&file, index * chunk_size);
+    return chunk;
+  };
+
+  auto handle = chunk_list->get(1, torrent::ChunkList::get_writable);
+  ASSERT_TRUE(handle.is_valid());
+  ASSERT_TRUE(handle.chunk()->from_buffer("bbbb", 100, 4));
+
+  chunk_list->release(&handle);
+  ASSERT_EQ(chunk_list->sync_chunks(torrent::ChunkList::sync_force |
+                                    torrent::ChunkList::sync_safe),
+            0);
+  ASSERT_EQ(chunk_list->syncing_size(), 1);
+
+  // Nothing is written on the main thread.
+  char buffer[4];
+  ASSERT_EQ(pread(fd, buffer, 4, chunk_size + 100), 4);
+  ASSERT_EQ(std::string(buffer, 4), "aaaa");
+
+  // Writing to the chunk while it is syncing puts it back in the
+  // queue once the sync is done.
+  handle = chunk_list->get(1, torrent::ChunkList::get_writable);
+  ASSERT_TRUE(handle.is_valid());
+  ASSERT_TRUE(handle.chunk()->from_buffer("cccc", 200, 4));
+  chunk_list->release(&handle);
+
+  ASSERT_EQ(sync_queue.wait(), 1);
+  ASSERT_EQ(chunk_list->syncing_size(), 0);
+  ASSERT_EQ(chunk_list->queue_size(), 1);
+  ASSERT_TRUE((*chunk_list)[1].is_valid());
+
+  ASSERT_EQ(pread(fd, buffer, 4, chunk_size + 100), 4);
+  ASSERT_EQ(std::string(buffer, 4), "bbbb");
+  ASSERT_EQ(pread(fd, buffer, 4, chunk_size + 200), 4);
+  ASSERT_EQ(std::string(buffer, 4), "aaaa");
+
+  ASSERT_EQ(chunk_list->sync_chunks(torrent::ChunkList::sync_all |
+                                    torrent::ChunkList::sync_force),
+            0);
+  ASSERT_EQ(chunk_list->queue_size(), 0);
+  ASSERT_FALSE((*chunk_list)[1].is_valid());
+
+  ASSERT_EQ(pread(fd, buffer, 4, chunk_size + 200), 4);
+  ASSERT_EQ(std::string(buffer, 4), "cccc");
+
+  ::close(fd);
+  ::unlink(path);
+
+  CLEANUP_CHUNK_LIST();
+}
@@ -0,0 +1,205 @@
+#include <vector>
+
+#include "data/disk_scheduler.h"
+#include "data/hash_chunk.h"
+#include "torrent/exceptions.h"
+
+#include "test/helpers/fixture.h"
+
+class test_disk_scheduler : public test_fixture {};
+
+static const uint32_t chunk_size = 1 << 20;
+
+static torrent::DiskScheduler::location
+make_location(uint64_t device, uint64_t inode, uint64_t index) {
+  torrent::DiskScheduler::location loc;
+  loc.device = device;
+  loc.inode  = inode;
+  loc.offset = index * chunk_size;
+  return loc;
+}
+
+static std::vector<torrent::HashChunk*>
+pop_all(torrent::DiskScheduler* scheduler, unsigned int max_count) {
+  std::vector<torrent::HashChunk*> result;
+  torrent::HashChunk*              chunks[16];
+  unsigned int                     count;
+
+  while ((count = scheduler->pop(chunks, max_count)) != 0) {
+    result.insert(result.end(), chunks, chunks + count);
+    scheduler->finished(chunks, count);
+  }
+
+  return result;
+}
+
+TEST_F(test_disk_scheduler, test_elevator_order) {
+  torrent::DiskScheduler scheduler;
+  torrent::HashChunk     chunks[6];
+
+  // Two downloads interleaving their chunks, in different files.
+  scheduler.push(&chunks[0], make_location(1, 20, 0), chunk_size, false);
+  scheduler.push(&chunks[1], make_location(1, 10, 0), chunk_size, false);
+  scheduler.push(&chunks[2], make_location(1, 20, 1), chunk_size, false);
+  scheduler.push(&chunks[3], make_location(1, 10, 2), chunk_size, false);
+  scheduler.push(&chunks[4], make_location(1, 10, 1), chunk_size, false);
+
+  ASSERT_EQ(scheduler.size(), 5u);
+  ASSERT_EQ(pop_all(&scheduler, 1),
+            std::vector<torrent::HashChunk*>(
+              { &chunks[1], &chunks[4], &chunks[3], &chunks[0], &chunks[2] }));
+  ASSERT_TRUE(scheduler.empty());
+
+  // The head stays at the end of the last sweep, so positions behind
+  // it are served after those ahead.
+  scheduler.push(&chunks[0], make_location(1, 10, 0), chunk_size, false);
+  scheduler.push(&chunks[5], make_location(1, 30, 0), chunk_size, false);
+
+  ASSERT_EQ(pop_all(&scheduler, 1),
+            std::vector<torrent::HashChunk*>({ &chunks[5], &chunks[0] }));
+}
+
+TEST_F(test_disk_scheduler, test_device_limit) {
+  torrent::DiskScheduler scheduler;
+  torrent::HashChunk     chunks[4];
+  torrent::HashChunk*    popped[4];
+
+  scheduler.push(&chunks[0], make_location(1, 10, 0), chunk_size, false);
+  scheduler.push(&chunks[1], make_location(1, 10, 1), chunk_size, false);
+  scheduler.push(&chunks[2], make_location(2, 10, 0), chunk_size, false);
+  scheduler.push(&chunks[3], make_location(2, 10, 1), chunk_size, false);
+
+  ASSERT_EQ(scheduler.device_limit(), 1u);
+  ASSERT_EQ(scheduler.pop(popped, 1), 1u);
+  ASSERT_EQ(popped[0], &chunks[0]);
+  ASSERT_EQ(scheduler.pop(popped + 1, 1), 1u);
+  ASSERT_EQ(popped[1], &chunks[2]);
+
+  // Both devices are busy.
+  ASSERT_EQ(scheduler.pop(popped + 2, 1), 0u);
+
+  scheduler.finished(popped + 1, 1);
+  ASSERT_EQ(scheduler.pop(popped + 2, 1), 1u);
+  ASSERT_EQ(popped[2], &chunks[3]);
+  ASSERT_EQ(scheduler.pop(popped + 3, 1), 0u);
+
+  scheduler.set_device_limit(2);
+  ASSERT_EQ(scheduler.pop(popped + 3, 1), 1u);
+  ASSERT_EQ(popped[3], &chunks[1]);
+
+  scheduler.finished(popped, 1);
+  scheduler.finished(popped + 2, 1);
+  scheduler.finished(popped + 3, 1);
+
+  ASSERT_THROW(scheduler.finished(popped, 1), torrent::internal_error);
+  ASSERT_THROW(scheduler.set_device_limit(0), torrent::internal_error);
+}
+
+TEST_F(test_disk_scheduler, test_batches) {
+  torrent::DiskScheduler scheduler;
+  torrent::HashChunk     chunks[6];
+  torrent::HashChunk*    popped[6];
+
+  for (unsigned int i = 0; i < 4; i++)
+    scheduler.push(&chunks[i], make_location(1, 10, i), chunk_size, false);
+
+  scheduler.push(&chunks[4], make_location(1, 10, 4), chunk_size / 2, false);
+  scheduler.push(&chunks[5], make_location(1, 10, 5), chunk_size / 2, true);
+
+  // A batch holds a single slot on the device, and stops at chunks of
+  // a different size and those that must be hashed alone.
+  ASSERT_EQ(scheduler.pop(popped, 3), 3u);
+  ASSERT_EQ(scheduler.pop(popped + 3, 3), 0u);
+  scheduler.finished(popped, 3);
+
+  ASSERT_EQ(scheduler.pop(popped, 6), 1u);
+  ASSERT_EQ(popped[0], &chunks[3]);
+  scheduler.finished(popped, 1);
+
+  ASSERT_EQ(scheduler.pop(popped, 6), 1u);
+  ASSERT_EQ(popped[0], &chunks[4]);
+  scheduler.finished(popped, 1);
+
+  ASSERT_EQ(scheduler.pop(popped, 6), 1u);
+  ASSERT_EQ(popped[0], &chunks[5]);
+  scheduler.finished(popped, 1);
+}
+
+TEST_F(test_disk_scheduler, test_sweep_limit) {
+  torrent::DiskScheduler scheduler;
+  uint32_t               large_size = torrent::DiskScheduler::sweep_limit / 2;
+  torrent::HashChunk     chunks[4];
+  torrent::HashChunk*    popped;
+
+  // A large file is interrupted by the next file once the limit is
+  // reached.
+  for (unsigned int i = 0; i < 3; i++) {
+    auto loc   = make_location(1, 10, 0);
+    loc.offset = uint64_t(i) * large_size;
+    scheduler.push(&chunks[i], loc, large_size, false);
+  }
+
+  scheduler.push(&chunks[3], make_location(1, 20, 0), large_size, false);
+
+  std::vector<torrent::HashChunk*> order;
+
+  while (scheduler.pop(&popped, 1) != 0) {
+    order.push_back(popped);
+    scheduler.finished(&popped, 1);
+  }
+
+  ASSERT_EQ(order,
+            std::vector<torrent::HashChunk*>(
+              { &chunks[0], &chunks[1], &chunks[3], &chunks[2] }));
+}
+
+TEST_F(test_disk_scheduler, test_remove) {
+  torrent::DiskScheduler scheduler;
+  torrent::HashChunk     chunks[2];
+  torrent::HashChunk*    popped;
+
+  scheduler.push(&chunks[0], make_location(1, 10, 0), chunk_size, false);
+  scheduler.push(&chunks[1], make_location(1, 10, 1), chunk_size, false);
+
+  ASSERT_EQ(scheduler.pop(&popped, 1), 1u);
+  ASSERT_EQ(popped, &chunks[0]);
+
+  // Chunks being hashed can't be removed.
+  ASSERT_FALSE(scheduler.remove(&chunks[0]));
+  ASSERT_TRUE(scheduler.remove(&chunks[1]));
+  ASSERT_TRUE(scheduler.empty());
+
+  scheduler.finished(&popped, 1);
+}
+
+TEST_F(test_disk_scheduler, test_pop_device) {
+  torrent::DiskScheduler scheduler;
+  torrent::HashChunk     chunks[3];
+  torrent::HashChunk*    popped[2];
+
+  scheduler.push(&chunks[0], make_location(1, 10, 0), chunk_size, false);
+  scheduler.push(&chunks[1], make_location(2, 10, 0), chunk_size, false);
+  scheduler.push(&chunks[2], make_location(2, 10, 1), chunk_size, false);
+
+  ASSERT_EQ(scheduler.pending(1), 1u);
+  ASSERT_EQ(scheduler.pending(2), 2u);
+  ASSERT_EQ(scheduler.pending(3), 0u);
+
+  // Only the given device is served, within its limit.
+  ASSERT_EQ(scheduler.pop_device(2, popped, 1), 1u);
+  ASSERT_EQ(popped[0], &chunks[1]);
+  ASSERT_EQ(scheduler.pop_device(2, popped + 1, 1), 0u);
+  ASSERT_EQ(scheduler.pop_device(3, popped + 1, 1), 0u);
+
+  ASSERT_EQ(scheduler.pop_device(1, popped + 1, 1), 1u);
+  ASSERT_EQ(popped[1], &chunks[0]);
+
+  scheduler.finished(popped, 1);
+  scheduler.finished(popped + 1, 1);
+
+  ASSERT_EQ(scheduler.pop_device(2, popped, 2), 1u);
+  ASSERT_EQ(popped[0], &chunks[2]);
+  ASSERT_TRUE(scheduler.empty());
+
+  scheduler.finished(popped, 1);
+}
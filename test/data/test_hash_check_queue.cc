@@ -1,10 +1,17 @@
+#include <cstring>
 #include <functional>
 #include <mutex>
 #include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
 
 #include "data/chunk_handle.h"
+#include "data/socket_file.h"
 #include "thread_disk.h"
 #include "torrent/chunk_manager.h"
+#include "torrent/data/file.h"
+#include "torrent/data/file_manager.h"
 #include "torrent/exceptions.h"
 #include "torrent/poll_select.h"
 #include "utils/sha1.h"
@@ -102,6 +109,126 @@ TEST_F(test_hash_check_queue, test_multiple) {
   CLEANUP_CHUNK_LIST();
 }
 
+TEST_F(test_hash_check_queue, test_recheck) {
+  SETUP_CHUNK_LIST();
+  torrent::HashCheckQueue hash_queue;
+
+  done_chunks_type done_chunks;
+  hash_queue.slot_chunk_done() =
+    [&done_chunks](torrent::HashChunk*        hash_chunk,
+                   const torrent::HashString& hash_value) {
+      return chunk_done(&done_chunks, hash_chunk, hash_value);
+    };
+
+  handle_list                      handles;
+  std::vector<torrent::HashChunk*> chunks;
+
+  for (unsigned int i = 0; i < 20; i++) {
+    auto handle = chunk_list->get(i, torrent::ChunkList::get_blocking);
+    auto chunk  = new torrent::HashChunk(handle);
+    chunk->set_recheck(i % 2 == 0);
+
+    handles.push_back(handle);
+    chunks.push_back(chunk);
+    hash_queue.push_back(chunk);
+  }
+
+  // Rechecks are held by the disk scheduler.
+  ASSERT_EQ(hash_queue.size(), 10u);
+  ASSERT_EQ(hash_queue.scheduled_size(), 10u);
+
+  ASSERT_TRUE(hash_queue.remove(chunks[2]));
+  ASSERT_EQ(hash_queue.scheduled_size(), 9u);
+
+  hash_queue.perform();
+
+  ASSERT_TRUE(hash_queue.empty());
+  ASSERT_EQ(hash_queue.scheduled_size(), 0u);
+
+  for (unsigned int i = 0; i < 20; i++) {
+    if (i == 2) {
+      ASSERT_EQ(done_chunks.find(i), done_chunks.end());
+    } else {
+      ASSERT_NE(done_chunks.find(i), done_chunks.end());
+      ASSERT_EQ(done_chunks[i], hash_for_index(i));
+    }
+
+    chunk_list->release(&handles[i]);
+
+    delete chunks[i];
+  }
+
+  CLEANUP_CHUNK_LIST();
+}
+
+TEST_F(test_hash_check_queue, test_owners) {
+  SETUP_CHUNK_LIST();
+  torrent::HashCheckQueue hash_queue;
+
+  std::vector<uint32_t> done_order;
+  hash_queue.slot_chunk_done() =
+    [&done_order](torrent::HashChunk* hash_chunk, const torrent::HashString&) {
+      done_order.push_back(hash_chunk->handle().index());
+    };
+
+  // Large enough that each owner hashes two chunks per round.
+  const uint32_t chunk_size = 2 << 20;
+
+  chunk_list->slot_create_chunk() = [chunk_size](uint32_t, int) {
+    char* memory = (char*)mmap(nullptr,
+                               chunk_size,
+                               PROT_READ | PROT_WRITE,
+                               MAP_ANON | MAP_PRIVATE,
+                               -1,
+                               0);
+
+    if (memory == MAP_FAILED)
+      throw torrent::internal_error("test_owners: mmap failed.");
+
+    auto chunk = new torrent::Chunk();
+    chunk->push_back(torrent::ChunkPart::MAPPED_MMAP,
+                     torrent::MemoryChunk(memory,
+                                          memory,
+                                          memory + chunk_size,
+                                          torrent::MemoryChunk::prot_read,
+                                          0));
+    return chunk;
+  };
+
+  int                              owners[2];
+  handle_list                      handles;
+  std::vector<torrent::HashChunk*> chunks;
+
+  // The first owner queues all its chunks before the second.
+  for (unsigned int i = 0; i < 12; i++) {
+    auto handle = chunk_list->get(i, torrent::ChunkList::get_blocking);
+    auto chunk  = new torrent::HashChunk(handle);
+    chunk->set_owner(&owners[i / 6]);
+
+    handles.push_back(handle);
+    chunks.push_back(chunk);
+    hash_queue.push_back(chunk);
+  }
+
+  ASSERT_EQ(hash_queue.size(), 12u);
+  ASSERT_EQ(hash_queue.front(), chunks[0]);
+  ASSERT_EQ(hash_queue.back(), chunks[11]);
+
+  hash_queue.perform();
+
+  ASSERT_TRUE(hash_queue.empty());
+  ASSERT_EQ(done_order,
+            std::vector<uint32_t>({ 0, 1, 6, 7, 2, 3, 8, 9, 4, 5, 10, 11 }));
+
+  for (unsigned int i = 0; i < 12; i++) {
+    chunk_list->release(&handles[i]);
+
+    delete chunks[i];
+  }
+
+  CLEANUP_CHUNK_LIST();
+}
+
 TEST_F(test_hash_check_queue, test_erase) {
   // SETUP_CHUNK_LIST();
   // torrent::HashCheckQueue hash_queue;
@@ -172,3 +299,241 @@ TEST_F(test_hash_check_queue, test_thread) {
   CLEANUP_THREAD();
   CLEANUP_CHUNK_LIST();
 }
+
+TEST_F(test_hash_check_queue, test_thread_pool) {
+  SETUP_CHUNK_LIST();
+  SETUP_THREAD();
+  thread_disk->set_hash_thread_count(4);
+  thread_disk->start_thread();
+
+  ASSERT_EQ(thread_disk->hash_thread_count(), 4);
+
+  torrent::HashCheckQueue* hash_queue = thread_disk->hash_queue();
+
+  done_chunks_type done_chunks;
+  hash_queue->slot_chunk_done() =
+    [&done_chunks](torrent::HashChunk*        hash_chunk,
+                   const torrent::HashString& hash_value) {
+      return chunk_done(&done_chunks, hash_chunk, hash_value);
+    };
+
+  for (int i = 0; i < 100; i++) {
+    done_chunks_lock.lock();
+    done_chunks.clear();
+    done_chunks_lock.unlock();
+
+    handle_list                      handles;
+    std::vector<torrent::HashChunk*> chunks;
+
+    for (unsigned int index = 0; index < 20; index++) {
+      handles.push_back(
+        chunk_list->get(index, torrent::ChunkList::get_blocking));
+      chunks.push_back(new torrent::HashChunk(handles.back()));
+
+      hash_queue->push_back(chunks.back());
+      thread_disk->interrupt_hash();
+    }
+
+    for (unsigned int index = 0; index < 20; index++) {
+      ASSERT_TRUE(wait_for_true([&done_chunks, index] {
+        return verify_hash(&done_chunks, index, hash_for_index(index));
+      }));
+    }
+
+    for (unsigned int index = 0; index < 20; index++) {
+      chunk_list->release(&handles[index]);
+      delete chunks[index];
+    }
+  }
+
+  thread_disk->set_hash_thread_count(2);
+  ASSERT_EQ(thread_disk->hash_thread_count(), 2);
+
+  thread_disk->stop_thread();
+  CLEANUP_THREAD();
+  CLEANUP_CHUNK_LIST();
+}
+
+TEST_F(test_hash_check_queue, test_thread_pool_resize) {
+  SETUP_CHUNK_LIST();
+  SETUP_THREAD();
+  thread_disk->start_thread();
+
+  // The new workers are stopped before they have had a chance to
+  // become active.
+  for (int i = 0; i < 20; i++) {
+    thread_disk->set_hash_thread_count(4);
+    thread_disk->set_hash_thread_count(1);
+
+    ASSERT_EQ(thread_disk->hash_thread_count(), 1);
+  }
+
+  thread_disk->stop_thread();
+  CLEANUP_THREAD();
+  CLEANUP_CHUNK_LIST();
+}
+
+struct test_read_file : public torrent::File {
+  using torrent::File::set_frozen_path;
+};
+
+TEST_F(test_hash_check_queue, test_read_mode) {
+  SETUP_CHUNK_LIST();
+  torrent::HashCheckQueue hash_queue;
+
+  done_chunks_type done_chunks;
+  hash_queue.slot_chunk_done() =
+    [&done_chunks](torrent::HashChunk*        hash_chunk,
+                   const torrent::HashString& hash_value) {
+      return chunk_done(&done_chunks, hash_chunk, hash_value);
+    };
+
+  // Place the chunks so they straddle a page boundary in the file.
+  char path[] = "/tmp/test_hash_check_queue.XXXXXX";
+  int  fd     = mkstemp(path);
+  ASSERT_NE(fd, -1);
+
+  const uint64_t first = 4096 - 15;
+
+  for (uint32_t index = 0; index < 4; index++) {
+    char buffer[10];
+    std::memset(buffer, index, 10);
+    ASSERT_EQ(pwrite(fd, buffer, 10, first + index * 10), 10);
+  }
+
+  test_read_file file;
+  file.set_frozen_path(path);
+
+  chunk_list->slot_create_chunk() = [fd, first, &file](uint32_t index, int) {
+    torrent::MemoryChunk memory_chunk =
+      torrent::SocketFile(fd).create_chunk(first + index * 10,
+                                           10,
+                                           torrent::MemoryChunk::prot_read,
+                                           torrent::MemoryChunk::map_shared);
+
+    auto chunk = new torrent::Chunk();
+    chunk->push_back(torrent::ChunkPart::MAPPED_MMAP, memory_chunk);
+    chunk->back().set_file(&file, first + index * 10);
+    return chunk;
+  };
+
+  for (uint32_t mode : { torrent::ChunkManager::recheck_read_pread,
+                         torrent::ChunkManager::recheck_read_direct }) {
+    done_chunks.clear();
+
+    for (uint32_t index = 0; index < 4; index++) {
+      // The last chunk's file can't be opened, so it falls back to
+      // reading through the mapping.
+      file.set_frozen_path(index == 3 ? "/nonexistent/file" : path);
+
+      auto handle     = chunk_list->get(index, torrent::ChunkList::get_blocking);
+      auto hash_chunk = new torrent::HashChunk(handle);
+      hash_chunk->set_read_mode(mode);
+
+      ASSERT_EQ(hash_chunk->read_mode(), mode);
+
+      hash_queue.push_back(hash_chunk);
+      hash_queue.perform();
+
+      ASSERT_EQ(done_chunks[index], hash_for_index(index));
+
+      chunk_list->release(&handle);
+      delete hash_chunk;
+    }
+  }
+
+  ::close(fd);
+  ::unlink(path);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+TEST_F(test_hash_check_queue, test_devices) {
+  SETUP_CHUNK_LIST();
+  torrent::HashCheckQueue hash_queue;
+
+  std::vector<uint32_t> done_order;
+  hash_queue.slot_chunk_done() =
+    [&done_order](torrent::HashChunk* hash_chunk, const torrent::HashString&) {
+      done_order.push_back(hash_chunk->handle().index());
+    };
+
+  std::vector<uint64_t> interrupted;
+  hash_queue.slot_interrupt() = [&interrupted](uint64_t device) {
+    interrupted.push_back(device);
+  };
+
+  char path[] = "/tmp/test_hash_check_queue.XXXXXX";
+  int  fd     = mkstemp(path);
+  ASSERT_NE(fd, -1);
+  ::close(fd);
+
+  // Opening the file records the device it is stored on.
+  torrent::FileManager file_manager;
+  test_read_file       file;
+  file.set_frozen_path(path);
+
+  ASSERT_TRUE(
+    file_manager.open(&file, torrent::MemoryChunk::prot_read, 0));
+
+  uint64_t device = file.device();
+
+  if (device == 0) {
+    file_manager.close(&file);
+    ::unlink(path);
+    CLEANUP_CHUNK_LIST();
+    GTEST_SKIP() << "temporary file reports device 0";
+  }
+
+  // The even chunks are stored in the file, the odd ones have no
+  // file and so are on device 0.
+  auto create_chunk = chunk_list->slot_create_chunk();
+
+  chunk_list->slot_create_chunk() = [create_chunk, &file](uint32_t index,
+                                                          int      prot) {
+    torrent::Chunk* chunk = create_chunk(index, prot);
+
+    if (index % 2 == 0)
+      chunk->back().set_file(&file, 0);
+
+    return chunk;
+  };
+
+  handle_list                      handles;
+  std::vector<torrent::HashChunk*> chunks;
+
+  for (unsigned int i = 0; i < 4; i++) {
+    handles.push_back(chunk_list->get(i, torrent::ChunkList::get_blocking));
+    chunks.push_back(new torrent::HashChunk(handles.back()));
+    hash_queue.push_back(chunks.back());
+  }
+
+  ASSERT_EQ(interrupted, std::vector<uint64_t>({ device, 0, device, 0 }));
+  ASSERT_EQ(hash_queue.pending(device), 2u);
+  ASSERT_EQ(hash_queue.pending(0), 2u);
+
+  // A device thread only hashes the chunks of its own device.
+  hash_queue.perform(device);
+
+  ASSERT_EQ(done_order, std::vector<uint32_t>({ 0, 2 }));
+  ASSERT_EQ(hash_queue.pending(device), 0u);
+  ASSERT_EQ(hash_queue.size(), 2u);
+
+  hash_queue.perform(device + 1);
+  ASSERT_EQ(hash_queue.size(), 2u);
+
+  hash_queue.perform();
+
+  ASSERT_EQ(done_order, std::vector<uint32_t>({ 0, 2, 1, 3 }));
+  ASSERT_TRUE(hash_queue.empty());
+
+  for (unsigned int i = 0; i < 4; i++) {
+    chunk_list->release(&handles[i]);
+    delete chunks[i];
+  }
+
+  file_manager.close(&file);
+  ::unlink(path);
+
+  CLEANUP_CHUNK_LIST();
+}
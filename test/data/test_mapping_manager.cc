@@ -0,0 +1,84 @@
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+#include "data/mapping_manager.h"
+#include "torrent/data/file.h"
+
+#include "test/helpers/fixture.h"
+
+class test_mapping_manager : public test_fixture {};
+
+TEST_F(test_mapping_manager, test_windows) {
+  const uint32_t window_size = 16 * 4096;
+  const int      prot        = torrent::MemoryChunk::prot_read;
+
+  char path[] = "/tmp/test_mapping_manager.XXXXXX";
+  int  fd     = mkstemp(path);
+  ASSERT_NE(fd, -1);
+
+  std::string contents;
+
+  for (uint32_t i = 0; i < 4 * window_size; i++)
+    contents += char('a' + i % 26);
+
+  ASSERT_EQ(pwrite(fd, contents.data(), contents.size(), 0),
+            ssize_t(contents.size()));
+
+  torrent::File file;
+  file.set_file_descriptor(fd);
+  file.set_protection(prot);
+
+  torrent::MappingManager mapping_manager;
+  mapping_manager.set_window_size(window_size);
+  mapping_manager.set_address_budget(2 * window_size);
+
+  auto first = mapping_manager.create_chunk(&file, 100, 8192, prot);
+  ASSERT_TRUE(first.is_valid());
+  ASSERT_EQ(std::string(first.begin(), 8192), contents.substr(100, 8192));
+
+  auto second = mapping_manager.create_chunk(&file, 20000, 8192, prot);
+  ASSERT_TRUE(second.is_valid());
+  ASSERT_EQ(std::string(second.begin(), 8192), contents.substr(20000, 8192));
+  ASSERT_EQ(mapping_manager.size(), 1);
+  ASSERT_EQ(mapping_manager.usage(), window_size);
+
+  // Ranges crossing a window boundary are left to the caller.
+  ASSERT_FALSE(
+    mapping_manager.create_chunk(&file, window_size - 100, 8192, prot)
+      .is_valid());
+
+  auto third = mapping_manager.create_chunk(&file, window_size, 8192, prot);
+  ASSERT_TRUE(third.is_valid());
+  ASSERT_EQ(mapping_manager.size(), 2);
+
+  // Both windows are referenced, so a third does not fit the budget.
+  ASSERT_FALSE(
+    mapping_manager.create_chunk(&file, 2 * window_size, 8192, prot)
+      .is_valid());
+
+  mapping_manager.release(first);
+  mapping_manager.release(second);
+  ASSERT_EQ(mapping_manager.size(), 2);
+
+  auto fourth =
+    mapping_manager.create_chunk(&file, 2 * window_size + 4096, 8192, prot);
+  ASSERT_TRUE(fourth.is_valid());
+  ASSERT_EQ(std::string(fourth.begin(), 8192),
+            contents.substr(2 * window_size + 4096, 8192));
+  ASSERT_EQ(mapping_manager.size(), 2);
+  ASSERT_EQ(mapping_manager.usage(), 2 * window_size);
+
+  // Referenced windows of an erased file are unmapped once released.
+  mapping_manager.erase(&file);
+  ASSERT_EQ(mapping_manager.size(), 2);
+
+  mapping_manager.release(third);
+  mapping_manager.release(fourth);
+  ASSERT_EQ(mapping_manager.size(), 0);
+  ASSERT_EQ(mapping_manager.usage(), 0);
+
+  file.set_file_descriptor(-1);
+  ::close(fd);
+  ::unlink(path);
+}
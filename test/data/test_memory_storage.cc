@@ -0,0 +1,49 @@
+#include <cstring>
+#include <string>
+
+#include "data/memory_storage.h"
+#include "torrent/data/file.h"
+
+#include "test/helpers/fixture.h"
+
+class test_memory_storage : public test_fixture {};
+
+namespace {
+
+class test_file : public torrent::File {
+public:
+  using File::set_size_bytes;
+};
+
+} // namespace
+
+TEST_F(test_memory_storage, test_basic) {
+  const int prot = torrent::MemoryChunk::prot_read |
+                   torrent::MemoryChunk::prot_write;
+
+  torrent::MemoryStorage storage;
+  ASSERT_FALSE(storage.is_file_backed());
+
+  test_file file;
+  file.set_size_bytes(3 * 4096 + 100);
+
+  torrent::ChunkPart::mapped_type mapped;
+
+  auto first = storage.create_chunk(&file, 4000, 200, prot, &mapped);
+  ASSERT_TRUE(first.is_valid());
+  ASSERT_EQ(mapped, torrent::ChunkPart::MAPPED_STATIC);
+  ASSERT_EQ(first.size(), 200);
+  ASSERT_EQ(first.ptr() + 4000, first.begin());
+
+  std::memcpy(first.begin(), "abcd", 4);
+
+  // Parts of the same file share the memory.
+  auto second = storage.create_chunk(&file, 4000, 4096, prot, &mapped);
+  ASSERT_TRUE(second.is_valid());
+  ASSERT_EQ(std::string(second.begin(), 4), "abcd");
+
+  ASSERT_FALSE(
+    storage.create_chunk(&file, 3 * 4096, 101, prot, &mapped).is_valid());
+
+  storage.erase_file(&file);
+}
@@ -0,0 +1,215 @@
+#include <cstdlib>
+#include <list>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+#include "data/chunk_list.h"
+#include "data/prefetch_queue.h"
+#include "download/download_constructor.h"
+#include "download/download_wrapper.h"
+#include "globals.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/data/file.h"
+#include "torrent/data/file_list.h"
+#include "torrent/object.h"
+
+#include "test/helpers/fixture.h"
+
+class test_prefetch_queue : public test_fixture {
+protected:
+  static constexpr uint32_t chunk_size  = 2 << 14;
+  static constexpr uint32_t block_size  = 1 << 14;
+  static constexpr uint32_t chunk_count = 4;
+
+  // Files 'a' and 'b' are 48 and 80 KiB, so chunk 1 spans both.
+  void SetUp() override {
+    test_fixture::SetUp();
+
+    torrent::cachedTime = torrent::utils::timer::current();
+
+    char path[] = "/tmp/test_prefetch_queue.XXXXXX";
+    m_fd        = mkstemp(path);
+    ASSERT_NE(m_fd, -1);
+
+    m_path = path;
+
+    torrent::Object torrent = torrent::Object::create_map();
+    torrent::Object& info =
+      torrent.insert_key("info", torrent::Object::create_map());
+
+    info.insert_key("name", "data");
+    info.insert_key("piece length", (int64_t)chunk_size);
+    info.insert_key("pieces", std::string(20 * chunk_count, 'p'));
+
+    auto& files = info.insert_key("files", torrent::Object::create_list());
+
+    for (auto [name, length] : { std::pair{ "a", 48 << 10 },
+                                 std::pair{ "b", 80 << 10 } }) {
+      files.as_list().push_back(torrent::Object::create_map());
+      files.as_list().back().insert_key("length", (int64_t)length);
+      files.as_list()
+        .back()
+        .insert_key("path", torrent::Object::create_list())
+        .as_list()
+        .push_back(name);
+    }
+
+    torrent::EncodingList        encodings;
+    torrent::DownloadConstructor ctor;
+
+    ctor.set_download(&m_wrapper);
+    ctor.set_encoding_list(&encodings);
+    ctor.initialize(torrent);
+
+    // The files only need to look open, the queue prefetches through
+    // duplicates of their descriptors.
+    for (auto file : *file_list()) {
+      file->set_file_descriptor(m_fd);
+      file->set_protection(torrent::MemoryChunk::prot_read);
+    }
+
+    m_chunk_list.set_manager(&m_chunk_manager);
+    m_chunk_list.set_chunk_size(chunk_size);
+    m_chunk_list.resize(chunk_count);
+  }
+
+  void TearDown() override {
+    for (auto file : *file_list())
+      file->set_file_descriptor(-1);
+
+    ::close(m_fd);
+    ::unlink(m_path.c_str());
+
+    test_fixture::TearDown();
+  }
+
+  torrent::FileList* file_list() {
+    return m_wrapper.file_list();
+  }
+
+  bool is_prefetched(uint32_t index) {
+    return m_chunk_list[index].time_preloaded() == torrent::cachedTime;
+  }
+
+  int         m_fd{ -1 };
+  std::string m_path;
+
+  torrent::DownloadWrapper m_wrapper;
+  torrent::ChunkManager    m_chunk_manager;
+  torrent::ChunkList       m_chunk_list;
+  torrent::PrefetchQueue   m_queue;
+
+  int m_owner;
+  int m_other_owner;
+};
+
+TEST_F(test_prefetch_queue, test_upcoming_pieces) {
+  std::list<torrent::Piece> upcoming{
+    torrent::Piece(0, block_size, block_size),
+    torrent::Piece(1, 0, block_size),
+    torrent::Piece(2, block_size, block_size),
+  };
+
+  // The tails of chunks 0, 1 and 2 are queued, with chunk 1 split
+  // between the two files.
+  ASSERT_EQ(m_queue.push_pieces(&m_owner,
+                                &m_chunk_list,
+                                file_list(),
+                                torrent::Piece(0, 0, block_size),
+                                upcoming,
+                                1 << 20),
+            2 * chunk_size + block_size);
+  ASSERT_EQ(m_queue.size(), 4);
+
+  ASSERT_TRUE(is_prefetched(0));
+  ASSERT_TRUE(is_prefetched(1));
+  ASSERT_TRUE(is_prefetched(2));
+  ASSERT_FALSE(is_prefetched(3));
+
+  m_queue.perform(0, nullptr);
+  ASSERT_EQ(m_queue.size(), 0);
+}
+
+TEST_F(test_prefetch_queue, test_upcoming_pieces_budget) {
+  std::list<torrent::Piece> upcoming{
+    torrent::Piece(1, 0, block_size),
+    torrent::Piece(2, 0, block_size),
+  };
+
+  // The budget ends within chunk 1, which is left to be continued by
+  // the next call.
+  ASSERT_EQ(m_queue.push_pieces(&m_owner,
+                                &m_chunk_list,
+                                file_list(),
+                                torrent::Piece(0, 0, block_size),
+                                upcoming,
+                                chunk_size + block_size / 2),
+            chunk_size + block_size / 2);
+
+  ASSERT_TRUE(is_prefetched(0));
+  ASSERT_FALSE(is_prefetched(1));
+  ASSERT_FALSE(is_prefetched(2));
+
+  ASSERT_EQ(m_queue.push_pieces(&m_owner,
+                                &m_chunk_list,
+                                file_list(),
+                                torrent::Piece(1, 0, block_size),
+                                upcoming,
+                                chunk_size),
+            chunk_size);
+
+  // The rest of chunk 1 is queued without the part still pending, as
+  // one job for each file.
+  ASSERT_TRUE(is_prefetched(1));
+  ASSERT_EQ(m_queue.size(), 4);
+}
+
+TEST_F(test_prefetch_queue, test_dedup) {
+  torrent::Piece piece(1, 0, block_size);
+
+  ASSERT_EQ(m_queue.push_pieces(
+              &m_owner, &m_chunk_list, file_list(), piece, {}, 1 << 20),
+            chunk_size);
+  ASSERT_EQ(m_queue.size(), 2);
+
+  // Chunks prefetched recently are skipped.
+  ASSERT_EQ(m_queue.push_pieces(
+              &m_owner, &m_chunk_list, file_list(), piece, {}, 1 << 20),
+            0);
+
+  // Ranges that are still pending are not queued again, whoever
+  // requests them.
+  ASSERT_TRUE(
+    m_queue.push_back(&m_other_owner, file_list(), chunk_size, chunk_size));
+  ASSERT_TRUE(
+    m_queue.push_back(&m_other_owner, file_list(), chunk_size + 100, 100));
+  ASSERT_EQ(m_queue.size(), 2);
+
+  ASSERT_TRUE(m_queue.push_back(&m_other_owner, file_list(), 0, chunk_size));
+  ASSERT_EQ(m_queue.size(), 3);
+}
+
+TEST_F(test_prefetch_queue, test_erase) {
+  std::list<torrent::Piece> upcoming{ torrent::Piece(1, 0, block_size) };
+
+  m_queue.push_pieces(&m_owner,
+                      &m_chunk_list,
+                      file_list(),
+                      torrent::Piece(0, 0, block_size),
+                      upcoming,
+                      1 << 20);
+  m_queue.push_back(&m_other_owner, file_list(), 2 * chunk_size, chunk_size);
+  ASSERT_EQ(m_queue.size(), 4);
+
+  // Only the owner's ranges overlapping the cancelled chunk are
+  // dropped.
+  ASSERT_EQ(m_queue.erase(&m_other_owner, chunk_size, chunk_size), 0);
+  ASSERT_EQ(m_queue.erase(&m_owner, chunk_size, chunk_size), 2);
+  ASSERT_EQ(m_queue.size(), 2);
+
+  // Choking drops what is left for the owner.
+  ASSERT_EQ(m_queue.erase(&m_owner, 0, chunk_size * chunk_count), 1);
+  ASSERT_EQ(m_queue.size(), 1);
+  ASSERT_EQ(m_queue.pending(0), 1);
+}
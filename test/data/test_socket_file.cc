@@ -0,0 +1,37 @@
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+#include "data/socket_file.h"
+
+#include "test/helpers/fixture.h"
+
+class test_socket_file : public test_fixture {};
+
+TEST_F(test_socket_file, test_punch_hole) {
+  char path[] = "/tmp/test_socket_file.XXXXXX";
+  int  fd     = mkstemp(path);
+  ASSERT_NE(fd, -1);
+
+  std::string data(3 * 65536, 'x');
+  ASSERT_EQ(::write(fd, data.c_str(), data.size()), ssize_t(data.size()));
+
+  torrent::SocketFile file(fd);
+
+  ASSERT_TRUE(file.punch_hole(65536, 65536));
+  ASSERT_EQ(file.size(), data.size());
+
+  // The tail is released by truncation if holes are not supported.
+  ASSERT_TRUE(file.punch_hole(2 * 65536, 65536));
+  ASSERT_EQ(file.size(), data.size());
+
+  std::string result(data.size(), '\0');
+  ASSERT_EQ(::pread(fd, &result[0], result.size(), 0), ssize_t(data.size()));
+
+  ASSERT_EQ(result.substr(0, 65536), std::string(65536, 'x'));
+  ASSERT_EQ(result.substr(65536), std::string(2 * 65536, '\0'));
+
+  file.close();
+  ::unlink(path);
+}
@@ -0,0 +1,220 @@
+#include "torrent/buildinfo.h"
+
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "net/socket_stream.h"
+
+#include "test/helpers/fixture.h"
+
+class test_socket_stream : public test_fixture {};
+
+namespace {
+
+class test_stream : public torrent::SocketStream {
+public:
+  test_stream(int fd) {
+    set_fd(torrent::SocketFd(fd));
+  }
+  ~test_stream() override {
+    get_fd().close();
+    get_fd().clear();
+  }
+
+  void event_read() override {}
+  void event_write() override {}
+  void event_error() override {}
+};
+
+} // namespace
+
+TEST_F(test_socket_stream, test_write_vector) {
+  int fds[2];
+  ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  test_stream stream(fds[0]);
+
+  char  header[] = "header:";
+  char  first[]  = "first,";
+  char  second[] = "second";
+  iovec iov[]    = { { header, 7 }, { first, 6 }, { second, 6 } };
+
+  ASSERT_EQ(stream.write_vector_throws(iov, 3), 19);
+
+  char buffer[32];
+  ASSERT_EQ(::read(fds[1], buffer, sizeof(buffer)), 19);
+  ASSERT_EQ(std::string(buffer, 19), "header:first,second");
+
+  ::close(fds[1]);
+}
+
+TEST_F(test_socket_stream, test_read_vector) {
+  int fds[2];
+  ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  test_stream stream(fds[0]);
+
+  ASSERT_EQ(::write(fds[1], "block-end|header", 16), 16);
+
+  char  block[9];
+  char  header[13];
+  iovec iov[] = { { block, sizeof(block) }, { header, sizeof(header) } };
+
+  ASSERT_EQ(stream.read_vector_throws(iov, 2), 16);
+  ASSERT_EQ(std::string(block, 9), "block-end");
+  ASSERT_EQ(std::string(header, 7), "|header");
+
+  ::close(fds[1]);
+
+  ASSERT_THROW(stream.read_vector_throws(iov, 2), torrent::close_connection);
+}
+
+TEST_F(test_socket_stream, test_write_file) {
+  int fds[2];
+  ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  test_stream stream(fds[0]);
+
+  char path[] = "/tmp/test_socket_stream_XXXXXX";
+  int  fd     = ::mkstemp(path);
+  ASSERT_NE(fd, -1);
+  ::unlink(path);
+
+  ASSERT_EQ(::write(fd, "skipped:file data", 17), 17);
+
+  int result = stream.write_file_throws(fd, 8, 9);
+
+#ifdef LT_HAVE_SENDFILE
+  ASSERT_EQ(result, 9);
+
+  char buffer[32];
+  ASSERT_EQ(::read(fds[1], buffer, sizeof(buffer)), 9);
+  ASSERT_EQ(std::string(buffer, 9), "file data");
+#else
+  ASSERT_EQ(result, -1);
+#endif
+
+  ::close(fd);
+  ::close(fds[1]);
+}
+
+TEST_F(test_socket_stream, test_write_zerocopy) {
+  int listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(listen_fd, -1);
+
+  sockaddr_in sa{};
+  socklen_t   sa_length = sizeof(sa);
+  sa.sin_family         = AF_INET;
+  sa.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+
+  ASSERT_EQ(::bind(listen_fd, (sockaddr*)&sa, sizeof(sa)), 0);
+  ASSERT_EQ(::listen(listen_fd, 1), 0);
+  ASSERT_EQ(::getsockname(listen_fd, (sockaddr*)&sa, &sa_length), 0);
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_EQ(::connect(fd, (sockaddr*)&sa, sizeof(sa)), 0);
+
+  int peer_fd = ::accept(listen_fd, nullptr, nullptr);
+  ASSERT_NE(peer_fd, -1);
+  ::close(listen_fd);
+
+  test_stream stream(fd);
+
+  if (!stream.get_fd().set_zerocopy(true)) {
+    ::close(peer_fd);
+    GTEST_SKIP() << "MSG_ZEROCOPY not supported";
+  }
+
+  std::string data(16 << 10, 'z');
+  ASSERT_EQ(stream.write_zerocopy_throws(data.data(), data.size()),
+            int(data.size()));
+
+  std::string received;
+  char        buffer[4096];
+
+  while (received.size() < data.size()) {
+    ssize_t r = ::read(peer_fd, buffer, sizeof(buffer));
+    ASSERT_GT(r, 0);
+    received.append(buffer, r);
+  }
+
+  ASSERT_EQ(received, data);
+
+  pollfd pfd{ fd, 0, 0 };
+  ASSERT_EQ(::poll(&pfd, 1, 1000), 1);
+  ASSERT_TRUE(pfd.revents & POLLERR);
+
+  uint32_t last   = ~uint32_t();
+  bool     copied = false;
+
+  ASSERT_TRUE(stream.read_zerocopy_completions(&last, &copied));
+  ASSERT_EQ(last, 0);
+  ASSERT_FALSE(stream.read_zerocopy_completions(&last, &copied));
+
+  ::close(peer_fd);
+}
+
+TEST_F(test_socket_stream, test_write_corked) {
+  int listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(listen_fd, -1);
+
+  sockaddr_in sa{};
+  socklen_t   sa_length = sizeof(sa);
+  sa.sin_family         = AF_INET;
+  sa.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+
+  ASSERT_EQ(::bind(listen_fd, (sockaddr*)&sa, sizeof(sa)), 0);
+  ASSERT_EQ(::listen(listen_fd, 1), 0);
+  ASSERT_EQ(::getsockname(listen_fd, (sockaddr*)&sa, &sa_length), 0);
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_EQ(::connect(fd, (sockaddr*)&sa, sizeof(sa)), 0);
+
+  int peer_fd = ::accept(listen_fd, nullptr, nullptr);
+  ASSERT_NE(peer_fd, -1);
+  ::close(listen_fd);
+
+  test_stream stream(fd);
+
+  if (!stream.get_fd().set_cork(true)) {
+    ::close(peer_fd);
+    GTEST_SKIP() << "TCP_CORK not supported";
+  }
+
+  char path[]  = "/tmp/test_socket_stream_XXXXXX";
+  int  file_fd = ::mkstemp(path);
+  ASSERT_NE(file_fd, -1);
+  ::unlink(path);
+
+  ASSERT_EQ(::write(file_fd, "piece data", 10), 10);
+
+  // The header is held back until the payload follows and the socket
+  // gets uncorked.
+  ASSERT_EQ(stream.write_stream_throws("header:", 7), 7);
+
+  pollfd pfd{ peer_fd, POLLIN, 0 };
+  ASSERT_EQ(::poll(&pfd, 1, 50), 0);
+
+  int result = stream.write_file_throws(file_fd, 0, 10);
+
+  if (result == -1)
+    result = stream.write_stream_throws("piece data", 10);
+
+  ASSERT_EQ(result, 10);
+  ASSERT_EQ(::poll(&pfd, 1, 50), 0);
+
+  ASSERT_TRUE(stream.get_fd().set_cork(false));
+  ASSERT_EQ(::poll(&pfd, 1, 1000), 1);
+
+  char buffer[32];
+  ASSERT_EQ(::read(peer_fd, buffer, sizeof(buffer)), 17);
+  ASSERT_EQ(std::string(buffer, 17), "header:piece data");
+
+  ::close(file_fd);
+  ::close(peer_fd);
+}
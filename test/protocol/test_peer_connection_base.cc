@@ -0,0 +1,539 @@
+#include <cstdlib>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "data/chunk.h"
+#include "download/download_main.h"
+#include "download/download_wrapper.h"
+#include "globals.h"
+#include "manager.h"
+#include "net/throttle_list.h"
+#include "protocol/peer_connection_base.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/data/block_transfer.h"
+#include "torrent/data/file_list.h"
+#include "torrent/data/file_manager.h"
+#include "torrent/data/piece.h"
+#include "torrent/download.h"
+#include "torrent/hash_string.h"
+#include "torrent/object.h"
+#include "torrent/peer/peer_info.h"
+#include "torrent/torrent.h"
+#include "torrent/utils/socket_address.h"
+#include "torrent/utils/timer.h"
+
+#include "test/helpers/fixture.h"
+
+namespace {
+
+// Sets up just enough of a connection to upload pieces of 'download'
+// to 'fd', or download them from it, with the throttles disabled.
+class test_connection : public torrent::PeerConnectionBase {
+public:
+  test_connection(torrent::DownloadMain* download, int fd) {
+    set_fd(torrent::SocketFd(fd));
+
+    m_download = download;
+    m_up->set_throttle(&m_throttle);
+
+    m_peerChunks.upload_throttle()->set_list_iterator(m_throttle.end());
+    m_peerChunks.download_throttle()->set_list_iterator(m_throttle.end());
+    m_throttle.insert(m_peerChunks.upload_throttle());
+  }
+
+  ~test_connection() override {
+    if (m_request_list.is_downloading() &&
+        m_request_list.transfer()->is_finished())
+      m_request_list.finished();
+
+    m_request_list.clear();
+
+    down_chunk_release();
+    up_chunk_release();
+
+    for (auto node : { m_peerChunks.upload_throttle(),
+                       m_peerChunks.download_throttle() })
+      if (m_throttle.is_throttled(node))
+        m_throttle.erase(node);
+    get_fd().clear();
+  }
+
+  void initialize_custom() override {}
+  void update_interested() override {}
+  bool receive_keepalive() override {
+    return true;
+  }
+
+  void event_read() override {}
+  void event_write() override {}
+
+  torrent::ProtocolBase* up() {
+    return m_up;
+  }
+  const torrent::Piece& up_piece() const {
+    return m_upPiece;
+  }
+
+  bool is_up_sendfile() const {
+    return m_upSendfile;
+  }
+  void set_up_sendfile(bool state) {
+    m_upSendfile = state;
+  }
+
+  // Buffers the header of 'piece' after any messages already in the
+  // buffer, like PeerConnection::fill_write_buffer.
+  void prepare_piece(const torrent::Piece& piece) {
+    m_upPiece = piece;
+    m_up->write_piece(piece);
+    m_up->set_state(ProtocolWrite::MSG);
+  }
+
+  // Follows PeerConnection::event_write for unencrypted pieces in the
+  // MSG state, returns true once the buffered messages are written.
+  bool write(bool batch) {
+    load_up_chunk();
+    up_chunk_vectored(batch);
+
+    return m_up->get_state() != ProtocolWrite::MSG;
+  }
+
+  // Requests pieces from 'peer_info' as if it were a seeder.
+  void set_seeder(torrent::PeerInfo* peer_info) {
+    m_peerChunks.set_peer_info(peer_info);
+    m_peerChunks.bitfield()->set_size_bits(
+      m_download->file_list()->size_chunks());
+    m_peerChunks.bitfield()->allocate();
+    m_peerChunks.bitfield()->set_all();
+
+    m_down->set_throttle(&m_throttle);
+    m_throttle.insert(m_peerChunks.download_throttle());
+
+    m_request_list.set_delegator(m_download->delegator());
+    m_request_list.set_peer_chunks(&m_peerChunks);
+  }
+
+  void set_encryption(const torrent::RC4& decrypt) {
+    m_encryption.set_encrypt(decrypt);
+    m_encryption.set_decrypt(decrypt);
+  }
+
+  torrent::ProtocolBase* down() {
+    return m_down;
+  }
+  torrent::BlockTransfer* transfer() {
+    return m_request_list.transfer();
+  }
+
+  bool is_down_header_read() const {
+    return m_downHeaderRead;
+  }
+
+  // Requests two blocks and starts receiving the first, so another
+  // piece is expected after it.
+  torrent::Piece start_piece() {
+    const torrent::Piece* piece = m_request_list.delegate();
+
+    if (piece == nullptr || m_request_list.delegate() == nullptr ||
+        !down_chunk_start(*piece))
+      throw torrent::internal_error("test_connection could not start piece");
+
+    return m_request_list.transfer()->piece();
+  }
+
+  bool read_piece() {
+    return down_chunk();
+  }
+
+  std::string chunk_data(const torrent::Piece& piece) {
+    std::string result(piece.length(), '\0');
+
+    m_downChunk.chunk()->to_buffer(
+      result.data(), piece.offset(), piece.length());
+    return result;
+  }
+
+private:
+  torrent::ThrottleList m_throttle;
+};
+
+} // namespace
+
+class test_peer_connection_base : public test_fixture {
+protected:
+  static constexpr uint32_t chunk_size = 1 << 16;
+
+  void SetUp() override {
+    test_fixture::SetUp();
+
+    char path[] = "/tmp/test_peer_connection_base.XXXXXX";
+    ASSERT_NE(mkdtemp(path), nullptr);
+    m_root = path;
+
+    m_data.resize(2 * chunk_size);
+
+    for (size_t i = 0; i < m_data.size(); i++)
+      m_data[i] = static_cast<char>(i * 7 + i / 251);
+
+    FILE* file = fopen((m_root + "/a").c_str(), "w");
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(fwrite(m_data.data(), 1, m_data.size(), file), m_data.size());
+    fclose(file);
+
+    torrent::cachedTime = torrent::utils::timer::current();
+    torrent::manager    = new torrent::Manager;
+    torrent::manager->file_manager()->set_max_open_files(16);
+    torrent::manager->chunk_manager()->set_sync_queue(nullptr);
+
+    m_download = create_download();
+    m_download.open();
+  }
+
+  void TearDown() override {
+    m_connection.reset();
+    m_peer_info.reset();
+
+    if (m_pipe[0] != -1)
+      ::close(m_pipe[0]);
+    if (m_pipe[1] != -1)
+      ::close(m_pipe[1]);
+
+    torrent::download_remove(m_download);
+
+    delete torrent::manager;
+    torrent::manager = nullptr;
+
+    ::unlink((m_root + "/a").c_str());
+    ::rmdir(m_root.c_str());
+
+    test_fixture::TearDown();
+  }
+
+  torrent::Download create_download() {
+    auto  torrent = new torrent::Object(torrent::Object::create_map());
+    auto& info    = torrent->insert_key("info", torrent::Object::create_map());
+    auto& files   = info.insert_key("files", torrent::Object::create_list());
+
+    files.as_list().push_back(torrent::Object::create_map());
+    files.as_list().back().insert_key("length", (int64_t)m_data.size());
+    files.as_list()
+      .back()
+      .insert_key("path", torrent::Object::create_list())
+      .as_list()
+      .push_back("a");
+
+    torrent->insert_key("announce", "udp://127.0.0.1:6969");
+
+    info.insert_key("name", "test");
+    info.insert_key("piece length", (int64_t)chunk_size);
+    info.insert_key("pieces", std::string(20 * 2, 'p'));
+
+    torrent::Download download = torrent::download_add(torrent);
+    download.file_list()->set_root_dir(m_root);
+
+    return download;
+  }
+
+  // A pipe holding a single page takes exactly that much of a write
+  // whenever it is empty, making the short writes predictable.
+  void open_pipe() {
+    ASSERT_EQ(::pipe2(m_pipe, O_NONBLOCK), 0);
+
+    m_capacity = ::fcntl(m_pipe[1], F_SETPIPE_SZ, 4096);
+    ASSERT_GT(m_capacity, 0);
+
+    m_connection =
+      std::make_unique<test_connection>(m_download.ptr()->main(), m_pipe[1]);
+  }
+
+  // Hash checks the download with nothing completed so that pieces
+  // can be requested, and lets the connection read from a socket.
+  void open_read_socket() {
+    m_download.set_bitfield(false);
+    ASSERT_TRUE(m_download.hash_check(true));
+
+    torrent::utils::priority_queue_perform(&torrent::taskScheduler,
+                                           torrent::cachedTime);
+
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, m_pipe),
+              0);
+
+    torrent::utils::socket_address address;
+
+    m_peer_info = std::make_unique<torrent::PeerInfo>(address.c_sockaddr());
+    m_connection =
+      std::make_unique<test_connection>(m_download.ptr()->main(), m_pipe[0]);
+    m_connection->set_seeder(m_peer_info.get());
+  }
+
+  void send(const std::string& data) {
+    ASSERT_EQ(::write(m_pipe[1], data.data(), data.size()),
+              ssize_t(data.size()));
+  }
+
+  std::string buffered() {
+    auto buffer = m_connection->down()->buffer();
+
+    return std::string(reinterpret_cast<char*>(buffer->position()),
+                       buffer->remaining());
+  }
+
+  void drain() {
+    char buffer[4096];
+    int  result;
+
+    while ((result = ::read(m_pipe[0], buffer, sizeof(buffer))) > 0)
+      m_output.append(buffer, result);
+  }
+
+  // Keeps writing and emptying the pipe until the buffered messages
+  // are written.
+  void write_all(bool batch) {
+    for (int i = 0; i != 1024; i++) {
+      bool done = m_connection->write(batch);
+
+      drain();
+
+      if (done)
+        return;
+    }
+
+    FAIL() << "the connection did not finish writing";
+  }
+
+  void queue_piece(const torrent::Piece& piece) {
+    m_connection->peer_chunks()->upload_queue()->push_back(piece);
+  }
+
+  static void append_32(std::string* buffer, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+      buffer->push_back(static_cast<char>(value >> shift));
+  }
+
+  static std::string piece_header(const torrent::Piece& piece) {
+    std::string result;
+
+    append_32(&result, 9 + piece.length());
+    result.push_back(torrent::ProtocolBase::PIECE);
+    append_32(&result, piece.index());
+    append_32(&result, piece.offset());
+    return result;
+  }
+
+  static std::string block_data(uint32_t length) {
+    std::string result(length, '\0');
+
+    for (size_t i = 0; i < result.size(); i++)
+      result[i] = static_cast<char>(i * 13 + 5);
+
+    return result;
+  }
+
+  std::string expected_piece(const torrent::Piece& piece) {
+    return piece_header(piece) +
+           m_data.substr(piece.index() * chunk_size + piece.offset(),
+                         piece.length());
+  }
+
+  std::string                         m_root;
+  std::string                         m_data;
+  std::string                         m_output;
+  torrent::Download                   m_download;
+  int                                 m_pipe[2]{ -1, -1 };
+  int                                 m_capacity{ 0 };
+  std::unique_ptr<torrent::PeerInfo>  m_peer_info;
+  std::unique_ptr<test_connection>    m_connection;
+};
+
+TEST_F(test_peer_connection_base, test_up_short_write_piece) {
+  open_pipe();
+
+  torrent::Piece piece(0, 0, 16384);
+  std::string    expected =
+    std::string("\0\0\0\5\4\0\0\0\1", 9) + expected_piece(piece);
+
+  m_connection->up()->write_have(1);
+  m_connection->prepare_piece(piece);
+
+  write_all(false);
+
+  uint32_t sent = m_capacity - torrent::ProtocolBase::sizeof_have -
+                  torrent::ProtocolBase::sizeof_piece;
+
+  ASSERT_EQ(m_connection->up()->get_state(),
+            torrent::ProtocolBase::WRITE_PIECE);
+  ASSERT_EQ(m_connection->up()->buffer()->remaining(), 0u);
+  ASSERT_EQ(m_connection->up_piece(),
+            torrent::Piece(0, sent, piece.length() - sent));
+  ASSERT_EQ(m_output, expected.substr(0, m_capacity));
+}
+
+TEST_F(test_peer_connection_base, test_up_short_write_header) {
+  open_pipe();
+
+  uint32_t       length = m_capacity - torrent::ProtocolBase::sizeof_piece - 5;
+  torrent::Piece first(0, 0, length);
+  torrent::Piece second(0, length, 2000);
+
+  m_connection->prepare_piece(first);
+  queue_piece(second);
+
+  ASSERT_FALSE(m_connection->write(true));
+  ASSERT_EQ(m_connection->up_piece(), second);
+  ASSERT_TRUE(m_connection->peer_chunks()->upload_queue()->empty());
+  ASSERT_EQ(m_connection->up()->buffer()->remaining(),
+            torrent::ProtocolBase::sizeof_piece - 5);
+
+  drain();
+  write_all(true);
+
+  ASSERT_EQ(m_connection->up()->get_state(), torrent::ProtocolBase::IDLE);
+  ASSERT_EQ(m_connection->up_piece().length(), 0u);
+  ASSERT_EQ(m_output, expected_piece(first) + expected_piece(second));
+}
+
+TEST_F(test_peer_connection_base, test_up_short_write_boundary) {
+  open_pipe();
+
+  uint32_t       length = m_capacity - torrent::ProtocolBase::sizeof_piece;
+  torrent::Piece first(0, 0, length);
+  torrent::Piece second(0, length, 2000);
+
+  m_connection->prepare_piece(first);
+  queue_piece(second);
+
+  // The header of the second piece is dropped from the buffer, and the
+  // piece is left queued.
+  write_all(true);
+
+  ASSERT_EQ(m_connection->up()->get_state(), torrent::ProtocolBase::IDLE);
+  ASSERT_EQ(m_connection->up_piece().length(), 0u);
+  ASSERT_EQ(m_connection->up()->buffer()->remaining(), 0u);
+  ASSERT_EQ(m_connection->peer_chunks()->upload_queue()->size(), 1u);
+  ASSERT_EQ(m_connection->peer_chunks()->upload_queue()->front(), second);
+  ASSERT_EQ(m_output, expected_piece(first));
+}
+
+// Sockets opened with O_APPEND are refused by sendfile, so the chunk
+// data is copied instead and the connection stops using sendfile.
+TEST_F(test_peer_connection_base, test_up_sendfile_fallback) {
+  ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, m_pipe), 0);
+  ASSERT_EQ(::fcntl(m_pipe[1], F_SETFL, O_APPEND | O_NONBLOCK), 0);
+
+  m_connection =
+    std::make_unique<test_connection>(m_download.ptr()->main(), m_pipe[1]);
+  m_connection->set_up_sendfile(true);
+
+  torrent::Piece first(1, 0, 4096);
+  torrent::Piece second(1, 4096, 4096);
+
+  m_connection->up()->write_have(0);
+  m_connection->prepare_piece(first);
+  queue_piece(second);
+
+  write_all(true);
+
+  ASSERT_FALSE(m_connection->is_up_sendfile());
+  ASSERT_EQ(m_connection->up()->get_state(), torrent::ProtocolBase::IDLE);
+  ASSERT_TRUE(m_connection->peer_chunks()->upload_queue()->empty());
+  ASSERT_EQ(m_output,
+            std::string("\0\0\0\5\4\0\0\0\0", 9) + expected_piece(first) +
+              expected_piece(second));
+}
+
+TEST_F(test_peer_connection_base, test_down_short_read) {
+  open_read_socket();
+
+  torrent::Piece piece = m_connection->start_piece();
+  torrent::Piece next(piece.index(), piece.offset() + piece.length(), 16384);
+  std::string    data = block_data(piece.length());
+
+  send(data.substr(0, 1000));
+
+  ASSERT_FALSE(m_connection->read_piece());
+  ASSERT_FALSE(m_connection->is_down_header_read());
+  ASSERT_EQ(m_connection->transfer()->position(), 1000u);
+  ASSERT_EQ(m_connection->down()->buffer()->size_end(), 0u);
+
+  send(data.substr(1000) + piece_header(next));
+
+  ASSERT_TRUE(m_connection->read_piece());
+  ASSERT_TRUE(m_connection->is_down_header_read());
+  ASSERT_EQ(buffered(), piece_header(next));
+  ASSERT_EQ(m_connection->chunk_data(piece), data);
+}
+
+// Whatever follows the block is read into the header area, and is
+// parsed as usual.
+TEST_F(test_peer_connection_base, test_down_header_message) {
+  open_read_socket();
+
+  torrent::Piece piece = m_connection->start_piece();
+  std::string    data  = block_data(piece.length());
+  std::string    messages("\0\0\0\5\4\0\0\0\3\0\0\0\0", 13);
+
+  send(data + messages);
+
+  ASSERT_TRUE(m_connection->read_piece());
+  ASSERT_TRUE(m_connection->is_down_header_read());
+  ASSERT_EQ(buffered(), messages);
+  ASSERT_EQ(m_connection->chunk_data(piece), data);
+}
+
+// Part of the header leaves the flag unset, so the connection reads
+// the rest before parsing it.
+TEST_F(test_peer_connection_base, test_down_header_split) {
+  open_read_socket();
+
+  torrent::Piece piece = m_connection->start_piece();
+  torrent::Piece next(piece.index(), piece.offset() + piece.length(), 16384);
+  std::string    data = block_data(piece.length());
+
+  send(data + piece_header(next).substr(0, 6));
+
+  ASSERT_TRUE(m_connection->read_piece());
+  ASSERT_FALSE(m_connection->is_down_header_read());
+  ASSERT_EQ(buffered(), piece_header(next).substr(0, 6));
+
+  send(piece_header(next).substr(6));
+
+  auto buffer = m_connection->down()->buffer();
+
+  buffer->move_end(m_connection->read_stream_throws(
+    buffer->end(), torrent::PeerConnectionBase::read_size));
+
+  ASSERT_EQ(buffered(), piece_header(next));
+  ASSERT_EQ(m_connection->chunk_data(piece), data);
+}
+
+// The block and the header are decrypted in order across short reads.
+TEST_F(test_peer_connection_base, test_down_encrypted) {
+  open_read_socket();
+
+  const unsigned char key[] = "test_peer_connection_base";
+
+  torrent::RC4 encrypt(key, sizeof(key));
+  m_connection->set_encryption(torrent::RC4(key, sizeof(key)));
+
+  torrent::Piece piece = m_connection->start_piece();
+  torrent::Piece next(piece.index(), piece.offset() + piece.length(), 16384);
+  std::string    data   = block_data(piece.length());
+  std::string    stream = data + piece_header(next);
+
+  encrypt.crypt(stream.data(), stream.size());
+
+  send(stream.substr(0, 1000));
+
+  ASSERT_FALSE(m_connection->read_piece());
+  ASSERT_EQ(m_connection->transfer()->position(), 1000u);
+
+  send(stream.substr(1000));
+
+  ASSERT_TRUE(m_connection->read_piece());
+  ASSERT_TRUE(m_connection->is_down_header_read());
+  ASSERT_EQ(buffered(), piece_header(next));
+  ASSERT_EQ(m_connection->chunk_data(piece), data);
+}
@@ -0,0 +1,279 @@
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "data/chunk.h"
+#include "data/chunk_list.h"
+#include "download/download_wrapper.h"
+#include "globals.h"
+#include "manager.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/data/file.h"
+#include "torrent/data/file_list.h"
+#include "torrent/data/file_manager.h"
+#include "torrent/download.h"
+#include "torrent/download_info.h"
+#include "torrent/hash_string.h"
+#include "torrent/object.h"
+#include "torrent/torrent.h"
+#include "torrent/utils/timer.h"
+
+#include "test/helpers/fixture.h"
+
+class test_file_list : public test_fixture {
+protected:
+  static constexpr uint32_t chunk_size = 1 << 14;
+
+  void SetUp() override {
+    test_fixture::SetUp();
+
+    char path[] = "/tmp/test_file_list.XXXXXX";
+    ASSERT_NE(mkdtemp(path), nullptr);
+    m_root = path;
+
+    torrent::cachedTime = torrent::utils::timer::current();
+    torrent::manager    = new torrent::Manager;
+    torrent::manager->file_manager()->set_max_open_files(16);
+
+    // Without the disk thread running, sync in place.
+    torrent::manager->chunk_manager()->set_sync_queue(nullptr);
+  }
+
+  void TearDown() override {
+    delete torrent::manager;
+    torrent::manager = nullptr;
+
+    for (auto name : { "a", "b", "c", m_parts.c_str() })
+      ::unlink((m_root + "/" + name).c_str());
+
+    ::rmdir(m_root.c_str());
+
+    test_fixture::TearDown();
+  }
+
+  // File 'b' shares chunk 0 with 'a' and chunk 1 with 'c'.
+  torrent::Download create_download() {
+    auto  torrent = new torrent::Object(torrent::Object::create_map());
+    auto& info    = torrent->insert_key("info", torrent::Object::create_map());
+    auto& files   = info.insert_key("files", torrent::Object::create_list());
+
+    for (auto [name, length] : { std::pair("a", 10000),
+                                 std::pair("b", 20000),
+                                 std::pair("c", 10000) }) {
+      files.as_list().push_back(torrent::Object::create_map());
+      files.as_list().back().insert_key("length", (int64_t)length);
+      files.as_list()
+        .back()
+        .insert_key("path", torrent::Object::create_list())
+        .as_list()
+        .push_back(name);
+    }
+
+    torrent->insert_key("announce", "udp://127.0.0.1:6969");
+
+    info.insert_key("name", "test");
+    info.insert_key("piece length", (int64_t)chunk_size);
+    info.insert_key("pieces", std::string(20 * 3, 'p'));
+
+    torrent::Download download = torrent::download_add(torrent);
+
+    download.file_list()->set_root_dir(m_root);
+    m_parts = "." + torrent::hash_string_to_hex_str(download.info()->hash()) +
+              ".parts";
+
+    return download;
+  }
+
+  bool exists(const std::string& name) {
+    return ::access((m_root + "/" + name).c_str(), F_OK) == 0;
+  }
+
+  std::string m_root;
+  std::string m_parts;
+};
+
+TEST_F(test_file_list, test_part_file_create) {
+  torrent::Download  download  = create_download();
+  torrent::FileList* file_list = download.file_list();
+
+  (*file_list)[1]->set_priority(torrent::PRIORITY_OFF);
+  download.update_priorities();
+  download.open();
+
+  torrent::ChunkList*  chunk_list = download.ptr()->chunk_list();
+  torrent::ChunkHandle handle =
+    chunk_list->get(0, torrent::ChunkList::get_writable);
+
+  ASSERT_TRUE(handle.is_valid());
+  ASSERT_TRUE(exists("a"));
+  ASSERT_FALSE(exists("b"));
+  ASSERT_TRUE(exists(m_parts));
+  ASSERT_TRUE((*file_list)[1]->is_part_file());
+
+  chunk_list->release(&handle);
+  torrent::download_remove(download);
+}
+
+TEST_F(test_file_list, test_part_file_migrate) {
+  torrent::Download  download  = create_download();
+  torrent::FileList* file_list = download.file_list();
+
+  (*file_list)[1]->set_priority(torrent::PRIORITY_OFF);
+  download.update_priorities();
+  download.open();
+
+  torrent::ChunkList*  chunk_list = download.ptr()->chunk_list();
+  torrent::ChunkHandle handle =
+    chunk_list->get(0, torrent::ChunkList::get_writable);
+
+  ASSERT_TRUE(handle.is_valid());
+
+  std::vector<char> data(chunk_size);
+
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<char>(i * 7);
+
+  ASSERT_TRUE(handle.chunk()->from_buffer(data.data(), 0, chunk_size));
+  chunk_list->release(&handle);
+
+  // The boundary chunk is still mapped, so it gets flushed and 'b'
+  // is moved on the following tick.
+  (*file_list)[1]->set_priority(torrent::PRIORITY_NORMAL);
+  download.update_priorities();
+
+  ASSERT_FALSE(exists("b"));
+  ASSERT_FALSE((*chunk_list)[0].is_valid());
+
+  download.ptr()->receive_tick(1);
+
+  ASSERT_TRUE(exists("b"));
+  ASSERT_FALSE(exists(m_parts));
+  ASSERT_FALSE((*file_list)[1]->is_part_file());
+
+  std::vector<char> result(chunk_size - 10000);
+  std::string       path = m_root + "/b";
+  FILE*             file = fopen(path.c_str(), "r");
+
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(fread(result.data(), 1, result.size(), file), result.size());
+  fclose(file);
+
+  ASSERT_EQ(std::memcmp(result.data(), data.data() + 10000, result.size()), 0);
+
+  torrent::download_remove(download);
+}
+
+// Only chunk 2 lies entirely within 'c', the shared chunks 0 and 1 are
+// never reclaimed.
+TEST_F(test_file_list, test_reclaim_space) {
+  torrent::Download  download  = create_download();
+  torrent::FileList* file_list = download.file_list();
+
+  download.open();
+  download.set_bitfield(true);
+  ASSERT_TRUE(download.hash_check(true));
+
+  torrent::utils::priority_queue_perform(&torrent::taskScheduler,
+                                         torrent::cachedTime);
+
+  ASSERT_TRUE(download.is_hash_checked());
+
+  torrent::ChunkList*  chunk_list = download.ptr()->chunk_list();
+  torrent::ChunkHandle handle =
+    chunk_list->get(2, torrent::ChunkList::get_writable);
+
+  ASSERT_TRUE(handle.is_valid());
+
+  std::vector<char> data(handle.chunk()->chunk_size(), 'x');
+
+  ASSERT_TRUE(handle.chunk()->from_buffer(data.data(), 0, data.size()));
+  chunk_list->release(&handle);
+  chunk_list->sync_chunks(torrent::ChunkList::sync_all |
+                          torrent::ChunkList::sync_force);
+
+  ASSERT_EQ((*file_list)[1]->completed_chunks(), 2u);
+  ASSERT_EQ((*file_list)[2]->completed_chunks(), 2u);
+
+  (*file_list)[1]->set_priority(torrent::PRIORITY_OFF);
+  (*file_list)[2]->set_priority(torrent::PRIORITY_OFF);
+
+  // Nothing is reclaimed unless asked for.
+  download.ptr()->receive_tick(4);
+
+  ASSERT_EQ(file_list->completed_chunks(), 3u);
+
+  file_list->set_reclaim_space(true);
+  download.ptr()->receive_tick(4);
+
+  ASSERT_TRUE(file_list->bitfield()->get(0));
+  ASSERT_TRUE(file_list->bitfield()->get(1));
+  ASSERT_FALSE(file_list->bitfield()->get(2));
+  ASSERT_EQ(file_list->completed_chunks(), 2u);
+  ASSERT_EQ((*file_list)[0]->completed_chunks(), 1u);
+  ASSERT_EQ((*file_list)[1]->completed_chunks(), 2u);
+  ASSERT_EQ((*file_list)[2]->completed_chunks(), 1u);
+
+  std::vector<char> result(data.size());
+  std::string       path = m_root + "/c";
+  FILE*             file = fopen(path.c_str(), "r");
+
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(fseek(file, 2 * chunk_size - 30000, SEEK_SET), 0);
+  ASSERT_EQ(fread(result.data(), 1, result.size(), file), result.size());
+  fclose(file);
+
+  ASSERT_EQ(result, std::vector<char>(result.size(), 0));
+
+  torrent::download_remove(download);
+}
+
+// Referenced chunks are left for a later tick, while those only kept
+// by the read cache are evicted.
+TEST_F(test_file_list, test_reclaim_space_busy) {
+  torrent::Download  download  = create_download();
+  torrent::FileList* file_list = download.file_list();
+
+  download.open();
+  download.set_bitfield(true);
+  ASSERT_TRUE(download.hash_check(true));
+
+  torrent::utils::priority_queue_perform(&torrent::taskScheduler,
+                                         torrent::cachedTime);
+
+  ASSERT_TRUE(download.is_hash_checked());
+
+  torrent::ChunkList*  chunk_list = download.ptr()->chunk_list();
+  torrent::ChunkHandle handle =
+    chunk_list->get(2, torrent::ChunkList::get_writable);
+
+  ASSERT_TRUE(handle.is_valid());
+
+  chunk_list->release(&handle);
+  chunk_list->sync_chunks(torrent::ChunkList::sync_all |
+                          torrent::ChunkList::sync_force);
+
+  handle = chunk_list->get(2);
+
+  ASSERT_TRUE(handle.is_valid());
+
+  (*file_list)[2]->set_priority(torrent::PRIORITY_OFF);
+  (*file_list)[2]->set_flags(torrent::File::flag_reclaim_space);
+  download.ptr()->receive_tick(4);
+
+  ASSERT_TRUE(file_list->bitfield()->get(2));
+  ASSERT_EQ((*file_list)[2]->completed_chunks(), 2u);
+
+  chunk_list->release(&handle);
+
+  ASSERT_TRUE((*chunk_list)[2].is_valid());
+
+  download.ptr()->receive_tick(4);
+
+  ASSERT_FALSE((*chunk_list)[2].is_valid());
+  ASSERT_FALSE(file_list->bitfield()->get(2));
+  ASSERT_EQ((*file_list)[2]->completed_chunks(), 1u);
+
+  torrent::download_remove(download);
+}
@@ -0,0 +1,74 @@
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+#include "data/memory_chunk.h"
+#include "torrent/data/file.h"
+#include "torrent/data/file_manager.h"
+
+#include "test/helpers/fixture.h"
+
+class test_file_manager : public test_fixture {};
+
+namespace {
+
+class test_file : public torrent::File {
+public:
+  using File::set_frozen_path;
+};
+
+} // namespace
+
+TEST_F(test_file_manager, test_least_active) {
+  const int prot = torrent::MemoryChunk::prot_read;
+
+  torrent::FileManager file_manager;
+  file_manager.set_max_open_files(4);
+
+  test_file files[6];
+
+  for (auto& file : files) {
+    char path[] = "/tmp/test_file_manager.XXXXXX";
+    int  fd     = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    ::close(fd);
+
+    file.set_frozen_path(path);
+  }
+
+  for (int i = 0; i != 4; i++) {
+    files[i].set_last_touched(i + 1);
+    ASSERT_TRUE(file_manager.open(&files[i], prot, 0));
+  }
+
+  ASSERT_EQ(file_manager.open_files(), 4);
+
+  // The oldest file was touched after it was opened, so the next one
+  // is closed instead.
+  files[0].set_last_touched(10);
+
+  ASSERT_TRUE(file_manager.open(&files[4], prot, 0));
+  ASSERT_EQ(file_manager.open_files(), 4);
+  ASSERT_TRUE(files[0].is_open());
+  ASSERT_FALSE(files[1].is_open());
+
+  ASSERT_TRUE(file_manager.open(&files[5], prot, 0));
+  ASSERT_TRUE(files[0].is_open());
+  ASSERT_FALSE(files[2].is_open());
+
+  // Closing from the middle keeps the remaining files reachable.
+  file_manager.close(&files[4]);
+  ASSERT_EQ(file_manager.open_files(), 3);
+
+  ASSERT_TRUE(file_manager.open(&files[1], prot, 0));
+  ASSERT_TRUE(files[3].is_open());
+
+  for (auto& file : files) {
+    file_manager.close(&file);
+    ::unlink(file.frozen_path().c_str());
+  }
+
+  ASSERT_EQ(file_manager.open_files(), 0);
+  ASSERT_EQ(file_manager.files_opened_counter(), 7);
+  ASSERT_EQ(file_manager.files_closed_counter(), 7);
+}
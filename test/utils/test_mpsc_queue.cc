@@ -0,0 +1,81 @@
+#include <thread>
+#include <vector>
+
+#include "utils/mpsc_queue.h"
+
+#include "test/helpers/fixture.h"
+
+class test_mpsc_queue : public test_fixture {};
+
+namespace {
+
+struct node_type {
+  unsigned int producer{ 0 };
+  unsigned int sequence{ 0 };
+  node_type*   next{ nullptr };
+};
+
+using queue_type = torrent::mpsc_queue<node_type, &node_type::next>;
+
+} // namespace
+
+TEST_F(test_mpsc_queue, test_basic) {
+  queue_type queue;
+  node_type  nodes[3];
+
+  ASSERT_TRUE(queue.empty());
+  ASSERT_EQ(queue.pop_all(), nullptr);
+
+  ASSERT_TRUE(queue.push(&nodes[0]));
+  ASSERT_FALSE(queue.push(&nodes[1]));
+  ASSERT_FALSE(queue.push(&nodes[2]));
+  ASSERT_FALSE(queue.empty());
+
+  node_type* node = queue.pop_all();
+
+  ASSERT_TRUE(queue.empty());
+  ASSERT_EQ(node, &nodes[0]);
+  ASSERT_EQ(node->next, &nodes[1]);
+  ASSERT_EQ(node->next->next, &nodes[2]);
+  ASSERT_EQ(node->next->next->next, nullptr);
+
+  ASSERT_TRUE(queue.push(&nodes[1]));
+  ASSERT_EQ(queue.pop_all(), &nodes[1]);
+}
+
+TEST_F(test_mpsc_queue, test_producers) {
+  const unsigned int producer_count = 4;
+  const unsigned int node_count     = 10000;
+
+  queue_type                          queue;
+  std::vector<std::vector<node_type>> nodes(producer_count,
+                                            std::vector<node_type>(node_count));
+  std::vector<std::thread>            producers;
+
+  for (unsigned int i = 0; i < producer_count; i++)
+    producers.emplace_back([&queue, &nodes, i]() {
+      for (unsigned int j = 0; j < node_count; j++) {
+        nodes[i][j].producer = i;
+        nodes[i][j].sequence = j;
+        queue.push(&nodes[i][j]);
+      }
+    });
+
+  // Each producer's nodes must arrive in the order they were pushed.
+  std::vector<unsigned int> received(producer_count, 0);
+  unsigned int              total = 0;
+
+  while (total != producer_count * node_count) {
+    for (node_type* node = queue.pop_all(); node != nullptr;
+         node            = node->next) {
+      ASSERT_EQ(node->sequence, received[node->producer]);
+      received[node->producer]++;
+      total++;
+    }
+  }
+
+  for (auto& thread : producers)
+    thread.join();
+
+  ASSERT_TRUE(queue.empty());
+}
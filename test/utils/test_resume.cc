@@ -0,0 +1,192 @@
+#include <cstdlib>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/stat.h>
+
+#include "download/download_constructor.h"
+#include "download/download_wrapper.h"
+#include "torrent/bitfield.h"
+#include "torrent/data/file.h"
+#include "torrent/data/file_list.h"
+#include "torrent/download.h"
+#include "torrent/download_info.h"
+#include "torrent/object.h"
+#include "torrent/torrent.h"
+#include "torrent/utils/resume.h"
+
+#include "test/helpers/fixture.h"
+
+class test_resume : public test_fixture {
+protected:
+  static constexpr uint32_t chunk_size  = 1 << 14;
+  static constexpr uint32_t chunk_count = 4;
+
+  void SetUp() override {
+    test_fixture::SetUp();
+
+    char path[] = "/tmp/test_resume.XXXXXX";
+    ASSERT_NE(mkdtemp(path), nullptr);
+
+    m_root = path;
+    m_file = m_root + "/data";
+
+    int fd = ::open(m_file.c_str(), O_RDWR | O_CREAT, 0644);
+    ASSERT_NE(fd, -1);
+    ASSERT_EQ(::ftruncate(fd, chunk_size * chunk_count), 0);
+    ::close(fd);
+  }
+
+  void TearDown() override {
+    ::unlink(m_file.c_str());
+    ::rmdir(m_root.c_str());
+
+    test_fixture::TearDown();
+  }
+
+  std::unique_ptr<torrent::DownloadWrapper> create_download() {
+    auto wrapper = std::make_unique<torrent::DownloadWrapper>();
+
+    torrent::Object torrent = torrent::Object::create_map();
+    torrent::Object& info =
+      torrent.insert_key("info", torrent::Object::create_map());
+
+    info.insert_key("name", "data");
+    info.insert_key("length", (int64_t)chunk_size * chunk_count);
+    info.insert_key("piece length", (int64_t)chunk_size);
+    info.insert_key("pieces", std::string(20 * chunk_count, 'p'));
+
+    torrent::EncodingList        encodings;
+    torrent::DownloadConstructor ctor;
+
+    ctor.set_download(wrapper.get());
+    ctor.set_encoding_list(&encodings);
+    ctor.initialize(torrent);
+
+    wrapper->initialize(std::string(20, 'h'), std::string(20, 'i'));
+    wrapper->file_list()->set_root_dir(m_root);
+
+    return wrapper;
+  }
+
+  // Resume data saved during a hash check, where the chunks before
+  // the unchecked one are done and the file was downloading.
+  torrent::Object create_checkpoint() {
+    auto              wrapper = create_download();
+    torrent::Download download(wrapper.get());
+    torrent::Object   object     = torrent::Object::create_map();
+    uint8_t           bitfield[] = { 0xf0 };
+
+    download.set_bitfield(bitfield, bitfield + sizeof(bitfield));
+    download.update_range(torrent::Download::update_range_recheck, 2, 3);
+
+    torrent::resume_save_hash_checkpoint(
+      download, download.hash_unchecked_ranges(), object);
+
+    auto& files = object.insert_key("files", torrent::Object::create_list());
+
+    files.as_list().push_back(torrent::Object::create_map());
+    files.as_list().back().insert_key("mtime", ~int64_t(3));
+
+    return object;
+  }
+
+  std::string m_root;
+  std::string m_file;
+};
+
+TEST_F(test_resume, test_checkpoint_round_trip) {
+  torrent::Object object = create_checkpoint();
+
+  ASSERT_TRUE(object.has_key_map("hash_checkpoint"));
+
+  auto              wrapper = create_download();
+  torrent::Download download(wrapper.get());
+
+  torrent::resume_load_progress(download, object);
+
+  const torrent::Bitfield* bitfield = download.file_list()->bitfield();
+
+  ASSERT_TRUE(bitfield->get(0));
+  ASSERT_TRUE(bitfield->get(1));
+  ASSERT_FALSE(bitfield->get(2));
+  ASSERT_TRUE(bitfield->get(3));
+
+  auto unchecked = download.hash_unchecked_ranges();
+
+  ASSERT_EQ(unchecked.size(), 1);
+  ASSERT_EQ(unchecked.begin()->first, 2);
+  ASSERT_EQ(unchecked.begin()->second, 3);
+}
+
+TEST_F(test_resume, test_checkpoint_stale) {
+  torrent::Object object = create_checkpoint();
+
+  // Move the mtime away from the one recorded in the checkpoint.
+  struct stat st;
+  ASSERT_EQ(::stat(m_file.c_str(), &st), 0);
+
+  struct timespec times[2] = { st.st_atim, st.st_mtim };
+  times[1].tv_sec -= 3600;
+  ASSERT_EQ(::utimensat(AT_FDCWD, m_file.c_str(), times, 0), 0);
+
+  auto              wrapper = create_download();
+  torrent::Download download(wrapper.get());
+
+  torrent::resume_load_progress(download, object);
+
+  ASSERT_EQ(download.file_list()->bitfield()->size_set(), 0);
+
+  auto unchecked = download.hash_unchecked_ranges();
+
+  ASSERT_EQ(unchecked.size(), 1);
+  ASSERT_EQ(unchecked.begin()->first, 0);
+  ASSERT_EQ(unchecked.begin()->second, chunk_count);
+}
+
+TEST_F(test_resume, test_checkpoint_file_checks) {
+  torrent::Object object = create_checkpoint();
+
+  // The per-file checks still apply on top of the checkpoint, a file
+  // that should not be created has its range cleared.
+  object.get_key_list("files").front().insert_key("mtime", ~int64_t(1));
+
+  auto              wrapper = create_download();
+  torrent::Download download(wrapper.get());
+
+  torrent::resume_load_progress(download, object);
+
+  ASSERT_EQ(download.file_list()->bitfield()->size_set(), 0);
+  ASSERT_FALSE(download.file_list()->front()->is_create_queued());
+}
+
+TEST_F(test_resume, test_checkpoint_uncertain_pieces) {
+  torrent::Object object = create_checkpoint();
+
+  auto              wrapper = create_download();
+  torrent::Download download(wrapper.get());
+
+  uint32_t uncertain = htonl(1);
+
+  object.insert_key("uncertain_pieces",
+                    std::string((const char*)&uncertain, sizeof(uncertain)));
+  object.insert_key("uncertain_pieces.timestamp",
+                    (int64_t)download.info()->load_date() - 1);
+
+  torrent::resume_load_progress(download, object);
+
+  const torrent::Bitfield* bitfield = download.file_list()->bitfield();
+
+  ASSERT_TRUE(bitfield->get(0));
+  ASSERT_FALSE(bitfield->get(1));
+  ASSERT_FALSE(bitfield->get(2));
+  ASSERT_TRUE(bitfield->get(3));
+
+  auto unchecked = download.hash_unchecked_ranges();
+
+  ASSERT_EQ(unchecked.size(), 1);
+  ASSERT_EQ(unchecked.begin()->first, 1);
+  ASSERT_EQ(unchecked.begin()->second, 3);
+}
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <vector>
+
+#include "torrent/hash_string.h"
+#include "utils/sha1.h"
+
+#include "test/helpers/fixture.h"
+
+class test_sha1 : public test_fixture {};
+
+static torrent::HashString
+sha1_single(const char* data, unsigned int length) {
+  torrent::Sha1       sha1;
+  torrent::HashString hash;
+
+  sha1.init();
+  sha1.update(data, length);
+  sha1.final_c(hash.data());
+
+  return hash;
+}
+
+static void
+verify_multi(unsigned int lanes, unsigned int length, unsigned int split) {
+  std::vector<std::vector<char>> buffers(lanes, std::vector<char>(length));
+
+  for (unsigned int lane = 0; lane < lanes; lane++)
+    for (unsigned int i = 0; i < length; i++)
+      buffers[lane][i] = static_cast<char>(lane * 131 + i * 7 + (i >> 8));
+
+  torrent::Sha1Multi  sha1;
+  torrent::HashString hashes[torrent::Sha1Multi::max_lanes];
+  char*               results[torrent::Sha1Multi::max_lanes];
+  const void*         data[torrent::Sha1Multi::max_lanes];
+
+  sha1.init(lanes);
+  ASSERT_EQ(sha1.lanes(), lanes);
+
+  for (unsigned int position = 0; position < length;) {
+    unsigned int l = std::min(split, length - position);
+
+    for (unsigned int lane = 0; lane < lanes; lane++)
+      data[lane] = buffers[lane].data() + position;
+
+    sha1.update(data, l);
+    position += l;
+  }
+
+  for (unsigned int lane = 0; lane < lanes; lane++)
+    results[lane] = hashes[lane].data();
+
+  sha1.final_c(results);
+
+  for (unsigned int lane = 0; lane < lanes; lane++)
+    ASSERT_EQ(hashes[lane], sha1_single(buffers[lane].data(), length))
+      << "lanes:" << lanes << " length:" << length << " split:" << split
+      << " lane:" << lane;
+}
+
+TEST_F(test_sha1, test_preferred_lanes) {
+  auto lanes = torrent::Sha1Multi::preferred_lanes();
+
+  ASSERT_GE(lanes, 1u);
+  ASSERT_LE(lanes, torrent::Sha1Multi::max_lanes);
+
+  if (!torrent::Sha1Multi::is_supported()) {
+    ASSERT_EQ(lanes, 1u);
+  }
+}
+
+TEST_F(test_sha1, test_multi_lanes) {
+  if (!torrent::Sha1Multi::is_supported())
+    GTEST_SKIP() << "no multi-buffer kernel for this CPU";
+
+  for (unsigned int lanes = 1; lanes <= torrent::Sha1Multi::max_lanes; lanes++)
+    verify_multi(lanes, 16 << 10, 16 << 10);
+}
+
+TEST_F(test_sha1, test_multi_lengths) {
+  if (!torrent::Sha1Multi::is_supported())
+    GTEST_SKIP() << "no multi-buffer kernel for this CPU";
+
+  for (unsigned int length : {0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 1000})
+    verify_multi(7, length, length + 1);
+}
+
+TEST_F(test_sha1, test_multi_split_updates) {
+  if (!torrent::Sha1Multi::is_supported())
+    GTEST_SKIP() << "no multi-buffer kernel for this CPU";
+
+  for (unsigned int split : {1, 3, 63, 64, 100, 4096})
+    verify_multi(16, 10000, split);
+}